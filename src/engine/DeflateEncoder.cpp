@@ -0,0 +1,236 @@
+#include "engine/DeflateEncoder.h"
+
+#include <algorithm>
+
+namespace {
+
+	const int windowSize = 32768;
+	const int minMatch = 3;
+	const int maxMatch = 258;
+	const int maxChain = 64;
+	const int hashBits = 15;
+	const int64_t noPosition = INT64_MIN; // dictionary bytes have negative positions so -1 cannot be used
+
+	const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const int distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const int distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	uint32_t hash3(const uint8_t* p) {
+		return (((uint32_t)p[0] << 10) ^ ((uint32_t)p[1] << 5) ^ p[2]) & ((1 << hashBits) - 1);
+	}
+
+}
+
+DeflateEncoder::DeflateEncoder(std::vector<uint8_t>& out) :
+	out(out),
+	head(1 << hashBits, noPosition),
+	prev(windowSize, noPosition)
+{
+}
+
+void DeflateEncoder::setDictionary(const uint8_t* data, size_t size)
+{
+	if (size > windowSize) {
+		data += size - windowSize;
+		size = windowSize;
+	}
+
+	buffer.assign(data, data + size);
+	bufferOffset = -(int64_t)size;
+	bufferPos = size;
+
+	for (size_t i = 0; i + minMatch <= size; i++)
+		insertHash(i);
+}
+
+void DeflateEncoder::write(const uint8_t* data, size_t size)
+{
+	// feed large writes in slices so the buffer never holds much more than the history it needs
+	while (size > 0) {
+		size_t slice = std::min(size, (size_t)windowSize);
+		buffer.insert(buffer.end(), data, data + slice);
+		data += slice;
+		size -= slice;
+
+		compress(false);
+	}
+}
+
+void DeflateEncoder::flush()
+{
+	compress(true);
+	if (blockOpen)
+		endBlock();
+
+	// empty stored block, this leaves the stream byte aligned
+	putBits(0, 1);
+	putBits(0, 2);
+	alignToByte();
+	out.push_back(0x00);
+	out.push_back(0x00);
+	out.push_back(0xFF);
+	out.push_back(0xFF);
+}
+
+void DeflateEncoder::finish()
+{
+	if (finished)
+		return;
+
+	compress(true);
+	if (blockOpen)
+		endBlock();
+
+	beginBlock(true);
+	endBlock();
+	alignToByte();
+	finished = true;
+}
+
+void DeflateEncoder::compress(bool drain)
+{
+	size_t end = buffer.size();
+
+	while (bufferPos < end && (drain || bufferPos + maxMatch <= end)) {
+		if (!blockOpen)
+			beginBlock(false);
+
+		int bestLength = 0;
+		int bestDistance = 0;
+
+		if (bufferPos + minMatch <= end) {
+			int64_t absolutePos = bufferOffset + (int64_t)bufferPos;
+			int64_t candidate = head[hash3(&buffer[bufferPos])];
+			int maxLength = (int)std::min((size_t)maxMatch, end - bufferPos);
+
+			for (int chain = 0; chain < maxChain && candidate >= bufferOffset && absolutePos - candidate <= windowSize; chain++) {
+				const uint8_t* a = &buffer[(size_t)(candidate - bufferOffset)];
+				const uint8_t* b = &buffer[bufferPos];
+
+				int length = 0;
+				while (length < maxLength && a[length] == b[length])
+					length++;
+
+				if (length > bestLength) {
+					bestLength = length;
+					bestDistance = (int)(absolutePos - candidate);
+					if (length == maxLength)
+						break;
+				}
+
+				int64_t next = prev[candidate & (windowSize - 1)];
+				if (next >= candidate)
+					break;
+				candidate = next;
+			}
+		}
+
+		if (bestLength >= minMatch) {
+			putMatch(bestLength, bestDistance);
+			for (int i = 0; i < bestLength; i++) {
+				if (bufferPos + minMatch <= end)
+					insertHash(bufferPos);
+				bufferPos++;
+			}
+		}
+		else {
+			putLiteral(buffer[bufferPos]);
+			if (bufferPos + minMatch <= end)
+				insertHash(bufferPos);
+			bufferPos++;
+		}
+	}
+
+	slideWindow();
+}
+
+void DeflateEncoder::putBits(uint32_t value, int count)
+{
+	bitBuffer |= (uint64_t)value << bitCount;
+	bitCount += count;
+
+	while (bitCount >= 8) {
+		out.push_back((uint8_t)bitBuffer);
+		bitBuffer >>= 8;
+		bitCount -= 8;
+	}
+}
+
+void DeflateEncoder::putHuffman(uint32_t code, int length)
+{
+	// huffman codes are packed starting from their most significant bit
+	uint32_t reversed = 0;
+	for (int i = 0; i < length; i++) {
+		reversed = (reversed << 1) | (code & 1);
+		code >>= 1;
+	}
+	putBits(reversed, length);
+}
+
+void DeflateEncoder::putLiteral(int literal)
+{
+	if (literal < 144)
+		putHuffman(0x30 + literal, 8);
+	else if (literal < 256)
+		putHuffman(0x190 + literal - 144, 9);
+	else if (literal < 280)
+		putHuffman(literal - 256, 7);
+	else
+		putHuffman(0xC0 + literal - 280, 8);
+}
+
+void DeflateEncoder::putMatch(int length, int distance)
+{
+	int lengthCode = 28;
+	while (lengthBase[lengthCode] > length)
+		lengthCode--;
+
+	putLiteral(257 + lengthCode);
+	putBits(length - lengthBase[lengthCode], lengthExtra[lengthCode]);
+
+	int distCode = 29;
+	while (distBase[distCode] > distance)
+		distCode--;
+
+	putHuffman(distCode, 5);
+	putBits(distance - distBase[distCode], distExtra[distCode]);
+}
+
+void DeflateEncoder::beginBlock(bool final)
+{
+	putBits(final ? 1 : 0, 1);
+	putBits(1, 2); // fixed huffman codes
+	blockOpen = true;
+}
+
+void DeflateEncoder::endBlock()
+{
+	putLiteral(256);
+	blockOpen = false;
+}
+
+void DeflateEncoder::alignToByte()
+{
+	if (bitCount > 0)
+		putBits(0, 8 - bitCount);
+}
+
+void DeflateEncoder::insertHash(size_t pos)
+{
+	int64_t absolutePos = bufferOffset + (int64_t)pos;
+	uint32_t h = hash3(&buffer[pos]);
+	prev[absolutePos & (windowSize - 1)] = head[h];
+	head[h] = absolutePos;
+}
+
+void DeflateEncoder::slideWindow()
+{
+	if (bufferPos <= windowSize)
+		return;
+
+	size_t drop = bufferPos - windowSize;
+	buffer.erase(buffer.begin(), buffer.begin() + drop);
+	bufferPos -= drop;
+	bufferOffset += (int64_t)drop;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// streaming raw deflate (rfc 1951) compressor using lz77 with hash chains and the fixed huffman codes
+// memory use is bounded by the 32KB window no matter how much data is written, compressed bytes are appended to 'out' as they are produced
+// the caller is responsible for any zlib / png framing around the stream
+class DeflateEncoder {
+public:
+	DeflateEncoder(std::vector<uint8_t>& out);
+
+	DeflateEncoder(const DeflateEncoder&) = delete;
+
+	// primes the match window with data that comes before this stream, must be called before the first write
+	// used when several encoders each compress one part of a larger stream so that matches can reach back into the previous part
+	void setDictionary(const uint8_t* data, size_t size);
+
+	void write(const uint8_t* data, size_t size);
+
+	// ends the current block and pads the output to a byte boundary with an empty stored block
+	// streams ending in a flush can be concatenated, the last one must end with finish() instead
+	void flush();
+
+	// ends the stream with a final block, nothing can be written afterwards
+	void finish();
+
+private:
+	void compress(bool drain);
+
+	void putBits(uint32_t value, int count);
+	void putHuffman(uint32_t code, int length);
+	void putLiteral(int literal);
+	void putMatch(int length, int distance);
+
+	void beginBlock(bool final);
+	void endBlock();
+	void alignToByte();
+
+	void insertHash(size_t pos);
+	void slideWindow();
+
+	std::vector<uint8_t>& out;
+
+	uint64_t bitBuffer = 0;
+	int bitCount = 0;
+	bool blockOpen = false;
+	bool finished = false;
+
+	std::vector<uint8_t> buffer; // already compressed history followed by pending input
+	size_t bufferPos = 0;        // index into 'buffer' of the next byte to compress
+	int64_t bufferOffset = 0;    // absolute stream position of buffer[0]
+
+	std::vector<int64_t> head;   // most recent absolute position for each hash
+	std::vector<int64_t> prev;   // previous absolute position with the same hash, indexed by position & (window size - 1)
+};
@@ -0,0 +1,390 @@
+#include "engine/Json.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+	class JsonParser {
+	public:
+		JsonParser(const std::string& text) : text(text) {}
+
+		bool parse(JsonValue& value, std::string& error) {
+			if (!parseValue(value, 0)) {
+				error = message + " at character " + std::to_string(position);
+				return false;
+			}
+
+			skipSpaces();
+			if (position != text.size()) {
+				error = "unexpected text after the value at character " + std::to_string(position);
+				return false;
+			}
+			return true;
+		}
+
+	private:
+		void skipSpaces() {
+			while (position < text.size() && (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' || text[position] == '\r'))
+				position++;
+		}
+
+		bool fail(const char* text) {
+			message = text;
+			return false;
+		}
+
+		bool literal(const char* word) {
+			size_t length = strlen(word);
+			if (text.compare(position, length, word) != 0)
+				return false;
+			position += length;
+			return true;
+		}
+
+		bool parseValue(JsonValue& value, int depth) {
+			if (depth > 64)
+				return fail("nested too deeply");
+
+			skipSpaces();
+			if (position >= text.size())
+				return fail("expected a value");
+
+			char c = text[position];
+			if (c == '{')
+				return parseObject(value, depth);
+			if (c == '[')
+				return parseArray(value, depth);
+			if (c == '"') {
+				std::string s;
+				if (!parseString(s))
+					return false;
+				value = JsonValue(s);
+				return true;
+			}
+			if (literal("true")) {
+				value = JsonValue(true);
+				return true;
+			}
+			if (literal("false")) {
+				value = JsonValue(false);
+				return true;
+			}
+			if (literal("null")) {
+				value = JsonValue();
+				return true;
+			}
+
+			const char* begin = text.c_str() + position;
+			char* end;
+			double number = strtod(begin, &end);
+			if (end == begin || !std::isfinite(number))
+				return fail("expected a value");
+			position += end - begin;
+			value = JsonValue(number);
+			return true;
+		}
+
+		bool parseObject(JsonValue& value, int depth) {
+			value = JsonValue::object();
+			position++;
+
+			skipSpaces();
+			if (position < text.size() && text[position] == '}') {
+				position++;
+				return true;
+			}
+
+			while (true) {
+				skipSpaces();
+				std::string key;
+				if (position >= text.size() || text[position] != '"' || !parseString(key))
+					return fail("expected a member name");
+
+				skipSpaces();
+				if (position >= text.size() || text[position] != ':')
+					return fail("expected ':'");
+				position++;
+
+				JsonValue member;
+				if (!parseValue(member, depth + 1))
+					return false;
+				value.set(key, member);
+
+				skipSpaces();
+				if (position < text.size() && text[position] == ',') {
+					position++;
+					continue;
+				}
+				if (position < text.size() && text[position] == '}') {
+					position++;
+					return true;
+				}
+				return fail("expected ',' or '}'");
+			}
+		}
+
+		bool parseArray(JsonValue& value, int depth) {
+			value = JsonValue::array();
+			position++;
+
+			skipSpaces();
+			if (position < text.size() && text[position] == ']') {
+				position++;
+				return true;
+			}
+
+			while (true) {
+				JsonValue element;
+				if (!parseValue(element, depth + 1))
+					return false;
+				value.append(element);
+
+				skipSpaces();
+				if (position < text.size() && text[position] == ',') {
+					position++;
+					continue;
+				}
+				if (position < text.size() && text[position] == ']') {
+					position++;
+					return true;
+				}
+				return fail("expected ',' or ']'");
+			}
+		}
+
+		bool parseString(std::string& s) {
+			position++;
+
+			while (position < text.size()) {
+				char c = text[position++];
+				if (c == '"')
+					return true;
+				if (c != '\\') {
+					s += c;
+					continue;
+				}
+
+				if (position >= text.size())
+					break;
+				char escape = text[position++];
+				switch (escape) {
+				case '"': s += '"'; break;
+				case '\\': s += '\\'; break;
+				case '/': s += '/'; break;
+				case 'b': s += '\b'; break;
+				case 'f': s += '\f'; break;
+				case 'n': s += '\n'; break;
+				case 'r': s += '\r'; break;
+				case 't': s += '\t'; break;
+				case 'u': {
+					if (position + 4 > text.size())
+						return fail("bad \\u escape");
+					unsigned int code = (unsigned int)strtoul(text.substr(position, 4).c_str(), nullptr, 16);
+					position += 4;
+
+					// surrogate pairs are not joined, nothing this is used for needs characters outside the basic plane
+					if (code < 0x80) {
+						s += (char)code;
+					}
+					else if (code < 0x800) {
+						s += (char)(0xC0 | (code >> 6));
+						s += (char)(0x80 | (code & 0x3F));
+					}
+					else {
+						s += (char)(0xE0 | (code >> 12));
+						s += (char)(0x80 | ((code >> 6) & 0x3F));
+						s += (char)(0x80 | (code & 0x3F));
+					}
+					break;
+				}
+				default:
+					return fail("bad escape in string");
+				}
+			}
+
+			return fail("unterminated string");
+		}
+
+		const std::string& text;
+		size_t position = 0;
+		std::string message;
+	};
+
+	void serializeString(const std::string& s, std::string& out) {
+		out += '"';
+		for (char c : s) {
+			switch (c) {
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if ((unsigned char)c < 0x20) {
+					char escape[8];
+					snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char)c);
+					out += escape;
+				}
+				else {
+					out += c;
+				}
+			}
+		}
+		out += '"';
+	}
+
+	void serializeValue(const JsonValue& value, std::string& out) {
+		switch (value.getType()) {
+		case JsonValue::Type::Null:
+			out += "null";
+			break;
+		case JsonValue::Type::Bool:
+			out += value.getBool() ? "true" : "false";
+			break;
+		case JsonValue::Type::Number: {
+			char number[32];
+			snprintf(number, sizeof(number), "%.17g", value.getNumber());
+			out += number;
+			break;
+		}
+		case JsonValue::Type::String:
+			serializeString(value.getString(), out);
+			break;
+		case JsonValue::Type::Array: {
+			out += '[';
+			bool first = true;
+			for (const JsonValue& element : value.getArray()) {
+				if (!first)
+					out += ',';
+				serializeValue(element, out);
+				first = false;
+			}
+			out += ']';
+			break;
+		}
+		case JsonValue::Type::Object: {
+			out += '{';
+			bool first = true;
+			for (const auto& member : value.getMembers()) {
+				if (!first)
+					out += ',';
+				serializeString(member.first, out);
+				out += ':';
+				serializeValue(member.second, out);
+				first = false;
+			}
+			out += '}';
+			break;
+		}
+		}
+	}
+
+}
+
+JsonValue::JsonValue()
+{
+}
+
+JsonValue::JsonValue(bool value) :
+	type(Type::Bool),
+	boolValue(value)
+{
+}
+
+JsonValue::JsonValue(double value) :
+	type(Type::Number),
+	numberValue(value)
+{
+}
+
+JsonValue::JsonValue(const std::string& value) :
+	type(Type::String),
+	stringValue(value)
+{
+}
+
+JsonValue::JsonValue(const char* value) :
+	type(Type::String),
+	stringValue(value)
+{
+}
+
+JsonValue JsonValue::array()
+{
+	JsonValue value;
+	value.type = Type::Array;
+	return value;
+}
+
+JsonValue JsonValue::object()
+{
+	JsonValue value;
+	value.type = Type::Object;
+	return value;
+}
+
+bool JsonValue::parse(const std::string& text, JsonValue& value, std::string& error)
+{
+	return JsonParser(text).parse(value, error);
+}
+
+std::string JsonValue::serialize() const
+{
+	std::string out;
+	serializeValue(*this, out);
+	return out;
+}
+
+JsonValue::Type JsonValue::getType() const
+{
+	return type;
+}
+
+bool JsonValue::isNull() const
+{
+	return type == Type::Null;
+}
+
+bool JsonValue::getBool(bool fallback) const
+{
+	return type == Type::Bool ? boolValue : fallback;
+}
+
+double JsonValue::getNumber(double fallback) const
+{
+	return type == Type::Number ? numberValue : fallback;
+}
+
+const std::string& JsonValue::getString() const
+{
+	return stringValue;
+}
+
+const std::vector<JsonValue>& JsonValue::getArray() const
+{
+	return arrayValue;
+}
+
+void JsonValue::append(const JsonValue& value)
+{
+	arrayValue.push_back(value);
+}
+
+const JsonValue* JsonValue::find(const std::string& key) const
+{
+	auto member = objectValue.find(key);
+	return member == objectValue.end() ? nullptr : &member->second;
+}
+
+const std::map<std::string, JsonValue>& JsonValue::getMembers() const
+{
+	return objectValue;
+}
+
+void JsonValue::set(const std::string& key, const JsonValue& value)
+{
+	objectValue[key] = value;
+}
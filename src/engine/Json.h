@@ -0,0 +1,52 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+// just enough json for manifests and messages: objects, arrays, strings, numbers, true, false and null
+// numbers are doubles, strings are kept as utf-8 and \u escapes outside ascii are written back out as utf-8
+class JsonValue {
+public:
+	enum class Type { Null, Bool, Number, String, Array, Object };
+
+	JsonValue();
+	JsonValue(bool value);
+	JsonValue(double value);
+	JsonValue(const std::string& value);
+	JsonValue(const char* value);
+
+	static JsonValue array();
+	static JsonValue object();
+
+	// returns false and describes the problem in 'error' if 'text' is not a single json value
+	static bool parse(const std::string& text, JsonValue& value, std::string& error);
+
+	// compact, on one line, doubles are written with enough digits to read back exactly
+	std::string serialize() const;
+
+	Type getType() const;
+	bool isNull() const;
+
+	// the value, or 'fallback' if it is some other type
+	bool getBool(bool fallback = false) const;
+	double getNumber(double fallback = 0.0) const;
+	const std::string& getString() const;
+
+	// array elements (empty unless this is an array)
+	const std::vector<JsonValue>& getArray() const;
+	void append(const JsonValue& value);
+
+	// object members, find() returns nullptr if there is no such member or this is not an object
+	const JsonValue* find(const std::string& key) const;
+	const std::map<std::string, JsonValue>& getMembers() const;
+	void set(const std::string& key, const JsonValue& value);
+
+private:
+	Type type = Type::Null;
+	bool boolValue = false;
+	double numberValue = 0.0;
+	std::string stringValue;
+	std::vector<JsonValue> arrayValue;
+	std::map<std::string, JsonValue> objectValue;
+};
@@ -0,0 +1,166 @@
+#include "engine/MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	// views have to start on a multiple of this
+	uint64_t mappingGranularity() {
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwAllocationGranularity;
+#else
+		return (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+	}
+
+}
+
+MappedFile::MappedFile()
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& filepath, uint64_t size, bool keepContents)
+{
+	close();
+	this->size = size;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, keepContents ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	fileSize.QuadPart = (LONGLONG)size;
+	if (!SetFilePointerEx(file, fileSize, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, nullptr);
+	if (!mapping) {
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = mapping;
+#else
+	int flags = O_RDWR | O_CREAT;
+	if (!keepContents)
+		flags |= O_TRUNC;
+
+	fd = ::open(filepath.c_str(), flags, 0644);
+	if (fd < 0)
+		return false;
+
+	if (ftruncate(fd, (off_t)size) != 0) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+	if (fileHandle)
+		CloseHandle(fileHandle);
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+}
+
+bool MappedFile::isOpen()
+{
+#ifdef _WIN32
+	return mappingHandle != nullptr;
+#else
+	return fd >= 0;
+#endif
+}
+
+uint64_t MappedFile::getSize()
+{
+	return size;
+}
+
+MappedFile::Region MappedFile::map(uint64_t offset, size_t length)
+{
+	static const uint64_t granularity = mappingGranularity();
+
+	Region region;
+	if (!isOpen() || length == 0 || offset + length > size)
+		return region;
+
+	uint64_t baseOffset = offset - offset % granularity;
+	size_t baseLength = (size_t)(offset - baseOffset) + length;
+
+#ifdef _WIN32
+	void* base = MapViewOfFile(mappingHandle, FILE_MAP_WRITE, (DWORD)(baseOffset >> 32), (DWORD)baseOffset, baseLength);
+	if (!base)
+		return region;
+#else
+	void* base = mmap(nullptr, baseLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)baseOffset);
+	if (base == MAP_FAILED)
+		return region;
+#endif
+
+	region.base = base;
+	region.baseLength = baseLength;
+	region.data = (uint8_t*)base + (offset - baseOffset);
+	return region;
+}
+
+void MappedFile::unmap(Region& region)
+{
+	if (!region.base)
+		return;
+
+#ifdef _WIN32
+	FlushViewOfFile(region.base, region.baseLength);
+	UnmapViewOfFile(region.base);
+#else
+	// start writeback now so dirty pages do not pile up in the page cache, then drop the pages from this process
+	msync(region.base, region.baseLength, MS_ASYNC);
+	madvise(region.base, region.baseLength, MADV_DONTNEED);
+	munmap(region.base, region.baseLength);
+#endif
+
+	region = Region();
+}
+
+bool MappedFile::flush()
+{
+	if (!isOpen())
+		return false;
+
+#ifdef _WIN32
+	return FlushFileBuffers(fileHandle) != 0;
+#else
+	return fsync(fd) == 0;
+#endif
+}
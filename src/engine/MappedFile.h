@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// a file on disk that is accessed through memory mapped views
+// only the views that are currently mapped take up memory, so files much larger than ram (or the address space) can be written a piece at a time
+class MappedFile {
+public:
+	// a mapped piece of the file, 'data' points at the requested offset
+	struct Region {
+		uint8_t* data = nullptr;
+		void* base = nullptr;
+		size_t baseLength = 0;
+	};
+
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+
+	// opens or creates the file and sets its size, if keepContents is false any existing data is discarded
+	bool open(const std::string& filepath, uint64_t size, bool keepContents);
+	void close();
+
+	bool isOpen();
+	uint64_t getSize();
+
+	// maps [offset, offset + length) for reading and writing, data is nullptr if it failed
+	// several regions can be mapped at once from different threads
+	Region map(uint64_t offset, size_t length);
+
+	// starts writing the region back to disk and releases it, nothing stays resident after this
+	void unmap(Region& region);
+
+	// blocks until everything written so far is on disk
+	bool flush();
+
+private:
+	uint64_t size = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fd = -1;
+#endif
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+
+	// number of threads to use when the caller does not care, every core
+	inline int defaultThreadCount() {
+		return std::max(1, (int)std::thread::hardware_concurrency());
+	}
+
+	// calls job(0) to job(count - 1) spread over up to threadCount threads (the calling thread is one of them), returns when all are done
+	template<typename Job>
+	void forEach(int count, int threadCount, const Job& job) {
+		std::atomic<int> next{ 0 };
+		auto worker = [&]() {
+			for (int i = next++; i < count; i = next++)
+				job(i);
+		};
+
+		std::vector<std::thread> threads;
+		for (int i = 1; i < std::min(count, threadCount); i++)
+			threads.emplace_back(worker);
+		worker();
+
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+
+	// something that runs job(0) to job(count - 1) like forEach() but somewhere else, such as on a shared pool at some priority
+	using Runner = std::function<void(int count, const std::function<void(int)>& job)>;
+
+}
@@ -0,0 +1,356 @@
+#include "engine/PngWriter.h"
+#include "engine/DeflateEncoder.h"
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+
+namespace {
+
+	const size_t idatChunkSize = 64 * 1024;
+	const size_t dictionarySize = 32 * 1024;
+
+	// about how much raw data goes into each group, big enough that priming and the sync flush between groups cost almost nothing
+	const size_t groupBytes = 1024 * 1024;
+
+	// built by the first call, a function local static so png files can be written from several threads at once
+	const std::array<uint32_t, 256>& crcTable() {
+		static const std::array<uint32_t, 256> table = []() {
+			std::array<uint32_t, 256> table;
+			for (uint32_t n = 0; n < 256; n++) {
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+			return table;
+		}();
+		return table;
+	}
+
+	uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+		const std::array<uint32_t, 256>& table = crcTable();
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size) {
+		uint32_t a = adler & 0xFFFF, b = adler >> 16;
+
+		// 5552 is the most bytes that can be summed before b could overflow 32 bits
+		while (size > 0) {
+			size_t block = std::min(size, (size_t)5552);
+			for (size_t i = 0; i < block; i++) {
+				a += data[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+			data += block;
+			size -= block;
+		}
+
+		return (b << 16) | a;
+	}
+
+	// the adler32 of two buffers joined together, from the adler values of each and the length of the second (same math as zlib)
+	uint32_t adler32Combine(uint32_t adler1, uint32_t adler2, uint64_t length2) {
+		const uint32_t base = 65521;
+		uint32_t remainder = (uint32_t)(length2 % base);
+		uint32_t sum1 = adler1 & 0xFFFF;
+		uint32_t sum2 = (remainder * sum1) % base;
+		sum1 += (adler2 & 0xFFFF) + base - 1;
+		sum2 += (adler1 >> 16) + (adler2 >> 16) + base - remainder;
+		if (sum1 >= base) sum1 -= base;
+		if (sum1 >= base) sum1 -= base;
+		if (sum2 >= base << 1) sum2 -= base << 1;
+		if (sum2 >= base) sum2 -= base;
+		return sum1 | (sum2 << 16);
+	}
+
+	void putU32(uint8_t* p, uint32_t value) {
+		p[0] = (uint8_t)(value >> 24);
+		p[1] = (uint8_t)(value >> 16);
+		p[2] = (uint8_t)(value >> 8);
+		p[3] = (uint8_t)value;
+	}
+
+	uint8_t paeth(int a, int b, int c) {
+		int p = a + b - c;
+		int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc) return (uint8_t)a;
+		if (pb <= pc) return (uint8_t)b;
+		return (uint8_t)c;
+	}
+
+	// writes the filter type byte followed by the filtered row to 'out'
+	// picks the filter with the smallest sum of absolute values (the usual heuristic from the png spec), palette images are left unfiltered as the spec recommends
+	void filterRow(const uint8_t* row, const uint8_t* previousRow, size_t rowBytes, int bytesPerPixel, bool adaptive, std::vector<uint8_t>& scratch, uint8_t* out) {
+		if (!adaptive) {
+			out[0] = 0;
+			std::copy(row, row + rowBytes, out + 1);
+			return;
+		}
+
+		scratch.resize(rowBytes + 1);
+		long long bestScore = -1;
+
+		for (int type = 0; type < 5; type++) {
+			uint8_t* f = &scratch[0];
+			f[0] = (uint8_t)type;
+
+			long long score = 0;
+			for (size_t i = 0; i < rowBytes; i++) {
+				int a = i >= (size_t)bytesPerPixel ? row[i - bytesPerPixel] : 0;
+				int b = previousRow[i];
+				int c = i >= (size_t)bytesPerPixel ? previousRow[i - bytesPerPixel] : 0;
+
+				uint8_t value = row[i];
+				switch (type) {
+				case 1: value -= (uint8_t)a; break;
+				case 2: value -= (uint8_t)b; break;
+				case 3: value -= (uint8_t)((a + b) / 2); break;
+				case 4: value -= paeth(a, b, c); break;
+				}
+
+				f[i + 1] = value;
+				score += value < 128 ? value : 256 - value;
+			}
+
+			if (bestScore < 0 || score < bestScore) {
+				bestScore = score;
+				std::copy(scratch.begin(), scratch.end(), out);
+			}
+		}
+	}
+
+}
+
+PngWriter::PngWriter(const std::string& filepath, int width, int height, int channels, int threadCount) :
+	file(filepath, std::ios::binary),
+	width(width),
+	height(height),
+	channels(channels),
+	threadCount(threadCount > 0 ? threadCount : Parallel::defaultThreadCount()),
+	rowBytes((size_t)width * channels)
+{
+	writeHeader(channels == 1 ? 0 : channels == 3 ? 2 : 6, nullptr);
+}
+
+PngWriter::PngWriter(const std::string& filepath, int width, int height, const std::vector<std::array<uint8_t, 3>>& palette, int threadCount) :
+	file(filepath, std::ios::binary),
+	width(width),
+	height(height),
+	channels(1),
+	indexed(true),
+	threadCount(threadCount > 0 ? threadCount : Parallel::defaultThreadCount()),
+	rowBytes((size_t)width)
+{
+	writeHeader(3, &palette);
+}
+
+PngWriter::PngWriter(std::vector<uint8_t>& output, int width, int height, int channels, int threadCount) :
+	memory(&output),
+	width(width),
+	height(height),
+	channels(channels),
+	threadCount(threadCount > 0 ? threadCount : Parallel::defaultThreadCount()),
+	rowBytes((size_t)width * channels)
+{
+	writeHeader(channels == 1 ? 0 : channels == 3 ? 2 : 6, nullptr);
+}
+
+PngWriter::~PngWriter()
+{
+	if (!finished)
+		finish();
+}
+
+bool PngWriter::isOpen()
+{
+	return memory || file.good();
+}
+
+void PngWriter::writeRow(const uint8_t* row)
+{
+	if (finished || rowsWritten >= height)
+		return;
+
+	pendingRows.insert(pendingRows.end(), row, row + rowBytes);
+	pendingRowCount++;
+	rowsWritten++;
+
+	if (pendingRowCount >= groupRows * threadCount)
+		compressPendingRows();
+}
+
+void PngWriter::writeRows(const uint8_t* rows, int rowCount)
+{
+	for (int i = 0; i < rowCount; i++)
+		writeRow(rows + i * rowBytes);
+}
+
+int PngWriter::getRowsWritten()
+{
+	return rowsWritten;
+}
+
+bool PngWriter::finish()
+{
+	if (finished)
+		return false;
+	finished = true;
+
+	compressPendingRows();
+
+	// every group ends byte aligned and not final, so the stream is closed with an empty final block
+	DeflateEncoder end(compressed);
+	end.finish();
+
+	uint8_t adlerBytes[4];
+	putU32(adlerBytes, adler);
+	compressed.insert(compressed.end(), adlerBytes, adlerBytes + 4);
+
+	flushIDAT(true);
+	writeChunk("IEND", nullptr, 0);
+	if (memory)
+		return rowsWritten == height;
+
+	file.close();
+	return !file.fail() && rowsWritten == height;
+}
+
+void PngWriter::writeHeader(int colorType, const std::vector<std::array<uint8_t, 3>>* palette)
+{
+	groupRows = (int)std::max((size_t)1, groupBytes / std::max((size_t)1, rowBytes));
+	previousRow.assign(rowBytes, 0);
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	write(signature, 8);
+
+	uint8_t header[13];
+	putU32(&header[0], width);
+	putU32(&header[4], height);
+	header[8] = 8; // bit depth
+	header[9] = (uint8_t)colorType;
+	header[10] = 0; // deflate
+	header[11] = 0; // adaptive filtering
+	header[12] = 0; // no interlace
+	writeChunk("IHDR", header, 13);
+
+	if (palette) {
+		std::vector<uint8_t> entries;
+		for (size_t i = 0; i < palette->size() && i < 256; i++)
+			entries.insert(entries.end(), (*palette)[i].begin(), (*palette)[i].end());
+		writeChunk("PLTE", &entries[0], entries.size());
+	}
+
+	// zlib header, 32KB window, no preset dictionary
+	compressed.push_back(0x78);
+	compressed.push_back(0x01);
+}
+
+void PngWriter::compressPendingRows()
+{
+	if (pendingRowCount == 0)
+		return;
+
+	struct Group {
+		int firstRow, rowCount;
+		std::vector<uint8_t> filtered;
+		std::vector<uint8_t> compressed;
+		uint32_t adler = 1;
+	};
+
+	std::vector<Group> groups;
+	for (int row = 0; row < pendingRowCount; row += groupRows) {
+		Group group;
+		group.firstRow = row;
+		group.rowCount = std::min(groupRows, pendingRowCount - row);
+		groups.push_back(std::move(group));
+	}
+
+	// filtering only depends on the raw rows so every group can be filtered at once
+	Parallel::forEach((int)groups.size(), threadCount, [&](int g) {
+		Group& group = groups[g];
+		group.filtered.resize(group.rowCount * (rowBytes + 1));
+
+		std::vector<uint8_t> scratch;
+		for (int i = 0; i < group.rowCount; i++) {
+			int row = group.firstRow + i;
+			const uint8_t* above = row == 0 ? &previousRow[0] : &pendingRows[(row - 1) * rowBytes];
+			filterRow(&pendingRows[row * rowBytes], above, rowBytes, channels, !indexed, scratch, &group.filtered[i * (rowBytes + 1)]);
+		}
+
+		group.adler = adler32(1, &group.filtered[0], group.filtered.size());
+	});
+
+	// each group is its own deflate stream primed with the data before it and ending in a sync flush, so they can simply be joined
+	Parallel::forEach((int)groups.size(), threadCount, [&](int g) {
+		Group& group = groups[g];
+		const std::vector<uint8_t>& before = g == 0 ? dictionary : groups[g - 1].filtered;
+
+		DeflateEncoder encoder(group.compressed);
+		if (!before.empty()) {
+			size_t primeSize = std::min(before.size(), dictionarySize);
+			encoder.setDictionary(&before[before.size() - primeSize], primeSize);
+		}
+		encoder.write(&group.filtered[0], group.filtered.size());
+		encoder.flush();
+	});
+
+	for (Group& group : groups) {
+		compressed.insert(compressed.end(), group.compressed.begin(), group.compressed.end());
+		adler = adler32Combine(adler, group.adler, group.filtered.size());
+		flushIDAT(false);
+	}
+
+	const std::vector<uint8_t>& last = groups.back().filtered;
+	size_t keep = std::min(last.size(), dictionarySize);
+	dictionary.assign(last.end() - keep, last.end());
+
+	previousRow.assign(pendingRows.end() - rowBytes, pendingRows.end());
+	pendingRows.clear();
+	pendingRowCount = 0;
+}
+
+void PngWriter::writeChunk(const char* type, const uint8_t* data, size_t size)
+{
+	uint8_t length[4];
+	putU32(length, (uint32_t)size);
+	write(length, 4);
+	write(type, 4);
+	if (size > 0)
+		write(data, size);
+
+	uint32_t crc = crc32(0, (const uint8_t*)type, 4);
+	crc = crc32(crc, data, size);
+
+	uint8_t crcBytes[4];
+	putU32(crcBytes, crc);
+	write(crcBytes, 4);
+}
+
+void PngWriter::write(const void* data, size_t size)
+{
+	if (memory)
+		memory->insert(memory->end(), (const uint8_t*)data, (const uint8_t*)data + size);
+	else
+		file.write((const char*)data, size);
+}
+
+void PngWriter::flushIDAT(bool all)
+{
+	size_t written = 0;
+	while (compressed.size() - written >= idatChunkSize || (all && written < compressed.size())) {
+		size_t size = std::min(idatChunkSize, compressed.size() - written);
+		writeChunk("IDAT", &compressed[written], size);
+		written += size;
+	}
+
+	compressed.erase(compressed.begin(), compressed.begin() + written);
+}
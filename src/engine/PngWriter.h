@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// writes an 8 bit png one row at a time, rows are filtered and compressed as they arrive and written to disk in IDAT chunks
+// memory use does not depend on the height of the image so it can be fed from gpu readback bands or cpu tiles of any size
+// rows are collected into groups that are filtered and deflated on separate threads (like pigz), each group is primed with the end of the
+// group before it so the compression ratio is close to a single stream, and the results are joined into one zlib stream
+class PngWriter {
+public:
+	// channels: 1 = grey, 3 = rgb, 4 = rgba
+	// threadCount 0 uses every core
+	PngWriter(const std::string& filepath, int width, int height, int channels = 4, int threadCount = 0);
+
+	// writes an indexed color png, rows are one byte per pixel indexing into 'palette' (at most 256 entries)
+	PngWriter(const std::string& filepath, int width, int height, const std::vector<std::array<uint8_t, 3>>& palette, int threadCount = 0);
+
+	// writes the png to the end of 'output' instead of a file, for images that are sent somewhere rather than saved
+	PngWriter(std::vector<uint8_t>& output, int width, int height, int channels = 4, int threadCount = 0);
+
+	// finishes the file if finish() was not called
+	~PngWriter();
+
+	PngWriter(const PngWriter&) = delete;
+
+	bool isOpen();
+
+	// rows must be given from the top of the image down, each row is width * channels bytes
+	void writeRow(const uint8_t* row);
+	void writeRows(const uint8_t* rows, int rowCount);
+
+	int getRowsWritten();
+
+	// writes the end of the stream, returns false if the file could not be written or not every row was given
+	bool finish();
+
+private:
+	void writeHeader(int colorType, const std::vector<std::array<uint8_t, 3>>* palette);
+	void compressPendingRows();
+
+	void write(const void* data, size_t size);
+	void writeChunk(const char* type, const uint8_t* data, size_t size);
+	void flushIDAT(bool all);
+
+	std::ofstream file;
+	std::vector<uint8_t>* memory = nullptr; // written to instead of 'file' if set
+	int width, height, channels;
+	bool indexed = false;
+	int threadCount;
+	size_t rowBytes;
+	int groupRows;
+	int rowsWritten = 0;
+	bool finished = false;
+
+	std::vector<uint8_t> pendingRows; // raw rows waiting to be compressed
+	int pendingRowCount = 0;
+	std::vector<uint8_t> previousRow;
+	std::vector<uint8_t> dictionary;  // last 32KB of filtered data, used to prime the next group
+
+	std::vector<uint8_t> compressed;
+	uint32_t adler = 1;
+};
@@ -0,0 +1,194 @@
+#include "engine/Process.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <csignal>
+#include <ctime>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+#include <chrono>
+#include <thread>
+
+namespace {
+
+#ifdef _WIN32
+	const intptr_t invalidHandle = 0;
+
+	HANDLE native(intptr_t handle) {
+		return (HANDLE)handle;
+	}
+
+	// the rules CommandLineToArgvW uses to split it again in the child
+	std::string quote(const std::string& argument) {
+		if (!argument.empty() && argument.find_first_of(" \t\"") == std::string::npos)
+			return argument;
+
+		std::string quoted = "\"";
+		size_t backslashes = 0;
+		for (char c : argument) {
+			if (c == '\\') {
+				backslashes++;
+				continue;
+			}
+			quoted.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+			backslashes = 0;
+			quoted += c;
+		}
+		quoted.append(backslashes * 2, '\\');
+		return quoted + "\"";
+	}
+#else
+	const intptr_t invalidHandle = -1;
+#endif
+
+}
+
+Process::Process() :
+	handle(invalidHandle)
+{
+}
+
+Process::~Process()
+{
+	if (isValid() && isRunning())
+		kill();
+
+#ifdef _WIN32
+	if (isValid())
+		CloseHandle(native(handle));
+#endif
+}
+
+Process::Process(Process&& other) :
+	handle(other.handle),
+	exited(other.exited)
+{
+	other.handle = invalidHandle;
+}
+
+Process& Process::operator=(Process&& other)
+{
+	if (this != &other) {
+		this->~Process();
+		handle = other.handle;
+		exited = other.exited;
+		other.handle = invalidHandle;
+	}
+	return *this;
+}
+
+Process Process::start(const std::string& executable, const std::vector<std::string>& arguments)
+{
+	Process process;
+
+#ifdef _WIN32
+	std::string commandLine = quote(executable);
+	for (const std::string& argument : arguments)
+		commandLine += " " + quote(argument);
+
+	STARTUPINFOA startup = {};
+	startup.cb = sizeof(startup);
+	PROCESS_INFORMATION info = {};
+	if (!CreateProcessA(executable.c_str(), &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &info))
+		return process;
+
+	CloseHandle(info.hThread);
+	process.handle = (intptr_t)info.hProcess;
+#else
+	std::vector<char*> argv;
+	argv.push_back(const_cast<char*>(executable.c_str()));
+	for (const std::string& argument : arguments)
+		argv.push_back(const_cast<char*>(argument.c_str()));
+	argv.push_back(nullptr);
+
+	pid_t pid;
+	if (posix_spawn(&pid, executable.c_str(), nullptr, nullptr, &argv[0], environ) != 0)
+		return process;
+
+	process.handle = pid;
+#endif
+
+	return process;
+}
+
+std::string Process::currentExecutable()
+{
+#ifdef _WIN32
+	char path[MAX_PATH];
+	DWORD length = GetModuleFileNameA(nullptr, path, MAX_PATH);
+	return std::string(path, length);
+#else
+	char path[4096];
+	ssize_t length = readlink("/proc/self/exe", path, sizeof(path));
+	return length > 0 ? std::string(path, length) : std::string();
+#endif
+}
+
+double Process::cpuMilliseconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	uint64_t kernelTicks = (uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime;
+	uint64_t userTicks = (uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime;
+	return (kernelTicks + userTicks) / 10000.0; // 100ns ticks
+#else
+	timespec time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+#endif
+}
+
+bool Process::isValid() const
+{
+	return handle != invalidHandle;
+}
+
+bool Process::isRunning()
+{
+	return !wait(0);
+}
+
+bool Process::wait(int milliseconds)
+{
+	if (!isValid() || exited)
+		return true;
+
+#ifdef _WIN32
+	exited = WaitForSingleObject(native(handle), (DWORD)milliseconds) == WAIT_OBJECT_0;
+#else
+	// waitpid has no timeout, so it is polled
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+	while (true) {
+		int status;
+		pid_t result = waitpid((pid_t)handle, &status, WNOHANG);
+		exited = result == (pid_t)handle || result < 0;
+		if (exited || std::chrono::steady_clock::now() >= deadline)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+#endif
+
+	return exited;
+}
+
+void Process::kill()
+{
+	if (!isValid() || exited)
+		return;
+
+#ifdef _WIN32
+	TerminateProcess(native(handle), 1);
+#else
+	::kill((pid_t)handle, SIGKILL);
+#endif
+	wait(1000);
+}
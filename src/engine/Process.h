@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// a child process running an executable, over CreateProcess or posix_spawn
+// used to start render farm workers from the same executable, the destructor kills a child that is still running
+class Process {
+public:
+	Process();
+	~Process();
+
+	Process(Process&& other);
+	Process& operator=(Process&& other);
+	Process(const Process&) = delete;
+	Process& operator=(const Process&) = delete;
+
+	// invalid if it could not be started
+	static Process start(const std::string& executable, const std::vector<std::string>& arguments);
+
+	// the full path of the running executable, for starting more copies of it
+	static std::string currentExecutable();
+
+	// processor time used by every thread of this process so far
+	static double cpuMilliseconds();
+
+	bool isValid() const;
+
+	// false once it has exited or been killed
+	bool isRunning();
+
+	// waits up to 'milliseconds' for it to exit, true if it has
+	bool wait(int milliseconds);
+
+	void kill();
+
+private:
+	intptr_t handle;
+	bool exited = false;
+};
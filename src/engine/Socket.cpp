@@ -0,0 +1,216 @@
+#include "engine/Socket.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <climits>
+
+namespace {
+
+#ifdef _WIN32
+	const intptr_t invalidHandle = (intptr_t)INVALID_SOCKET;
+
+	struct WinsockStartup {
+		WinsockStartup() {
+			WSADATA data;
+			WSAStartup(MAKEWORD(2, 2), &data);
+		}
+		~WinsockStartup() {
+			WSACleanup();
+		}
+	};
+
+	void startup() {
+		static WinsockStartup winsock;
+	}
+
+	SOCKET native(intptr_t handle) {
+		return (SOCKET)handle;
+	}
+
+	void closeHandle(intptr_t handle) {
+		closesocket(native(handle));
+	}
+
+	const int sendFlags = 0;
+#else
+	const intptr_t invalidHandle = -1;
+
+	void startup() {
+	}
+
+	int native(intptr_t handle) {
+		return (int)handle;
+	}
+
+	void closeHandle(intptr_t handle) {
+		::close(native(handle));
+	}
+
+	// a write to a closed connection returns an error instead of killing the process
+	const int sendFlags = MSG_NOSIGNAL;
+#endif
+
+	sockaddr_in loopbackAddress(uint16_t port) {
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return address;
+	}
+
+}
+
+Socket::Socket() :
+	handle(invalidHandle)
+{
+}
+
+Socket::Socket(intptr_t handle) :
+	handle(handle)
+{
+}
+
+Socket::~Socket()
+{
+	close();
+}
+
+Socket::Socket(Socket&& other) :
+	handle(other.handle)
+{
+	other.handle = invalidHandle;
+}
+
+Socket& Socket::operator=(Socket&& other)
+{
+	if (this != &other) {
+		close();
+		handle = other.handle;
+		other.handle = invalidHandle;
+	}
+	return *this;
+}
+
+Socket Socket::listenLoopback(uint16_t port)
+{
+	startup();
+
+	Socket socket((intptr_t)::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (!socket.isValid())
+		return socket;
+
+#ifndef _WIN32
+	// lets the server be restarted straight away, windows allows that already and SO_REUSEADDR means something else there
+	int reuse = 1;
+	setsockopt(native(socket.handle), SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+#endif
+
+	sockaddr_in address = loopbackAddress(port);
+	if (bind(native(socket.handle), (const sockaddr*)&address, sizeof(address)) != 0 || listen(native(socket.handle), 64) != 0)
+		socket.close();
+	return socket;
+}
+
+Socket Socket::connectLoopback(uint16_t port)
+{
+	startup();
+
+	Socket socket((intptr_t)::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (!socket.isValid())
+		return socket;
+
+	sockaddr_in address = loopbackAddress(port);
+	if (connect(native(socket.handle), (const sockaddr*)&address, sizeof(address)) != 0)
+		socket.close();
+	return socket;
+}
+
+bool Socket::isValid() const
+{
+	return handle != invalidHandle;
+}
+
+Socket Socket::accept()
+{
+	if (!isValid())
+		return Socket();
+	return Socket((intptr_t)::accept(native(handle), nullptr, nullptr));
+}
+
+int Socket::receive(void* data, size_t size)
+{
+	if (!isValid())
+		return -1;
+	return (int)recv(native(handle), (char*)data, (int)(size < INT_MAX ? size : INT_MAX), 0);
+}
+
+bool Socket::sendAll(const void* data, size_t size)
+{
+	const char* bytes = (const char*)data;
+	while (size > 0 && isValid()) {
+		int sent = (int)send(native(handle), bytes, (int)(size < INT_MAX ? size : INT_MAX), sendFlags);
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		size -= sent;
+	}
+	return size == 0;
+}
+
+bool Socket::peerClosed()
+{
+	if (!isValid())
+		return true;
+
+	// poll instead of select, which cannot take descriptors past FD_SETSIZE and the servers have a thread and a socket per connection
+	pollfd descriptor = {};
+	descriptor.fd = native(handle);
+	descriptor.events = POLLIN;
+#ifdef _WIN32
+	int ready = WSAPoll(&descriptor, 1, 0);
+#else
+	int ready = poll(&descriptor, 1, 0);
+#endif
+	if (ready <= 0 || !(descriptor.revents & (POLLIN | POLLHUP | POLLERR)))
+		return false;
+
+	// readable with nothing to read means the other end has gone
+	char byte;
+	return recv(native(handle), &byte, 1, MSG_PEEK) <= 0;
+}
+
+void Socket::setNoDelay()
+{
+	int on = 1;
+	setsockopt(native(handle), IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+void Socket::shutdown()
+{
+#ifdef _WIN32
+	::shutdown(native(handle), SD_BOTH);
+#else
+	::shutdown(native(handle), SHUT_RDWR);
+#endif
+}
+
+void Socket::close()
+{
+	if (isValid()) {
+		closeHandle(handle);
+		handle = invalidHandle;
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// blocking tcp sockets over winsock or bsd sockets, just what the local render servers need
+// everything listens on and connects to 127.0.0.1 so nothing is reachable from other machines
+class Socket {
+public:
+	Socket();
+	~Socket();
+
+	Socket(Socket&& other);
+	Socket& operator=(Socket&& other);
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+
+	// invalid if the port is already taken
+	static Socket listenLoopback(uint16_t port);
+
+	// invalid if nothing is listening on the port
+	static Socket connectLoopback(uint16_t port);
+
+	bool isValid() const;
+
+	// blocks until a client connects, invalid if the socket was closed
+	Socket accept();
+
+	// up to 'size' bytes, blocks until there are some, returns 0 once the other end has closed and -1 on an error
+	int receive(void* data, size_t size);
+
+	// false if the connection broke before everything was sent
+	bool sendAll(const void* data, size_t size);
+
+	// true if the other end has closed the connection, does not block or take anything it sent
+	bool peerClosed();
+
+	// sends small messages straight away instead of waiting to fill a packet
+	void setNoDelay();
+
+	// wakes any thread blocked in accept() or receive() on this socket, which then return as if it was closed
+	void shutdown();
+
+	void close();
+
+private:
+	explicit Socket(intptr_t handle);
+
+	intptr_t handle;
+};
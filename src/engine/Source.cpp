@@ -1,4 +1,7 @@
 
+#include "game/HeadlessRenderer.h"
+
+#ifndef HEADLESS_ONLY
 #include "GL/glew.h"
 #include "GLFW/glfw3.h"
 
@@ -7,9 +10,21 @@
 #include "engine/FontManager.h"
 #include "engine/TextureManager.h"
 #include "game/GameLogicInterface.h"
+#include "game/StreamViewer.h"
+#endif
+
+#include <cstdio>
 
 
 int main(int argc, char** argv) {
+	// command line renders never create a window, so they work on machines with no gpu or display
+	if (HeadlessRenderer::requested(argc, argv))
+		return HeadlessRenderer::run(argc, argv);
+
+#ifdef HEADLESS_ONLY
+	printf("this build has no window, run it with --headless, --batch, --serve, --view or --benchmark\n");
+	return 1;
+#else
 	if (!glfwInit()) printf("GLFW did not initialize properly\n");
 	window; // calls the constructor of window and loads it into static memory
 	if (glewInit() != GLEW_OK) printf("GLEW did not initialize properly\n");
@@ -21,7 +36,10 @@ int main(int argc, char** argv) {
 
 	window.setResolution(1920, 1080);
 	ViewportManager::init();
-	GameLogicInterface::init();
+	if (uint16_t viewPort = StreamViewer::requestedPort(argc, argv))
+		GameLogicInterface::initViewer(viewPort);
+	else
+		GameLogicInterface::init();
 	window.mainUpdateLoop();
 	GameLogicInterface::cleanup();
 	FontManager::cleanup();
@@ -29,4 +47,5 @@ int main(int argc, char** argv) {
 
 	glfwDestroyWindow(window.getHandle());
 	glfwTerminate();
+#endif
 }
\ No newline at end of file
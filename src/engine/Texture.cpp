@@ -6,9 +6,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-#define STBI_MSC_SECURE_CRT
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+#include "engine/PngWriter.h"
 
 #include <algorithm>
 
@@ -38,6 +36,13 @@ Texture::Texture(int width, int height) {
 	initPixHigh = height;
 }
 
+Texture::Texture(int width, int height, Format format) {
+	initType = 2;
+	initPixWide = width;
+	initPixHigh = height;
+	this->format = format;
+}
+
 Texture::Texture(int width, int height, float * data, size_t pixelCount) {
 	//generateFromData(width, height, data, pixelCount);
 	initType = 3;
@@ -104,6 +109,12 @@ void Texture::generateFromFile(const std::string & filename) {
 void Texture::generateDefaultTexture(int width, int height) {
 	initType = 2;
 
+	// only float textures get the checkerboard, compact textures are always filled with real data before they are used
+	if (format != Format::RGBA32F) {
+		uploadData(width, height, format, nullptr);
+		return;
+	}
+
 	this->width = width;
 	this->height = height;
 	if (!isInitilized) {
@@ -151,6 +162,7 @@ void Texture::generateDefaultTexture(int width, int height) {
 
 void Texture::generateFromData(int width, int height, float * data, size_t pixelCount) {
 	initType = 3;
+	format = Format::RGBA32F;
 
 	this->width = width;
 	this->height = height;
@@ -172,11 +184,76 @@ void Texture::generateFromData(int width, int height, float * data, size_t pixel
 	isInitilized = true;
 }
 
+void Texture::generateFromData(int width, int height, const uint8_t* rgba) {
+	uploadData(width, height, Format::RGBA8, rgba);
+}
+
+void Texture::generateFromData(int width, int height, const uint16_t* values) {
+	uploadData(width, height, Format::R16UI, values);
+}
+
+void Texture::generateFromData(int width, int height, const uint32_t* values) {
+	uploadData(width, height, Format::R32UI, values);
+}
+
+void Texture::uploadData(int width, int height, Format format, const void* data) {
+	GLint internalFormat = GL_RGBA8;
+	GLenum dataFormat = GL_RGBA;
+	GLenum dataType = GL_UNSIGNED_BYTE;
+	switch (format) {
+	case Format::RGBA32F: internalFormat = GL_RGBA32F; dataFormat = GL_RGBA; dataType = GL_FLOAT; break;
+	case Format::RGBA8: internalFormat = GL_RGBA8; dataFormat = GL_RGBA; dataType = GL_UNSIGNED_BYTE; break;
+	case Format::R16UI: internalFormat = GL_R16UI; dataFormat = GL_RED_INTEGER; dataType = GL_UNSIGNED_SHORT; break;
+	case Format::R32UI: internalFormat = GL_R32UI; dataFormat = GL_RED_INTEGER; dataType = GL_UNSIGNED_INT; break;
+	}
+
+	bool reuseStorage = isInitilized && this->format == format && this->width == width && this->height == height;
+
+	this->format = format;
+	this->width = width;
+	this->height = height;
+
+	if (!isInitilized) {
+		glGenTextures(1, &id);
+	}
+	glBindTexture(GL_TEXTURE_2D, id);
+
+	// 16 bit rows are not always a multiple of 4 bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (reuseStorage) {
+		if (data)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, dataFormat, dataType, data);
+	}
+	else {
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, dataType, data);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	if (isIntegerFormat()) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	else {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	isInitilized = true;
+}
+
+bool Texture::isIntegerFormat() {
+	return format == Format::R16UI || format == Format::R32UI;
+}
+
 void Texture::setDefaultTexParameters() {
 	tryInitialize();
 
 	glBindTexture(GL_TEXTURE_2D, id);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, isIntegerFormat() ? GL_NEAREST : GL_NEAREST_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_NEAREST_MIPMAP_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -212,9 +289,11 @@ void Texture::unbindAsRenderTarget()
 {
 		ViewportManager::unbindViewport();
 
-		glBindTexture(GL_TEXTURE_2D, id);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		if (!isIntegerFormat()) {
+			glBindTexture(GL_TEXTURE_2D, id);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
 
 		frameBufferIDhistory.pop();
 		if (frameBufferIDhistory.size() > 0) {
@@ -254,40 +333,64 @@ std::vector<std::array<float, 4>> Texture::getPixels(int mipmapLevel) {
 	return pixels;
 }
 
-void Texture::saveToFile(const std::string& filepath)
-{
+std::vector<uint8_t> Texture::getPixelsRGBA8(int mipmapLevel) {
+	tryInitialize();
+	std::vector<uint8_t> pixels((size_t)width * height * 4);
 
-	std::vector<std::array<float, 4>> pixels(width * height);
 	glBindTexture(GL_TEXTURE_2D, id);
-	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &pixels[0]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, mipmapLevel, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
 	unbind();
 
+	return pixels;
+}
 
-	uint8_t* pixels_int = new uint8_t[width * height * 4];
-	int i = 0;
-	for (std::array<float, 4>&p : pixels) {
-		p[0] = std::clamp(p[0], 0.0f, 1.0f);
-		p[1] = std::clamp(p[1], 0.0f, 1.0f);
-		p[2] = std::clamp(p[2], 0.0f, 1.0f);
-		p[3] = std::clamp(p[3], 0.0f, 1.0f);
+void Texture::saveToFile(const std::string& filepath)
+{
+	tryInitialize();
 
-		uint8_t r = (uint8_t)(p[0] * 254.0f);
-		uint8_t g = (uint8_t)(p[1] * 254.0f);
-		uint8_t b = (uint8_t)(p[2] * 254.0f);
-		uint8_t a = (uint8_t)(p[3] * 254.0f);
+	if (isIntegerFormat()) {
+		std::cout << "integer textures hold raw values and must be colored before they can be saved" << std::endl;
+		return;
+	}
 
-		pixels_int[i + 0] = r;
-		pixels_int[i + 1] = g;
-		pixels_int[i + 2] = b;
-		pixels_int[i + 3] = a;
+	if (!frameBufferInitilaized) {
+		generateFrameBuffer();
+		frameBufferInitilaized = true;
+	}
+
+	PngWriter png(filepath, width, height, 4);
+	if (!png.isOpen()) {
+		std::cout << "could not open " << filepath << " for writing" << std::endl;
+		return;
+	}
 
-		i += 4;
+	// reads back a band of rows at a time as bytes so memory use does not grow with the size of the texture
+	const int bandHeight = 64;
+	std::vector<uint8_t> band((size_t)width * 4 * bandHeight);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, frameBufferID);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	// opengl rows go from the bottom up and png rows go from the top down
+	for (int top = height; top > 0; top -= bandHeight) {
+		int rows = std::min(bandHeight, top);
+		glReadPixels(0, top - rows, width, rows, GL_RGBA, GL_UNSIGNED_BYTE, &band[0]);
+
+		for (int row = rows - 1; row >= 0; row--) {
+			png.writeRow(&band[(size_t)row * width * 4]);
+		}
 	}
 
-	stbi_flip_vertically_on_write(true);
-	stbi_write_png(filepath.c_str(), width, height, 4, pixels_int, 4 * width);
-	delete[] pixels_int;
+	if (frameBufferIDhistory.size() > 0) {
+		glBindFramebuffer(GL_FRAMEBUFFER, frameBufferIDhistory.top());
+	}
+	else {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
 
+	if (!png.finish())
+		std::cout << "failed to write " << filepath << std::endl;
 }
 
 GLuint Texture::getID() {
@@ -307,6 +410,22 @@ int Texture::getHeight()
 	return height;
 }
 
+Texture::Format Texture::getFormat()
+{
+	return format;
+}
+
+int Texture::getBytesPerPixel(Format format)
+{
+	switch (format) {
+	case Format::RGBA32F: return 16;
+	case Format::RGBA8: return 4;
+	case Format::R16UI: return 2;
+	case Format::R32UI: return 4;
+	}
+	return 16;
+}
+
 void Texture::freeMemory() {
 	if (isInitilized) {
 		if (frameBufferInitilaized) {
@@ -12,6 +12,14 @@
 // a texture managed by OpenGL, pixel data is stored in VRAM and accessed via shader programs
 class Texture {
 public:
+	// how the pixels are stored in vram, chosen per texture
+	// RGBA32F - 4 floats per pixel (16 bytes), the default
+	// RGBA8   - 4 bytes per pixel, plenty for anything that ends up on screen or in an 8 bit image file
+	// R16UI   - one unsigned 16 bit integer per pixel, for raw itteration counts below 65536 (sample with a usampler2D)
+	// R32UI   - one unsigned 32 bit integer per pixel, for raw itteration counts of any size (sample with a usampler2D)
+	// integer formats are always sampled with GL_NEAREST and have no mipmaps
+	enum class Format { RGBA32F, RGBA8, R16UI, R32UI };
+
 	// default constructor, no texture will be generated and no opengl functions will be called, use this for defining Textures before GLEW is initilized
 	// must call one of the generateXXX functions before binding
 	Texture();
@@ -22,6 +30,9 @@ public:
 	// generates a default texture with float rbga encoding 
 	Texture(int width, int height);
 
+	// generates an empty texture with the given pixel format
+	Texture(int width, int height, Format format);
+
 	// generates a texture with given data in float rgba encoding
 	// pixelCount - the number of pixels in 'data'    aka. sizeof(data) / (4 * sizeof(float))
 	Texture(int width, int height, float* data, size_t pixelCount);
@@ -40,6 +51,12 @@ public:
 	// generate functions will initialize an uninitialized texture or simply overwrite an existing one
 	void generateFromData(int width, int height, float* data, size_t pixelCount);
 
+	// same as above for the compact formats, the texture takes on the format of the data (RGBA8, R16UI or R32UI)
+	// if the size and format have not changed the existing storage is reused instead of being reallocated
+	void generateFromData(int width, int height, const uint8_t* rgba);
+	void generateFromData(int width, int height, const uint16_t* values);
+	void generateFromData(int width, int height, const uint32_t* values);
+
 	// includes interpolation and clamping
 	void setDefaultTexParameters();
 
@@ -67,7 +84,10 @@ public:
 	// mipmap level will return the pixels of that level of the mipmap, level 0 is the original size, each level of mipmap is half the size of previous one
 	std::vector<std::array<float, 4>> getPixels(int mipmapLevel = 0);
 
-	// saves the texture to a file to a png file
+	// 4 bytes per pixel, a quarter of the memory of getPixels(), only for RGBA32F and RGBA8 textures
+	std::vector<uint8_t> getPixelsRGBA8(int mipmapLevel = 0);
+
+	// saves the texture to a png file, rows are read back and compressed in bands so the whole image is never held in memory
 	void saveToFile(const std::string& filepath);
 
 	GLuint getID();
@@ -75,9 +95,16 @@ public:
 	int getWidth();
 	int getHeight();
 
+	Format getFormat();
+	static int getBytesPerPixel(Format format);
+
 private:
 	GLuint id;
 	int width, height;
+	Format format = Format::RGBA32F;
+
+	void uploadData(int width, int height, Format format, const void* data);
+	bool isIntegerFormat();
 
 	GLuint frameBufferID;
 	void generateFrameBuffer();
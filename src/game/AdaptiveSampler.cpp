@@ -0,0 +1,238 @@
+#include "game/AdaptiveSampler.h"
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+	// the same jitter every time for the same pixel so exports are reproducible
+	float jitter(int x, int y, int sample) {
+		uint32_t h = (uint32_t)x * 0x8da6b343u ^ (uint32_t)y * 0xd8163841u ^ (uint32_t)sample * 0xcb1ab31fu;
+		h ^= h >> 15;
+		h *= 0x2c1b3c6du;
+		h ^= h >> 12;
+		h *= 0x297a2d39u;
+		h ^= h >> 15;
+		return (h >> 8) * (1.0f / (1 << 24));
+	}
+
+	// box filter over groups of 'samples' rgba values, the inner loops are fixed length so they vectorize
+	void downsample(const uint8_t* samples, int pixelCount, uint8_t* rgba) {
+		const int n = AdaptiveSampler::gridSize * AdaptiveSampler::gridSize;
+
+		for (int p = 0; p < pixelCount; p++) {
+			uint16_t sum[4] = { n / 2, n / 2, n / 2, n / 2 };
+			for (int s = 0; s < n; s++)
+				for (int c = 0; c < 4; c++)
+					sum[c] += samples[((size_t)p * n + s) * 4 + c];
+
+			for (int c = 0; c < 4; c++)
+				rgba[(size_t)p * 4 + c] = (uint8_t)(sum[c] / n);
+		}
+	}
+
+	bool differs(const uint8_t* a, const uint8_t* b, int threshold) {
+		return std::abs(a[0] - b[0]) > threshold || std::abs(a[1] - b[1]) > threshold || std::abs(a[2] - b[2]) > threshold;
+	}
+
+}
+
+AdaptiveSampler::AdaptiveSampler(const MandelbrotView& view, int width, int height, const OrbitTrap& trap, bool smooth, const Colorizer& colorize,
+	int threshold, int threadCount) :
+	view(view),
+	width(width),
+	height(height),
+	trap(trap),
+	smooth(smooth),
+	colorize(colorize),
+	threshold(threshold),
+	threadCount(threadCount > 0 ? threadCount : Parallel::defaultThreadCount())
+{
+}
+
+void AdaptiveSampler::renderBand(int top, int rowCount, uint8_t* rgba)
+{
+	const size_t rowBytes = (size_t)width * 4;
+
+	// rows[0] is the row above the band (y = top) and rows[rowCount + 1] the row below it (y = top - rowCount - 1), either may be off the image
+	rows.resize(rowBytes * (rowCount + 2));
+	auto rowOf = [&](int y) { return &rows[rowBytes * (top - y)]; };
+
+	int firstY = std::min(top, height - 1);
+	int lastY = std::max(top - rowCount - 1, 0);
+
+	// the two rows shared with the last band were already rendered
+	int reusedFrom = firstY + 1;
+	if (carriedRow == firstY) {
+		std::copy(carried.begin(), carried.end(), rowOf(firstY));
+		reusedFrom = firstY - 1;
+	}
+
+	forEachRow(reusedFrom - lastY, [&](int i) {
+		renderRow(reusedFrom - 1 - i, rowOf(reusedFrom - 1 - i));
+	});
+
+	if (lastY + 1 <= firstY) {
+		carriedRow = lastY + 1;
+		carried.assign(rowOf(lastY + 1), rowOf(lastY + 1) + rowBytes * 2);
+	}
+
+	std::vector<int> edges(rowCount);
+	forEachRow(rowCount, [&](int row) {
+		int y = top - 1 - row;
+		const uint8_t* above = y + 1 < height ? rowOf(y + 1) : nullptr;
+		const uint8_t* here = rowOf(y);
+		const uint8_t* below = y > 0 ? rowOf(y - 1) : nullptr;
+
+		uint8_t* out = rgba + rowBytes * row;
+		std::copy(here, here + rowBytes, out);
+
+		std::vector<int> edgeXs;
+		for (int x = 0; x < width; x++) {
+			const uint8_t* pixel = here + x * 4;
+			if ((x > 0 && differs(pixel, pixel - 4, threshold)) || (x + 1 < width && differs(pixel, pixel + 4, threshold)) ||
+				(above && differs(pixel, above + x * 4, threshold)) || (below && differs(pixel, below + x * 4, threshold)))
+				edgeXs.push_back(x);
+		}
+
+		if (!edgeXs.empty())
+			supersample(y, edgeXs, out);
+		edges[row] = (int)edgeXs.size();
+	});
+
+	pixelCount += (uint64_t)width * rowCount;
+	for (int count : edges)
+		edgePixelCount += count;
+}
+
+void AdaptiveSampler::setRowSource(const RowSource& source)
+{
+	rowSource = source;
+}
+
+void AdaptiveSampler::setRunner(const Parallel::Runner& runner)
+{
+	this->runner = runner;
+}
+
+void AdaptiveSampler::forEachRow(int count, const std::function<void(int)>& job)
+{
+	if (count <= 0)
+		return;
+	if (runner)
+		runner(count, job);
+	else
+		Parallel::forEach(count, threadCount, job);
+}
+
+void AdaptiveSampler::renderRow(int y, uint8_t* rgba)
+{
+	std::vector<int> itters(width);
+	std::vector<float> smoothItters(smooth ? width : 0);
+	std::vector<float> trapDistances(trap.shape != OrbitTrap::Shape::None ? width : 0);
+	float* smoothPtr = smooth ? &smoothItters[0] : nullptr;
+	float* trapPtr = trapDistances.empty() ? nullptr : &trapDistances[0];
+
+	if (rowSource)
+		rowSource(y, &itters[0], smoothPtr, trapPtr);
+	else
+		MandelbrotCPU::renderRow(view, width, height, y, 0, width, &itters[0], smoothPtr, &trap, trapPtr);
+	colorize(&itters[0], smoothPtr, trapPtr, width, rgba);
+}
+
+void AdaptiveSampler::supersample(int y, const std::vector<int>& xs, uint8_t* rgba)
+{
+	const int n = gridSize * gridSize;
+
+	// grid cells in the order they are sampled, the first 4 are one from each quarter of the pixel so they are already a stratified 2x2 grid
+	static const int cellOrder[n] = { 0, 2, 8, 10, 5, 7, 13, 15, 1, 3, 9, 11, 4, 6, 12, 14 };
+	const int firstPass = 4;
+
+	std::vector<uint8_t> samples(xs.size() * n * 4);
+
+	// samples cells [cellBegin, cellEnd) of cellOrder for the pixels 'which' (indices into xs)
+	// the samples of every pixel in the row go through the kernel together so the simd lanes stay full
+	auto sample = [&](const std::vector<int>& which, int cellBegin, int cellEnd) {
+		int perPixel = cellEnd - cellBegin;
+		size_t count = which.size() * perPixel;
+		if (count == 0)
+			return;
+
+		// each sample is jittered within its cell and the grid covers the pixel's own square centered on its first sample
+		std::vector<double> zx(count), zy(count), cx(count), cy(count);
+		for (size_t i = 0; i < which.size(); i++) {
+			int x = xs[which[i]];
+			for (int c = cellBegin; c < cellEnd; c++) {
+				int cell = cellOrder[c];
+				double px = MandelbrotCPU::pixelToPlaneX(view, x - 0.5 + (cell % gridSize + jitter(x, y, cell * 2)) / gridSize, width);
+				double py = MandelbrotCPU::pixelToPlaneY(view, y - 0.5 + (cell / gridSize + jitter(x, y, cell * 2 + 1)) / gridSize, height);
+
+				size_t k = i * perPixel + (c - cellBegin);
+				zx[k] = view.julia ? px : 0.0;
+				zy[k] = view.julia ? py : 0.0;
+				cx[k] = view.julia ? view.juliaX : px;
+				cy[k] = view.julia ? view.juliaY : py;
+			}
+		}
+
+		std::vector<int> itters(count);
+		std::vector<float> smoothItters(smooth ? count : 0);
+		std::vector<float> trapDistances(trap.shape != OrbitTrap::Shape::None ? count : 0);
+		float* smoothPtr = smooth ? &smoothItters[0] : nullptr;
+		float* trapPtr = trapDistances.empty() ? nullptr : &trapDistances[0];
+		MandelbrotCPU::renderPoints(view, &zx[0], &zy[0], &cx[0], &cy[0], (int)count, &itters[0], smoothPtr, &trap, trapPtr);
+
+		std::vector<uint8_t> colors(count * 4);
+		colorize(&itters[0], smoothPtr, trapPtr, count, &colors[0]);
+		for (size_t i = 0; i < which.size(); i++)
+			std::copy(&colors[i * perPixel * 4], &colors[(i + 1) * perPixel * 4], &samples[((size_t)which[i] * n + cellBegin) * 4]);
+	};
+
+	std::vector<int> all(xs.size());
+	for (size_t i = 0; i < xs.size(); i++)
+		all[i] = (int)i;
+	sample(all, 0, firstPass);
+
+	// pixels where the first 4 samples agree with each other and the center are flat enough inside and just get those averaged,
+	// the rest get the whole grid
+	std::vector<int> refine, coarse;
+	for (size_t i = 0; i < xs.size(); i++) {
+		const uint8_t* first = &samples[i * n * 4];
+		const uint8_t* center = rgba + xs[i] * 4;
+
+		bool agree = true;
+		for (int c = 0; c < firstPass; c++)
+			agree = agree && !differs(first + c * 4, center, threshold);
+
+		(agree ? coarse : refine).push_back((int)i);
+	}
+	sample(refine, firstPass, n);
+
+	// a coarse pixel has 4 samples, they are repeated to fill the grid so every pixel goes through the same 16 sample filter
+	for (int i : coarse)
+		for (int c = firstPass; c < n; c++)
+			std::copy(&samples[((size_t)i * n + c % firstPass) * 4], &samples[((size_t)i * n + c % firstPass) * 4] + 4, &samples[((size_t)i * n + c) * 4]);
+
+	std::vector<uint8_t> averaged(xs.size() * 4);
+	downsample(&samples[0], (int)xs.size(), &averaged[0]);
+	for (size_t i = 0; i < xs.size(); i++)
+		std::copy(&averaged[i * 4], &averaged[i * 4] + 4, rgba + xs[i] * 4);
+
+	extraSamples += xs.size() * firstPass + refine.size() * (n - firstPass);
+}
+
+uint64_t AdaptiveSampler::getPixelCount()
+{
+	return pixelCount;
+}
+
+uint64_t AdaptiveSampler::getEdgePixelCount()
+{
+	return edgePixelCount;
+}
+
+uint64_t AdaptiveSampler::getSampleCount()
+{
+	return pixelCount + extraSamples;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "engine/Parallel.h"
+#include "game/MandelbrotCPU.h"
+#include "game/OrbitTrap.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// edge adaptive anti-aliasing for exports
+// every pixel gets one sample first, then only the pixels whose color differs from a neighbour get more: a jittered 2x2 grid, and the rest of
+// a 4x4 grid if those samples still disagree, which are averaged down to the pixel. the aliasing is all along filaments and the borders of color bands, which are a small part of most images,
+// so this looks close to supersampling every pixel 16 times for a few times the cost of one sample
+//
+// rows are rendered in bands from the top of the image down like exportMandelbrot_cpu writes them, the row above and below a band are needed
+// to find its edges and are carried over from one band to the next instead of being rendered twice
+class AdaptiveSampler {
+public:
+	// colors 'count' samples into 4 bytes each, 'smooth' and 'trapDistances' are null unless they were asked for
+	using Colorizer = std::function<void(const int* itters, const float* smooth, const float* trapDistances, size_t count, uint8_t* rgba)>;
+
+	// fills one row of one sample per pixel escape data, the same outputs as MandelbrotCPU::renderRow for the whole row
+	using RowSource = std::function<void(int y, int* itters, float* smooth, float* trapDistances)>;
+
+	static const int gridSize = 4; // an edge pixel gets gridSize * gridSize samples
+
+	// 'threshold' is the biggest difference in any of r, g or b between neighbours that is not treated as an edge
+	AdaptiveSampler(const MandelbrotView& view, int width, int height, const OrbitTrap& trap, bool smooth, const Colorizer& colorize,
+		int threshold = 12, int threadCount = 0);
+
+	// renders rows [top - rows, top) into 'rgba' (width * rows * 4 bytes, the top row first)
+	// bands must be asked for in order from the top of the image down
+	void renderBand(int top, int rows, uint8_t* rgba);
+
+	// takes the one sample per pixel rows from 'source' instead of itterating them, only the extra edge samples are rendered here
+	// it is called from several threads at once
+	void setRowSource(const RowSource& source);
+
+	// spreads the rows of each band with 'runner' instead of over threadCount threads of its own
+	void setRunner(const Parallel::Runner& runner);
+
+	uint64_t getPixelCount();
+	uint64_t getEdgePixelCount();
+
+	// every sample taken so far, one per pixel plus the extra ones of the edge pixels
+	uint64_t getSampleCount();
+
+private:
+	// rgba of one row at one sample per pixel
+	void renderRow(int y, uint8_t* rgba);
+
+	// replaces the colors of the pixels 'xs' of row 'y' with the average of their jittered grids of samples
+	void supersample(int y, const std::vector<int>& xs, uint8_t* rgba);
+
+	// with the runner if there is one
+	void forEachRow(int count, const std::function<void(int)>& job);
+
+	MandelbrotView view;
+	int width, height;
+	OrbitTrap trap;
+	bool smooth;
+	Colorizer colorize;
+	int threshold;
+	int threadCount;
+	RowSource rowSource;
+	Parallel::Runner runner;
+
+	// one sample per pixel rows, row 0 is the row above the band, the band itself, then the row below
+	std::vector<uint8_t> rows;
+	int carriedRow = -1; // the row of the image held in 'carried', the bottom row of the last band is the top of the next one
+	std::vector<uint8_t> carried;
+
+	uint64_t pixelCount = 0;
+	uint64_t edgePixelCount = 0;
+	std::atomic<uint64_t> extraSamples{ 0 };
+};
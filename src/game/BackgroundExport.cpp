@@ -0,0 +1,89 @@
+#include "game/BackgroundExport.h"
+
+#include <cstdio>
+
+BackgroundExport::BackgroundExport()
+{
+}
+
+BackgroundExport::~BackgroundExport()
+{
+	cancel();
+	wait();
+}
+
+bool BackgroundExport::start(const std::string& filepath, const MandelbrotView& view, int width, int height, const ImageExport::Settings& settings,
+	const std::vector<int>* histogramItters)
+{
+	if (running)
+		return false;
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->filepath = filepath;
+	}
+	this->histogramItters = histogramItters ? *histogramItters : std::vector<int>();
+	cancelled = false;
+	tracker.begin(0.0);
+	running = true;
+
+	thread = std::thread([this, filepath, view, width, height, settings, copied = histogramItters != nullptr]() {
+		ImageExport::Settings exportSettings = settings;
+		exportSettings.tracker = &tracker;
+		exportSettings.cancelled = [this]() { return (bool)cancelled; };
+
+		// the pre-pass is a few percent of the export and runs here so starting one never holds up the caller
+		tracker.begin(RenderProgress::predict(view, width, height, 1));
+		ImageExport::Result exported = ImageExport::exportPng(filepath, view, width, height, exportSettings, copied ? &this->histogramItters : nullptr);
+		tracker.finish();
+
+		if (exported.written)
+			printf("%s: %.1f s in the background, %.2f samples per pixel, the itterations were predicted %+.1f%% off\n", filepath.c_str(),
+				exported.milliseconds / 1000.0, (double)exported.samples / exported.pixels, tracker.getError() * 100.0);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		result = exported;
+		running = false;
+	});
+
+	return true;
+}
+
+void BackgroundExport::cancel()
+{
+	cancelled = true;
+}
+
+void BackgroundExport::wait()
+{
+	if (thread.joinable())
+		thread.join();
+}
+
+bool BackgroundExport::isRunning()
+{
+	return running;
+}
+
+float BackgroundExport::getProgress()
+{
+	return tracker.getEstimate().fraction;
+}
+
+RenderProgress& BackgroundExport::getTracker()
+{
+	return tracker;
+}
+
+std::string BackgroundExport::getFilepath()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return filepath;
+}
+
+ImageExport::Result BackgroundExport::getResult()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return result;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "game/ImageExport.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// an ImageExport png written on a thread of its own while the app keeps running, the Ctrl+S exports
+// the rows are rendered with the runner in its settings, usually a RenderScheduler at export priority so exploring is not slowed down by it
+class BackgroundExport {
+public:
+	BackgroundExport();
+
+	// cancels an export that is still running, the unfinished file is removed
+	~BackgroundExport();
+
+	BackgroundExport(const BackgroundExport&) = delete;
+
+	// returns false if an export is already running, 'histogramItters' is copied
+	bool start(const std::string& filepath, const MandelbrotView& view, int width, int height, const ImageExport::Settings& settings,
+		const std::vector<int>* histogramItters = nullptr);
+
+	void cancel();
+
+	// blocks until the export is finished or cancelled
+	void wait();
+
+	bool isRunning();
+
+	// fraction of the predicted itterations done
+	float getProgress();
+
+	// with the time left, and once finished how far off the prediction was
+	RenderProgress& getTracker();
+
+	std::string getFilepath();
+
+	// of the last export that finished
+	ImageExport::Result getResult();
+
+private:
+	std::thread thread;
+	std::atomic<bool> running{ false };
+	std::atomic<bool> cancelled{ false };
+	RenderProgress tracker;
+
+	std::mutex mutex;
+	std::string filepath;
+	ImageExport::Result result;
+	std::vector<int> histogramItters;
+};
@@ -0,0 +1,292 @@
+#include "game/BatchRenderer.h"
+#include "game/HeadlessRenderer.h"
+#include "game/ItterationEstimator.h"
+#include "game/TileCache.h"
+#include "game/ViewState.h"
+#include "engine/Json.h"
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+namespace {
+
+	bool readPair(const JsonValue& value, double& a, double& b) {
+		const std::vector<JsonValue>& pair = value.getArray();
+		if (pair.size() != 2 || pair[0].getType() != JsonValue::Type::Number || pair[1].getType() != JsonValue::Type::Number)
+			return false;
+		a = pair[0].getNumber();
+		b = pair[1].getNumber();
+		return true;
+	}
+
+	std::string textOf(const JsonValue& value) {
+		if (value.getType() == JsonValue::Type::String)
+			return value.getString();
+		if (value.getType() != JsonValue::Type::Number)
+			return "";
+
+		char text[32];
+		snprintf(text, sizeof(text), "%.17g", value.getNumber());
+		return text;
+	}
+
+	// a center pair or zoom as numbers, or as strings so deep locations keep every digit
+	bool readLocation(const JsonValue& value, MandelbrotView& view, bool center) {
+		ViewState location;
+		MandelbrotView placed;
+		if (center) {
+			const std::vector<JsonValue>& pair = value.getArray();
+			if (pair.size() != 2 || !location.setCenter(textOf(pair[0]), textOf(pair[1])) || !location.apply(placed))
+				return false;
+			view.camX = placed.camX;
+			view.camXLow = placed.camXLow;
+			view.camY = placed.camY;
+			view.camYLow = placed.camYLow;
+		}
+		else {
+			if (!location.setZoom(textOf(value)) || !location.apply(placed))
+				return false;
+			view.camZoom = placed.camZoom;
+		}
+		return true;
+	}
+
+	bool readJob(const JsonValue& line, BatchRenderer::Job& job, std::string& error) {
+		if (line.getType() != JsonValue::Type::Object) {
+			error = "a job must be an object";
+			return false;
+		}
+
+		for (const auto& member : line.getMembers()) {
+			const std::string& name = member.first;
+			const JsonValue& value = member.second;
+			bool valid = true;
+
+			if (name == "output") {
+				job.output = value.getString();
+				valid = !job.output.empty();
+			}
+			else if (name == "center") {
+				valid = readLocation(value, job.view, true);
+			}
+			else if (name == "zoom") {
+				valid = readLocation(value, job.view, false);
+			}
+			else if (name == "size") {
+				double w, h;
+				valid = readPair(value, w, h) && w >= 1 && h >= 1;
+				job.width = (int)w;
+				job.height = (int)h;
+			}
+			else if (name == "itters") {
+				job.autoItter = value.getString() == "auto";
+				job.view.maxItter = (int)value.getNumber();
+				valid = job.autoItter || job.view.maxItter > 0;
+			}
+			else if (name == "palette") {
+				const std::string& palette = value.getString();
+				job.settings.paletteMode = palette == "histogram" ? Palette::Mode::Histogram : Palette::Mode::Linear;
+				job.settings.smooth = palette == "smooth";
+				valid = palette == "linear" || palette == "histogram" || palette == "smooth";
+			}
+			else if (name == "color_shift") {
+				job.view.colorShiftFactor = (float)value.getNumber(job.view.colorShiftFactor);
+			}
+			else if (name == "formula") {
+				if (!HeadlessRenderer::parseFormula(value.getString(), job.view, error)) {
+					error = "formula: " + error;
+					return false;
+				}
+			}
+			else if (name == "julia") {
+				job.view.julia = value.getType() != JsonValue::Type::Bool || value.getBool();
+				valid = value.getType() == JsonValue::Type::Bool || readPair(value, job.view.juliaX, job.view.juliaY);
+			}
+			else if (name == "trap") {
+				valid = HeadlessRenderer::parseTrap(value.getString(), job.settings.trap.shape);
+			}
+			else if (name == "trap_scale") {
+				job.settings.trapScale = (float)value.getNumber();
+				valid = job.settings.trapScale > 0.0f;
+			}
+			else if (name == "aa") {
+				valid = value.getType() == JsonValue::Type::Bool;
+				job.settings.antiAliased = value.getBool();
+			}
+			else {
+				error = "unknown member \"" + name + "\"";
+				return false;
+			}
+
+			if (!valid) {
+				error = "bad value for \"" + name + "\": " + value.serialize();
+				return false;
+			}
+		}
+
+		if (job.output.empty()) {
+			error = "a job needs an \"output\"";
+			return false;
+		}
+		return true;
+	}
+
+}
+
+bool BatchRenderer::readManifest(const std::string& filepath, const Job& defaults, std::vector<Job>& jobs, std::string& error)
+{
+	std::ifstream stream(filepath);
+	if (!stream) {
+		error = "could not open the manifest";
+		return false;
+	}
+
+	std::string text;
+	int lineNumber = 0;
+	while (std::getline(stream, text)) {
+		lineNumber++;
+		if (text.find_first_not_of(" \t\r") == std::string::npos)
+			continue;
+
+		JsonValue line;
+		Job job = defaults;
+		job.line = lineNumber;
+		if (!JsonValue::parse(text, line, error) || !readJob(line, job, error)) {
+			error = "line " + std::to_string(lineNumber) + ": " + error;
+			return false;
+		}
+		jobs.push_back(job);
+	}
+
+	if (jobs.empty()) {
+		error = "no jobs in the manifest";
+		return false;
+	}
+	return true;
+}
+
+int BatchRenderer::run(std::vector<Job> jobs, int threadCount, size_t cacheBytes)
+{
+	auto start = std::chrono::steady_clock::now();
+	if (threadCount <= 0)
+		threadCount = Parallel::defaultThreadCount();
+
+	std::vector<TileCache::Placement> placements;
+	for (Job& job : jobs) {
+		if (job.autoItter)
+			job.view.maxItter = ItterationEstimator::estimate(job.view, job.width, job.height).maxItter;
+
+		// the same escape data ImageExport asks for
+		bool trapped = job.settings.trap.shape != OrbitTrap::Shape::None;
+		bool smooth = job.settings.smooth && job.settings.paletteMode == Palette::Mode::Linear && !trapped;
+		placements.push_back(TileCache::place(job.view, job.width, job.height, smooth, job.settings.trap));
+	}
+
+	// jobs on the same lattice run together so the tiles they share are still cached, the levels go from the most zoomed in out
+	// since a tile of the level above is entirely made of points of the one below, and within a level they go across the plane
+	std::vector<int> order(jobs.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = (int)i;
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		const TileCache::Placement& pa = placements[a];
+		const TileCache::Placement& pb = placements[b];
+		if (pa.lattice != pb.lattice)
+			return pa.lattice < pb.lattice;
+		if (pa.level != pb.level)
+			return pa.level < pb.level;
+		if (pa.view.camY != pb.view.camY)
+			return pa.view.camY < pb.view.camY;
+		return pa.view.camX < pb.view.camX;
+	});
+
+	// progress of the whole run, every image counts whether its rows were itterated or shared
+	RenderProgress tracker;
+	double predicted = 0.0;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		// jobs too deep for the cache render their own view, not the one moved onto the lattice
+		const MandelbrotView& rendered = TileCache::canPlace(jobs[i].view, jobs[i].width, jobs[i].height) ? placements[i].view : jobs[i].view;
+		predicted += RenderProgress::predict(rendered, jobs[i].width, jobs[i].height, threadCount);
+	}
+	tracker.begin(predicted);
+	RenderProgress::Printer printer("batch", tracker);
+
+	TileCache cache(cacheBytes);
+	int failed = 0;
+	uint64_t pixels = 0, edgeSamples = 0;
+
+	for (int index : order) {
+		const Job& job = jobs[index];
+		const TileCache::Placement& placement = placements[index];
+		TileCache::Stats before = cache.getStats();
+
+		// bands overlap by the rows around them, those were prepared with the band before and are still held by 'previous'
+		TileCache::Rows current, previous;
+		int prepared = job.height;
+
+		ImageExport::Settings settings = job.settings;
+		settings.threadCount = threadCount;
+		settings.tracker = &tracker;
+
+		// views past double precision are not shared, they render on their own
+		if (!TileCache::canPlace(job.view, job.width, job.height)) {
+			ImageExport::Result result = ImageExport::exportPng(job.output, job.view, job.width, job.height, settings);
+			if (!result.written) {
+				printf("line %d: could not write %s\n", job.line, job.output.c_str());
+				failed++;
+				continue;
+			}
+
+			pixels += result.pixels;
+			edgeSamples += result.samples - result.pixels;
+			printf("%s: %dx%d, maxItter %d, %.0f ms, not shared (too deep), checksum %08x\n", job.output.c_str(), job.width, job.height, job.view.maxItter,
+				result.milliseconds, result.checksum);
+			continue;
+		}
+
+		settings.prepareRows = [&](int yBegin, int yEnd) {
+			previous = std::move(current);
+			current = cache.prepare(placement, yBegin, std::min(yEnd, prepared), threadCount);
+			prepared = std::min(prepared, yBegin);
+		};
+		settings.rowSource = [&](int y, int* itters, float* smooth, float* trapDistances) {
+			(current.contains(y) ? current : previous).copyRow(y, itters, smooth, trapDistances);
+		};
+
+		ImageExport::Result result = ImageExport::exportPng(job.output, placement.view, job.width, job.height, settings);
+		if (!result.written) {
+			printf("line %d: could not write %s\n", job.line, job.output.c_str());
+			failed++;
+			continue;
+		}
+
+		TileCache::Stats after = cache.getStats();
+		uint64_t shared = (after.samplesReused - before.samplesReused) + (after.samplesBorrowed - before.samplesBorrowed);
+		pixels += result.pixels;
+		edgeSamples += result.samples - result.pixels;
+
+		printf("%s: %dx%d, maxItter %d, %.0f ms, %.0f%% of the samples shared, checksum %08x\n", job.output.c_str(), job.width, job.height, job.view.maxItter,
+			result.milliseconds, 100.0 * shared / result.pixels, result.checksum);
+	}
+
+	tracker.finish();
+
+	TileCache::Stats stats = cache.getStats();
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	uint64_t samples = stats.samplesComputed + stats.samplesReused + stats.samplesBorrowed;
+	uint64_t itterations = stats.itterationsComputed + stats.itterationsSaved;
+
+	printf("%d images, %.1f Mpx in %.0f ms\n", (int)jobs.size() - failed, pixels / 1e6, milliseconds);
+	printf("  %.2f M samples itterated, %.2f M reused from the same zoom and %.2f M from other zooms: %.1f%% of samples and %.1f%% of itterations saved\n",
+		stats.samplesComputed / 1e6, stats.samplesReused / 1e6, stats.samplesBorrowed / 1e6,
+		samples ? 100.0 * (samples - stats.samplesComputed) / samples : 0.0, itterations ? 100.0 * stats.itterationsSaved / itterations : 0.0);
+	if (edgeSamples)
+		printf("  %.2f M extra anti-aliasing samples, these are not shared\n", edgeSamples / 1e6);
+	printf("  the itterations of the images were predicted %+.1f%% off\n", tracker.getError() * 100.0);
+	if (stats.tilesEvicted)
+		printf("  %llu tiles were evicted, a bigger --cache-mb may share more\n", (unsigned long long)stats.tilesEvicted);
+
+	return failed;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "game/ImageExport.h"
+#include "game/MandelbrotCPU.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// renders a manifest of many images in one run, sharing the escape data of every job that looks at the same part of the plane with the same formula
+// and maxItter through one TileCache, so animation frames, zoom sequences and the same view in several palettes or sizes only itterate each point once
+//
+// the manifest is json lines, one job per line, every member is optional except "output" and starts from the command line options:
+//   {"output": "a.png", "center": [-0.5, 0], "zoom": 4, "size": [1920, 1080], "itters": 500, "palette": "smooth", "color_shift": 2,
+//    "formula": "burning-ship", "julia": [-0.8, 0.156], "trap": "cross", "trap_scale": 0.1, "aa": true}
+//
+// each view is moved less than half a pixel to sit on the tile lattice of its pixel size, only the one sample per pixel data is shared,
+// the extra edge samples of anti-aliasing are still worked out for every image
+namespace BatchRenderer {
+
+	struct Job {
+		std::string output;
+		MandelbrotView view;
+		int width = 3840, height = 2160;
+		bool autoItter = false;
+		ImageExport::Settings settings;
+		int line = 0; // in the manifest, for messages
+	};
+
+	// reads every job of the manifest at 'filepath', returns false with a message in 'error' if a line is not a valid job
+	bool readManifest(const std::string& filepath, const Job& defaults, std::vector<Job>& jobs, std::string& error);
+
+	// renders the jobs, ordered so ones that share tiles run one after another while those tiles are still cached, and prints what sharing saved
+	// returns the number of images that could not be written
+	int run(std::vector<Job> jobs, int threadCount, size_t cacheBytes);
+
+}
@@ -0,0 +1,460 @@
+#include "game/Benchmark.h"
+#include "game/MandelbrotCPU.h"
+#include "game/Palette.h"
+#include "game/FormulaProgram.h"
+#include "game/OrbitTrap.h"
+#include "game/FrameStream.h"
+#include "game/TileCache.h"
+#include "game/CostMap.h"
+#include "game/RenderScheduler.h"
+#include "game/BackgroundExport.h"
+#ifndef HEADLESS_ONLY
+#include "engine/Texture.h"
+#endif
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	double millisecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+}
+
+#ifndef HEADLESS_ONLY
+void Benchmark::pixelFormats(int width, int height)
+{
+	const int runs = 10;
+
+	MandelbrotView view;
+	size_t pixelCount = (size_t)width * height;
+	std::vector<int> itters(pixelCount);
+	MandelbrotCPU::renderItterations(view, width, height, &itters[0], 0, height);
+
+	std::vector<float> rgba32f(pixelCount * 4);
+	std::vector<uint8_t> rgba8(pixelCount * 4);
+	std::vector<uint16_t> r16(pixelCount);
+	std::vector<uint32_t> r32(pixelCount);
+
+	const char* names[4] = { "RGBA32F", "RGBA8", "R16UI", "R32UI" };
+	Texture::Format formats[4] = { Texture::Format::RGBA32F, Texture::Format::RGBA8, Texture::Format::R16UI, Texture::Format::R32UI };
+	double baseUploadMs = 0.0;
+
+	printf("\npixel formats, %dx%d, average of %d runs\n", width, height, runs);
+	printf("%-8s %6s %9s %9s %10s %8s\n", "format", "B/px", "MB", "pack ms", "upload ms", "vs f32");
+
+	for (int f = 0; f < 4; f++) {
+		Texture texture;
+
+		double packMs = 0.0, uploadMs = 0.0;
+		for (int run = 0; run <= runs; run++) {
+			auto start = std::chrono::steady_clock::now();
+			switch (formats[f]) {
+			case Texture::Format::RGBA32F:
+				for (size_t i = 0; i < pixelCount; i++) {
+					std::array<float, 3> color = MandelbrotCPU::colorRotator((float)itters[i] / view.maxItter, view.colorShiftFactor);
+					rgba32f[i * 4 + 0] = color[0];
+					rgba32f[i * 4 + 1] = color[1];
+					rgba32f[i * 4 + 2] = color[2];
+					rgba32f[i * 4 + 3] = 1.0f;
+				}
+				break;
+			case Texture::Format::RGBA8:
+				MandelbrotCPU::colorizeRGBA8(&itters[0], pixelCount, view.maxItter, view.colorShiftFactor, &rgba8[0]);
+				break;
+			case Texture::Format::R16UI:
+				r16.assign(itters.begin(), itters.end());
+				break;
+			case Texture::Format::R32UI:
+				r32.assign(itters.begin(), itters.end());
+				break;
+			}
+			double pack = millisecondsSince(start);
+
+			start = std::chrono::steady_clock::now();
+			switch (formats[f]) {
+			case Texture::Format::RGBA32F: texture.generateFromData(width, height, &rgba32f[0], pixelCount); break;
+			case Texture::Format::RGBA8: texture.generateFromData(width, height, &rgba8[0]); break;
+			case Texture::Format::R16UI: texture.generateFromData(width, height, &r16[0]); break;
+			case Texture::Format::R32UI: texture.generateFromData(width, height, &r32[0]); break;
+			}
+			glFinish();
+			double upload = millisecondsSince(start);
+
+			// the first run allocates the texture so it is left out
+			if (run > 0) {
+				packMs += pack / runs;
+				uploadMs += upload / runs;
+			}
+		}
+
+		if (f == 0)
+			baseUploadMs = uploadMs;
+
+		int bytes = Texture::getBytesPerPixel(formats[f]);
+		printf("%-8s %6d %9.1f %9.2f %10.2f %7.2fx\n", names[f], bytes, bytes * pixelCount / (1024.0 * 1024.0), packMs, uploadMs, baseUploadMs / uploadMs);
+	}
+}
+#endif
+
+void Benchmark::colorizers(int width, int height)
+{
+	const int runs = 10;
+
+	MandelbrotView view;
+	size_t pixelCount = (size_t)width * height;
+	std::vector<int> itters(pixelCount);
+	MandelbrotCPU::renderItterations(view, width, height, &itters[0], 0, height);
+
+	std::vector<uint8_t> formula(pixelCount * 4);
+	std::vector<uint8_t> lookup(pixelCount * 4);
+	Palette palette;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int run = 0; run < runs; run++)
+		MandelbrotCPU::colorizeRGBA8(&itters[0], pixelCount, view.maxItter, view.colorShiftFactor, &formula[0]);
+	double formulaMs = millisecondsSince(start) / runs;
+
+	start = std::chrono::steady_clock::now();
+	palette.update(view.maxItter, view.colorShiftFactor);
+	double buildMs = millisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	for (int run = 0; run < runs; run++)
+		palette.colorize(&itters[0], pixelCount, &lookup[0]);
+	double lookupMs = millisecondsSince(start) / runs;
+
+	bool identical = memcmp(&formula[0], &lookup[0], formula.size()) == 0;
+
+	Palette histogram;
+	start = std::chrono::steady_clock::now();
+	for (int run = 0; run < runs; run++)
+		histogram.updateHistogram(&itters[0], pixelCount, view.maxItter, view.colorShiftFactor);
+	double histogramMs = millisecondsSince(start) / runs;
+
+	printf("\ncolorizers, %dx%d, average of %d runs\n", width, height, runs);
+	printf("%-16s %9s %8s\n", "method", "ms", "speedup");
+	printf("%-16s %9.2f %7.2fx\n", "cos() per pixel", formulaMs, 1.0);
+	printf("%-16s %9.2f %8s\n", "palette build", buildMs, "-");
+	printf("%-16s %9.2f %7.2fx\n", "palette lookup", lookupMs, formulaMs / lookupMs);
+	printf("%-16s %9.2f %8s\n", "histogram build", histogramMs, "-");
+	printf("output %s\n", identical ? "identical" : "DIFFERENT");
+}
+
+void Benchmark::formulas(int width, int height)
+{
+	const int bandHeight = 16;
+	int bandCount = (height + bandHeight - 1) / bandHeight;
+	int threadCount = Parallel::defaultThreadCount();
+
+	std::vector<int> itters((size_t)width * height);
+	MandelbrotView base;
+
+	auto render = [&](const MandelbrotView& view) {
+		auto start = std::chrono::steady_clock::now();
+		Parallel::forEach(bandCount, threadCount, [&](int band) {
+			MandelbrotCPU::renderItterations(view, width, height, &itters[0], band * bandHeight, std::min((band + 1) * bandHeight, height));
+		});
+		return millisecondsSince(start);
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	Parallel::forEach(bandCount, threadCount, [&](int band) {
+		for (int y = band * bandHeight; y < std::min((band + 1) * bandHeight, height); y++) {
+			double y0 = MandelbrotCPU::pixelToPlaneY(base, y, height);
+			for (int x = 0; x < width; x++)
+				itters[x + (size_t)y * width] = MandelbrotCPU::mandelbrotAt(MandelbrotCPU::pixelToPlaneX(base, x, width), y0, base.maxItter);
+		}
+	});
+	double scalarMs = millisecondsSince(start);
+
+	printf("\nformulas, %dx%d, maxItter %d, %d threads\n", width, height, base.maxItter, threadCount);
+	printf("%-30s %9s %8s\n", "formula", "ms", "Mpx/s");
+	printf("%-30s %9.2f %8.2f\n", "z^2 + c (scalar loop)", scalarMs, width * height / scalarMs / 1000.0);
+
+	struct Row {
+		const char* name;
+		MandelbrotView::Formula formula;
+		int power;
+		bool julia;
+	};
+	const Row rows[] = {
+		{ "z^2 + c", MandelbrotView::Formula::Mandelbrot, 3, false },
+		{ "z^3 + c", MandelbrotView::Formula::Multibrot, 3, false },
+		{ "z^4 + c", MandelbrotView::Formula::Multibrot, 4, false },
+		{ "z^8 + c", MandelbrotView::Formula::Multibrot, 8, false },
+		{ "burning ship", MandelbrotView::Formula::BurningShip, 3, false },
+		{ "tricorn", MandelbrotView::Formula::Tricorn, 3, false },
+		{ "julia z^2 + c", MandelbrotView::Formula::Mandelbrot, 3, true },
+	};
+
+	for (const Row& row : rows) {
+		MandelbrotView view = base;
+		view.formula = row.formula;
+		view.power = row.power;
+		view.julia = row.julia;
+		if (row.julia)
+			view.camX = 0.0;
+
+		double ms = render(view);
+		printf("%-30s %9.2f %8.2f\n", row.name, ms, width * height / ms / 1000.0);
+	}
+
+	// the same formulas typed in at runtime and run by the bytecode interpreter
+	const char* sources[] = { "z^2 + c", "z^3 + c", "sqr(fold(z)) + c", "sqr(conj(z)) + c" };
+	for (const char* source : sources) {
+		std::string error;
+		MandelbrotView view = base;
+		view.formula = MandelbrotView::Formula::Custom;
+		view.program = FormulaProgram::compile(source, error);
+
+		double ms = render(view);
+		printf("%-30s %9.2f %8.2f\n", ("bytecode " + std::string(source)).c_str(), ms, width * height / ms / 1000.0);
+	}
+
+	// orbit traps are tracked inside the kernel, the percentage is the extra time over the scalar loop without a trap
+	std::vector<float> trapDistances((size_t)width * height);
+	const char* trapNames[] = { "", "point trap", "line trap", "cross trap", "circle trap" };
+	for (int shape = 1; shape < 5; shape++) {
+		OrbitTrap trap;
+		trap.shape = (OrbitTrap::Shape)shape;
+
+		auto trapStart = std::chrono::steady_clock::now();
+		Parallel::forEach(bandCount, threadCount, [&](int band) {
+			for (int y = band * bandHeight; y < std::min((band + 1) * bandHeight, height); y++)
+				MandelbrotCPU::renderRow(base, width, height, y, 0, width, &itters[(size_t)y * width], nullptr, &trap, &trapDistances[(size_t)y * width]);
+		});
+		double ms = millisecondsSince(trapStart);
+		printf("%-30s %9.2f %8.2f %+7.1f%%\n", trapNames[shape], ms, width * height / ms / 1000.0, (ms / scalarMs - 1.0) * 100.0);
+	}
+}
+
+void Benchmark::partitions(int width, int height, int parts)
+{
+	MandelbrotView view;
+	view.camX = -0.7435669;
+	view.camY = 0.1314023;
+	view.camZoom = 1.0 / 200.0;
+	view.maxItter = 2000;
+
+	CostMap costs(view, width, height);
+
+	// one thread, so each part's time is its work however many cores there are
+	std::vector<int> itters(width);
+	auto render = [&](const CostMap::Region& region) {
+		auto start = std::chrono::steady_clock::now();
+		for (int y = region.y0; y < region.y1; y++)
+			MandelbrotCPU::renderRow(view, width, height, y, region.x0, region.x1, &itters[0]);
+		return millisecondsSince(start);
+	};
+
+	std::vector<CostMap::Region> equalRows;
+	for (int part = 0; part < parts; part++) {
+		CostMap::Region region;
+		region.x1 = width;
+		region.y0 = height * part / parts;
+		region.y1 = height * (part + 1) / parts;
+		region.cost = costs.cost(region.x0, region.y0, region.x1, region.y1);
+		equalRows.push_back(region);
+	}
+
+	struct Split {
+		const char* name;
+		std::vector<CostMap::Region> regions;
+	};
+	const Split splits[] = {
+		{ "equal rows", equalRows },
+		{ "cost rows", costs.bisectRows(parts) },
+		{ "cost bisection", costs.bisect(parts) },
+	};
+
+	printf("\npartitions, %dx%d near the boundary, maxItter %d, %d parts, cost pre-pass %.1f ms\n", width, height, view.maxItter, parts, costs.getMilliseconds());
+	printf("%-16s %10s %10s %10s %16s\n", "split", "slowest ms", "mean ms", "imbalance", "share error avg");
+
+	for (const Split& split : splits) {
+		std::vector<double> ms;
+		double total = 0.0;
+		for (const CostMap::Region& region : split.regions) {
+			ms.push_back(render(region));
+			total += ms.back();
+		}
+
+		// how far each part's predicted share of the work was from the share it actually took
+		double error = 0.0;
+		for (size_t i = 0; i < ms.size(); i++)
+			error += std::abs(split.regions[i].cost / costs.getTotal() - ms[i] / total);
+
+		double slowest = *std::max_element(ms.begin(), ms.end());
+		double mean = total / ms.size();
+		printf("%-16s %10.1f %10.1f %9.2fx %15.2f%%\n", split.name, slowest, mean, slowest / mean, 100.0 * error / ms.size());
+	}
+}
+
+void Benchmark::stream(int width, int height)
+{
+	const uint16_t port = FrameStream::defaultPort + 1; // so it can run next to a session that is streaming
+	FrameStream::Sender sender(port);
+	FrameStream::Receiver receiver;
+	if (!sender.isListening() || !receiver.connect(port)) {
+		printf("\nstream: could not listen on 127.0.0.1:%d\n", port);
+		return;
+	}
+
+	struct Phase {
+		const char* name;
+		int steps;
+		double panX, panY; // per step, in screen widths and heights
+		double zoom;
+		float colorShift;
+	};
+	const Phase phases[] = {
+		{ "first frame", 1, 0.0, 0.0, 1.0, 0.0f },
+		{ "pan right 1%", 20, 0.01, 0.0, 1.0, 0.0f },
+		{ "pan up 5%", 10, 0.0, 0.05, 1.0, 0.0f },
+		{ "pan diagonal 2%", 10, 0.02, -0.02, 1.0, 0.0f },
+		{ "zoom in 1%", 10, 0.0, 0.0, 0.99, 0.0f },
+		{ "color shift", 5, 0.0, 0.0, 1.0, 1.0f },
+		{ "still", 5, 0.0, 0.0, 1.0, 0.0f },
+	};
+
+	MandelbrotView view;
+	view.camX = -0.75;
+	view.camY = 0.1;
+	view.camZoom = 0.25;
+	view.maxItter = 500;
+
+	size_t rawBytes = (size_t)width * height * sizeof(int);
+	FrameStream::Frame frame;
+	bool received = true;
+
+	printf("\nstream, %dx%d over loopback, %.0f KB per frame uncompressed\n", width, height, rawBytes / 1024.0);
+	printf("%-18s %6s %10s %8s %10s %10s\n", "step", "frames", "KB/frame", "tiles", "avg ms", "max ms");
+
+	for (const Phase& phase : phases) {
+		double bytes = 0.0, tiles = 0.0, latency = 0.0, maxLatency = 0.0;
+		for (int step = 0; step < phase.steps && received; step++) {
+			view.camX += phase.panX * 3.5 * view.camZoom;
+			view.camY += phase.panY * 2.0 * view.camZoom;
+			view.camZoom *= phase.zoom;
+			view.colorShiftFactor += phase.colorShift;
+
+			// one message per view since the next is only shown once this one has arrived
+			sender.show(view, width, height);
+			received = receiver.receive(frame);
+
+			bytes += frame.bytes;
+			tiles += frame.tiles;
+			latency += frame.latencyMilliseconds;
+			maxLatency = std::max(maxLatency, frame.latencyMilliseconds);
+		}
+		printf("%-18s %6d %10.1f %8.1f %10.2f %10.2f\n", phase.name, phase.steps, bytes / phase.steps / 1024.0, tiles / phase.steps,
+			latency / phase.steps, maxLatency);
+	}
+
+	if (!received) {
+		printf("the stream broke part way through\n");
+		return;
+	}
+
+	// the last view rendered from scratch, the deltas must add up to exactly the same escape data
+	TileCache cache((size_t)256 << 20);
+	TileCache::Placement placement = TileCache::place(view, width, height, false, OrbitTrap());
+	std::vector<int> expected((size_t)width * height);
+	{
+		TileCache::Rows rows = cache.prepare(placement, 0, height, Parallel::defaultThreadCount());
+		for (int y = 0; y < height; y++)
+			rows.copyRow(y, &expected[(size_t)y * width], nullptr, nullptr);
+	}
+
+	FrameStream::Sender::Stats stats = sender.getStats();
+	printf("%llu frames, %.1f MB sent, %.0f%% of tiles unchanged, %.1f itterated samples per frame pixel\n", (unsigned long long)stats.frames,
+		stats.bytes / (1024.0 * 1024.0), 100.0 * stats.tilesUnchanged / std::max<uint64_t>(1, stats.tilesSent + stats.tilesUnchanged),
+		(double)stats.samplesItterated / ((double)stats.frames * width * height));
+	printf("viewer escape data %s\n", frame.itters == expected ? "identical" : "DIFFERENT");
+
+	receiver.close();
+}
+
+void Benchmark::scheduler(int width, int height)
+{
+	MandelbrotView view;
+	view.camX = -0.7435669;
+	view.camY = 0.1314023;
+	view.camZoom = 1.0 / 200.0;
+	view.maxItter = 2000;
+
+	const int frames = 12;
+	const int bandHeight = 16;
+	const std::string exportPath = "benchmark-export.png";
+	std::vector<int> itters((size_t)width * height);
+
+	RenderScheduler pool;
+
+	struct Setup {
+		const char* name;
+		bool exporting;
+		bool scheduled;
+	};
+	const Setup setups[] = {
+		{ "idle", false, true },
+		{ "export, scheduled", true, true },
+		{ "export, unscheduled", true, false },
+	};
+
+	printf("\nscheduler, %d frames of %dx%d while exporting 7680x4320, %d pool threads (%d for exports)\n", frames, width, height,
+		pool.getThreadCount(), pool.getExportThreadCount());
+	printf("%-20s %10s %10s %14s\n", "setup", "median ms", "worst ms", "export done");
+
+	for (const Setup& setup : setups) {
+		BackgroundExport exporter;
+		if (setup.exporting) {
+			ImageExport::Settings settings;
+			settings.threadCount = setup.scheduled ? 1 : Parallel::defaultThreadCount();
+			if (setup.scheduled)
+				settings.runner = pool.runner(RenderScheduler::Priority::Export);
+			exporter.start(exportPath, view, 7680, 4320, settings);
+		}
+
+		float startProgress = exporter.getProgress();
+
+		// a pan each frame with a short pause after it, as when exploring, the scheduled export only moves on in the pauses when every core is busy
+		std::vector<double> ms;
+		MandelbrotView frame = view;
+		for (int i = 0; i < frames; i++) {
+			frame.camX += frame.camZoom * 0.05;
+			auto frameStart = std::chrono::steady_clock::now();
+
+			auto renderBand = [&](int band) {
+				MandelbrotCPU::renderItterations(frame, width, height, &itters[0], band * bandHeight, std::min((band + 1) * bandHeight, height));
+			};
+			int bands = (height + bandHeight - 1) / bandHeight;
+			if (setup.scheduled)
+				pool.forEach(RenderScheduler::Priority::Interactive, bands, renderBand);
+			else
+				Parallel::forEach(bands, Parallel::defaultThreadCount(), renderBand);
+
+			ms.push_back(millisecondsSince(frameStart));
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+
+		// of the predicted itterations, while the frames were rendered
+		double done = (exporter.getProgress() - startProgress) * 100.0;
+		exporter.cancel();
+		exporter.wait();
+
+		std::sort(ms.begin(), ms.end());
+		if (setup.exporting)
+			printf("%-20s %10.1f %10.1f %13.1f%%\n", setup.name, ms[ms.size() / 2], ms.back(), done);
+		else
+			printf("%-20s %10.1f %10.1f %14s\n", setup.name, ms[ms.size() / 2], ms.back(), "-");
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// timing comparisons that print a table to the console
+namespace Benchmark {
+
+	// memory, cpu packing time and upload time of a width x height itteration buffer in each Texture::Format
+	// needs an opengl context, left out of HEADLESS_ONLY builds
+	void pixelFormats(int width, int height);
+
+	// per pixel cos() formula against the palette lookup table, also checks that both give identical bytes
+	void colorizers(int width, int height);
+
+	// render time of every formula through the simd kernel on all cores, with the plain scalar loop as the reference
+	// and of z^2 + c with each orbit trap shape
+	void formulas(int width, int height);
+
+	// splits a view near the boundary of the set into parts by equal area, by equal predicted cost in rows and by recursive bisection of a CostMap
+	// renders each part on its own and prints how unbalanced each split is and how far the predicted share of each part was from its actual one
+	void partitions(int width, int height, int parts);
+
+	// streams a scripted session of pans, zooms and color shifts to a viewer over loopback through FrameStream
+	// prints the bytes and tiles per frame and the latency of each kind of step, and checks the viewer ends up with identical escape data
+	void stream(int width, int height);
+
+	// interactive frames of width x height while an 8k export is being written, through a RenderScheduler and with both on every core
+	// prints the frame times of each next to those with nothing else running, and how fast the export moved meanwhile
+	void scheduler(int width, int height);
+
+}
@@ -0,0 +1,263 @@
+#include "game/Buddhabrot.h"
+#include "game/Formulas.h"
+#include "game/FormulaProgram.h"
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+Buddhabrot::Buddhabrot()
+{
+}
+
+Buddhabrot::~Buddhabrot()
+{
+	stop();
+}
+
+void Buddhabrot::start(const MandelbrotView& view, int width, int height, const BuddhabrotBands& bands, int threadCount)
+{
+	stop();
+
+	this->view = view;
+	this->bands = bands;
+	this->width = width;
+	this->height = height;
+
+	image.assign((size_t)width * height * 3, 0.0f);
+	orbitCount = 0;
+	acceptedCount = 0;
+	version++;
+
+	if (threadCount <= 0)
+		threadCount = Parallel::defaultThreadCount();
+
+	stopping = false;
+	std::random_device seeds;
+	for (int i = 0; i < threadCount; i++) {
+		int seed = (int)seeds();
+		workers.emplace_back([this, seed]() { workerLoop(seed); });
+	}
+}
+
+void Buddhabrot::stop()
+{
+	stopping = true;
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+bool Buddhabrot::isRunning()
+{
+	return !workers.empty();
+}
+
+int Buddhabrot::getVersion()
+{
+	return version;
+}
+
+void Buddhabrot::getImage(std::vector<uint8_t>& rgba)
+{
+	std::vector<float> planes;
+	{
+		std::lock_guard<std::mutex> lock(imageMutex);
+		planes = image;
+	}
+
+	size_t pixelCount = (size_t)width * height;
+	rgba.resize(pixelCount * 4);
+
+	for (int channel = 0; channel < 3; channel++) {
+		const float* plane = &planes[channel * pixelCount];
+
+		// a few pixels near the main cardioid get far more hits than anything else, scaling to the very brightest would leave the rest black
+		std::vector<float> sorted(plane, plane + pixelCount);
+		size_t index = pixelCount * 999 / 1000;
+		std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+		float scale = sorted[index] > 0.0f ? sorted[index] : *std::max_element(sorted.begin(), sorted.end());
+
+		for (size_t i = 0; i < pixelCount; i++) {
+			float value = scale > 0.0f ? std::min(plane[i] / scale, 1.0f) : 0.0f;
+			rgba[i * 4 + channel] = (uint8_t)(std::sqrt(value) * 255.0f + 0.5f);
+		}
+	}
+
+	for (size_t i = 0; i < pixelCount; i++)
+		rgba[i * 4 + 3] = 255;
+}
+
+uint64_t Buddhabrot::getOrbitCount()
+{
+	std::lock_guard<std::mutex> lock(imageMutex);
+	return orbitCount;
+}
+
+float Buddhabrot::getAcceptanceRate()
+{
+	std::lock_guard<std::mutex> lock(imageMutex);
+	return orbitCount > 0 ? (float)acceptedCount / orbitCount : 0.0f;
+}
+
+int Buddhabrot::getWidth()
+{
+	return width;
+}
+
+int Buddhabrot::getHeight()
+{
+	return height;
+}
+
+void Buddhabrot::merge(std::vector<float>& histogram, uint64_t orbits, uint64_t accepted)
+{
+	{
+		std::lock_guard<std::mutex> lock(imageMutex);
+		for (size_t i = 0; i < image.size(); i++)
+			image[i] += histogram[i];
+		orbitCount += orbits;
+		acceptedCount += accepted;
+	}
+
+	std::fill(histogram.begin(), histogram.end(), 0.0f);
+	version++;
+}
+
+void Buddhabrot::workerLoop(int seed)
+{
+	const int maxItter = std::max(bands.red, std::max(bands.green, bands.blue));
+	const size_t pixelCount = (size_t)width * height;
+
+	std::mt19937_64 random(seed);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+	std::vector<float> histogram(pixelCount * 3, 0.0f);
+
+	// plane to pixel, the inverse of MandelbrotCPU::pixelToPlaneX / Y
+	double scaleX = width / (3.5 * view.camZoom);
+	double scaleY = height / (2.0 * view.camZoom);
+
+	// mutations of c are between 1/10000 and 1/10 of the width of the view, picked on a log scale
+	double span = 3.5 * view.camZoom;
+	double smallestMutation = span * 1e-4;
+	double largestMutation = span * 0.1;
+
+	// an orbit with the pixels it passes through in the view, 'contribution' is how many there are (0 if it never escapes)
+	struct Orbit {
+		double cx = 0.0, cy = 0.0;
+		int escapedAt = 0;
+		std::vector<int> pixels;
+		double contribution() const { return (double)pixels.size(); }
+	};
+
+	auto run = [&](const auto& step) {
+		auto trace = [&](Orbit& orbit) {
+			orbit.pixels.clear();
+			orbit.escapedAt = 0;
+
+			// most of the area of the set is the main cardioid and the period 2 bulb, neither ever escapes
+			if (view.formula == MandelbrotView::Formula::Mandelbrot) {
+				double x = orbit.cx - 0.25;
+				double q = x * x + orbit.cy * orbit.cy;
+				if (q * (q + x) <= 0.25 * orbit.cy * orbit.cy || (orbit.cx + 1) * (orbit.cx + 1) + orbit.cy * orbit.cy <= 0.0625)
+					return;
+			}
+
+			double x = 0.0, y = 0.0;
+			for (int itter = 1; itter <= maxItter; itter++) {
+				step(x, y, orbit.cx, orbit.cy, x, y);
+				if (x * x + y * y > 2 * 2) {
+					orbit.escapedAt = itter;
+					return;
+				}
+
+				double px = (x - view.camX) * scaleX + width * 0.5;
+				double py = (y - view.camY) * scaleY + height * 0.5;
+				if (px >= 0.0 && px < width && py >= 0.0 && py < height)
+					orbit.pixels.push_back((int)px + (int)py * width);
+			}
+
+			orbit.pixels.clear();
+		};
+
+		// 'weight' undoes the metropolis-hastings preference for orbits with a lot of points in the view, so the image comes out the
+		// same as with uniformly chosen c values, just with far less noise
+		auto splat = [&](const Orbit& orbit, double weight) {
+			float w = (float)(weight / orbit.contribution());
+			float* red = orbit.escapedAt <= bands.red ? &histogram[0] : nullptr;
+			float* green = orbit.escapedAt <= bands.green ? &histogram[pixelCount] : nullptr;
+			float* blue = orbit.escapedAt <= bands.blue ? &histogram[pixelCount * 2] : nullptr;
+
+			for (int pixel : orbit.pixels) {
+				if (red) red[pixel] += w;
+				if (green) green[pixel] += w;
+				if (blue) blue[pixel] += w;
+			}
+		};
+
+		Orbit current, proposal;
+		uint64_t orbits = 0, accepted = 0;
+		int stay = 0; // how many steps the chain has stayed on 'current' since it was last splatted
+
+		auto lastMerge = std::chrono::steady_clock::now();
+		while (!stopping) {
+			for (int i = 0; i < 256; i++) {
+				// until a contributing orbit is found the chain jumps anywhere, after that mostly small steps with the odd jump
+				bool large = current.pixels.empty() || uniform(random) < 0.2;
+				if (large) {
+					proposal.cx = uniform(random) * 4.0 - 2.0;
+					proposal.cy = uniform(random) * 4.0 - 2.0;
+				}
+				else {
+					double radius = largestMutation * std::exp(-std::log(largestMutation / smallestMutation) * uniform(random));
+					double angle = uniform(random) * 6.283185307179586;
+					proposal.cx = current.cx + radius * std::cos(angle);
+					proposal.cy = current.cy + radius * std::sin(angle);
+				}
+
+				trace(proposal);
+				orbits++;
+
+				bool accept = !proposal.pixels.empty() && (current.pixels.empty() || uniform(random) * current.contribution() < proposal.contribution());
+				if (accept) {
+					if (stay > 0)
+						splat(current, stay);
+					std::swap(current, proposal);
+					stay = 1;
+					accepted++;
+				}
+				else if (!current.pixels.empty()) {
+					stay++;
+				}
+			}
+
+			if (std::chrono::steady_clock::now() - lastMerge > std::chrono::milliseconds(250)) {
+				if (stay > 0)
+					splat(current, stay);
+				stay = 0;
+
+				merge(histogram, orbits, accepted);
+				orbits = 0;
+				accepted = 0;
+				lastMerge = std::chrono::steady_clock::now();
+			}
+		}
+
+		if (stay > 0)
+			splat(current, stay);
+		merge(histogram, orbits, accepted);
+	};
+
+	if (view.formula == MandelbrotView::Formula::Custom) {
+		if (view.program)
+			run([&](double x, double y, double cx, double cy, double& nx, double& ny) { view.program->step(x, y, cx, cy, nx, ny); });
+	}
+	else {
+		Formulas::dispatchFormula<false>(view, [&](auto formula, auto) {
+			run([](double x, double y, double cx, double cy, double& nx, double& ny) { decltype(formula)::step(x, y, cx, cy, nx, ny); });
+		});
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// orbit density rendering (buddhabrot), instead of coloring c by how fast it escapes every z its orbit visits is counted
+// with different itteration limits in red, green and blue it becomes a nebulabrot
+//
+// the c values are chosen with metropolis-hastings so samples pile up on orbits that actually pass through the view, which matters a lot
+// once zoomed in where almost every uniformly chosen c would be wasted. every thread runs its own chain into its own histograms, with no
+// atomics in the hot loop, and adds them into the shared image a few times a second so the image can be shown while it builds up
+// an orbit is counted in a channel if it escapes within that many itterations
+struct BuddhabrotBands {
+	int red = 5000;
+	int green = 500;
+	int blue = 50;
+};
+
+class Buddhabrot {
+public:
+	Buddhabrot();
+	~Buddhabrot();
+
+	Buddhabrot(const Buddhabrot&) = delete;
+
+	// starts sampling the orbits that pass through 'view' (its formula and camera, maxItter is replaced by the bands and julia mode is ignored)
+	// a running render is stopped and its image dropped
+	void start(const MandelbrotView& view, int width, int height, const BuddhabrotBands& bands = BuddhabrotBands(), int threadCount = 0);
+
+	// stops the workers, the image so far is kept
+	void stop();
+
+	bool isRunning();
+
+	// incremented every time a worker adds its samples to the image
+	int getVersion();
+
+	// the image so far, each channel scaled so its brightest pixels (ignoring the top 0.1%) are white, 4 bytes per pixel bottom row first like the textures
+	void getImage(std::vector<uint8_t>& rgba);
+
+	uint64_t getOrbitCount();
+	float getAcceptanceRate();
+
+	int getWidth();
+	int getHeight();
+
+private:
+	void workerLoop(int seed);
+
+	// adds and clears a worker's private histograms
+	void merge(std::vector<float>& histogram, uint64_t orbits, uint64_t accepted);
+
+	MandelbrotView view;
+	BuddhabrotBands bands;
+	int width = 0, height = 0;
+
+	std::vector<std::thread> workers;
+	std::atomic<bool> stopping{ false };
+
+	std::mutex imageMutex;
+	std::vector<float> image; // red, green and blue planes one after the other
+	uint64_t orbitCount = 0;
+	uint64_t acceptedCount = 0;
+	std::atomic<int> version{ 0 };
+};
@@ -0,0 +1,153 @@
+#include "game/CostMap.h"
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+	// what a pixel costs besides its itterations (mapping it onto the plane, colorizing and writing it), roughly 6 itterations
+	const double pixelCost = 6.0;
+
+}
+
+CostMap::CostMap()
+{
+}
+
+CostMap::CostMap(const MandelbrotView& view, int width, int height, int sampleColumns, int threadCount) :
+	width(width), height(height)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	columns = std::max(1, std::min(sampleColumns, width));
+	rows = std::max(1, std::min(height, (int)std::lround((double)columns * height / width)));
+
+	// the samples are a smaller image of the same view, so each is the middle of its cell
+	std::vector<int> samples((size_t)columns * rows);
+	Parallel::forEach(rows, threadCount > 0 ? threadCount : Parallel::defaultThreadCount(), [&](int row) {
+		MandelbrotCPU::renderRow(view, columns, rows, row, 0, columns, &samples[(size_t)row * columns]);
+	});
+
+	double cellPixels = ((double)width / columns) * ((double)height / rows);
+	sums.assign((size_t)(columns + 1) * (rows + 1), 0.0);
+	for (int row = 0; row < rows; row++) {
+		double rowSum = 0.0;
+		for (int column = 0; column < columns; column++) {
+			rowSum += (samples[(size_t)row * columns + column] + pixelCost) * cellPixels;
+			sums[(size_t)(row + 1) * (columns + 1) + column + 1] = sums[(size_t)row * (columns + 1) + column + 1] + rowSum;
+		}
+	}
+
+	milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+double CostMap::rowCost(const int* itters, int count)
+{
+	int64_t sum = 0;
+	for (int i = 0; i < count; i++)
+		sum += itters[i];
+	return sum + pixelCost * count;
+}
+
+double CostMap::getTotal() const
+{
+	return sums.empty() ? 0.0 : sums.back();
+}
+
+double CostMap::getMilliseconds() const
+{
+	return milliseconds;
+}
+
+int CostMap::getWidth() const
+{
+	return width;
+}
+
+int CostMap::getHeight() const
+{
+	return height;
+}
+
+double CostMap::below(double x, double y) const
+{
+	double u = x * columns / width, v = y * rows / height;
+	int i = std::min((int)u, columns - 1), j = std::min((int)v, rows - 1);
+	double fu = u - i, fv = v - j;
+
+	auto at = [&](int column, int row) { return sums[(size_t)row * (columns + 1) + column]; };
+	return at(i, j) * (1 - fu) * (1 - fv) + at(i + 1, j) * fu * (1 - fv) + at(i, j + 1) * (1 - fu) * fv + at(i + 1, j + 1) * fu * fv;
+}
+
+double CostMap::cost(int x0, int y0, int x1, int y1) const
+{
+	if (sums.empty() || x0 >= x1 || y0 >= y1)
+		return 0.0;
+	return below(x1, y1) - below(x0, y1) - below(x1, y0) + below(x0, y0);
+}
+
+std::vector<CostMap::Region> CostMap::bisect(int parts) const
+{
+	Region all;
+	all.x1 = width;
+	all.y1 = height;
+	all.cost = getTotal();
+
+	std::vector<Region> regions;
+	split(all, std::max(1, parts), false, regions);
+	return regions;
+}
+
+std::vector<CostMap::Region> CostMap::bisectRows(int parts) const
+{
+	Region all;
+	all.x1 = width;
+	all.y1 = height;
+	all.cost = getTotal();
+
+	std::vector<Region> regions;
+	split(all, std::max(1, parts), true, regions);
+
+	// bottom to top
+	std::sort(regions.begin(), regions.end(), [](const Region& a, const Region& b) { return a.y0 < b.y0; });
+	return regions;
+}
+
+void CostMap::split(const Region& region, int parts, bool rowsOnly, std::vector<Region>& out) const
+{
+	bool acrossRows = rowsOnly || region.y1 - region.y0 >= region.x1 - region.x0;
+	int length = acrossRows ? region.y1 - region.y0 : region.x1 - region.x0;
+	if (parts <= 1 || length < 2) {
+		out.push_back(region);
+		return;
+	}
+
+	// 'parts' may be odd, the first half gets its share of the cost
+	int firstParts = parts / 2;
+	double target = region.cost * firstParts / parts;
+
+	// the cost up to a cut only grows as it moves along, so the cut is found by binary search
+	int low = 1, high = length - 1;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		double first = acrossRows ? cost(region.x0, region.y0, region.x1, region.y0 + middle) : cost(region.x0, region.y0, region.x0 + middle, region.y1);
+		if (first < target)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	Region first = region, second = region;
+	if (acrossRows)
+		first.y1 = second.y0 = region.y0 + low;
+	else
+		first.x1 = second.x0 = region.x0 + low;
+	first.cost = cost(first.x0, first.y0, first.x1, first.y1);
+	second.cost = cost(second.x0, second.y0, second.x1, second.y1);
+
+	split(first, firstParts, rowsOnly, out);
+	split(second, parts - firstParts, rowsOnly, out);
+}
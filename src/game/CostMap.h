@@ -0,0 +1,53 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+
+#include <vector>
+
+// predicted render cost of every part of a view, from a low resolution pre-pass
+//
+// one pixel costs about its escape count, so a strip along the boundary of the set can cost a thousand times more than the same area outside it
+// and splitting an image into equal areas leaves most workers waiting for one. a grid of sample points is itterated first (a few percent of the
+// render) and each cell is taken to cost its sample's escape count for each of its pixels, plus a fixed cost per pixel. the cells are kept as a
+// summed area table so the cost of any rectangle of pixels is 4 lookups, and partitions are cut by recursive bisection on those sums
+class CostMap {
+public:
+	struct Region {
+		int x0 = 0, y0 = 0, x1 = 0, y1 = 0; // pixels [x0, x1) x [y0, y1), y from the bottom
+		double cost = 0.0;                  // predicted, in itterations
+	};
+
+	CostMap();
+
+	// 'sampleColumns' sample points across, with square cells, using every core unless 'threadCount' says otherwise
+	CostMap(const MandelbrotView& view, int width, int height, int sampleColumns = 192, int threadCount = 0);
+
+	double getTotal() const;
+	double getMilliseconds() const; // the pre-pass took
+
+	// the actual cost of rendered escape counts in the same units, for comparing with what was predicted
+	static double rowCost(const int* itters, int count);
+
+	// predicted cost of the pixels [x0, x1) x [y0, y1), cells a rectangle only partly covers count for the part it covers
+	double cost(int x0, int y0, int x1, int y1) const;
+
+	// the image cut into 'parts' rectangles of about equal cost, each cut goes across the longer side of what it splits
+	std::vector<Region> bisect(int parts) const;
+
+	// the same but only cut between rows, for workers that render whole rows
+	std::vector<Region> bisectRows(int parts) const;
+
+	int getWidth() const;
+	int getHeight() const;
+
+private:
+	void split(const Region& region, int parts, bool rowsOnly, std::vector<Region>& out) const;
+
+	// cost of [0, x) x [0, y), bilinear between the corners of the summed area table since a cell costs the same all over
+	double below(double x, double y) const;
+
+	int width = 0, height = 0;
+	int columns = 0, rows = 0;
+	std::vector<double> sums; // (columns + 1) x (rows + 1)
+	double milliseconds = 0.0;
+};
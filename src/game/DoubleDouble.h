@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cmath>
+
+// a number kept as the unevaluated sum of two doubles, hi + lo with |lo| at most half an ulp of hi, for about 106 bits of mantissa
+// the second precision tier of the kernel, views are only rendered with it once a double can no longer tell neighbouring pixels apart
+//
+// products are split with Dekker's method instead of std::fma because fma is emulated in software on cpus without it,
+// which needs the compiler to keep the order of the operations (not /fp:fast or -ffast-math)
+struct DoubleDouble {
+	double hi = 0.0;
+	double lo = 0.0;
+
+	DoubleDouble() {}
+	DoubleDouble(double value) : hi(value) {}
+	DoubleDouble(double hi, double lo) : hi(hi), lo(lo) {}
+
+	// the sum of two doubles exactly
+	static DoubleDouble twoSum(double a, double b) {
+		double s = a + b;
+		double v = s - a;
+		return DoubleDouble(s, (a - (s - v)) + (b - v));
+	}
+
+	// the same when |a| >= |b|
+	static DoubleDouble quickTwoSum(double a, double b) {
+		double s = a + b;
+		return DoubleDouble(s, b - (s - a));
+	}
+
+	// the product of two doubles exactly
+	static DoubleDouble twoProduct(double a, double b) {
+		const double splitter = 134217729.0; // 2^27 + 1
+		double p = a * b;
+		double ta = splitter * a, tb = splitter * b;
+		double aHi = ta - (ta - a), bHi = tb - (tb - b);
+		double aLo = a - aHi, bLo = b - bHi;
+		return DoubleDouble(p, ((aHi * bHi - p) + aHi * bLo + aLo * bHi) + aLo * bLo);
+	}
+};
+
+inline DoubleDouble operator+(const DoubleDouble& a, const DoubleDouble& b) {
+	DoubleDouble s = DoubleDouble::twoSum(a.hi, b.hi);
+	DoubleDouble t = DoubleDouble::twoSum(a.lo, b.lo);
+	s = DoubleDouble::quickTwoSum(s.hi, s.lo + t.hi);
+	return DoubleDouble::quickTwoSum(s.hi, s.lo + t.lo);
+}
+
+inline DoubleDouble operator-(const DoubleDouble& a) {
+	return DoubleDouble(-a.hi, -a.lo);
+}
+
+inline DoubleDouble operator-(const DoubleDouble& a, const DoubleDouble& b) {
+	return a + -b;
+}
+
+inline DoubleDouble& operator+=(DoubleDouble& a, const DoubleDouble& b) {
+	return a = a + b;
+}
+
+inline DoubleDouble operator*(const DoubleDouble& a, const DoubleDouble& b) {
+	DoubleDouble p = DoubleDouble::twoProduct(a.hi, b.hi);
+	return DoubleDouble::quickTwoSum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+inline DoubleDouble operator/(const DoubleDouble& a, const DoubleDouble& b) {
+	// long division, each quotient digit is a double
+	double q1 = a.hi / b.hi;
+	DoubleDouble r = a - b * q1;
+	double q2 = r.hi / b.hi;
+	r = r - b * q2;
+	double q3 = r.hi / b.hi;
+	return DoubleDouble::quickTwoSum(q1, q2) + q3;
+}
+
+inline bool operator<(const DoubleDouble& a, const DoubleDouble& b) {
+	return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+inline bool operator<=(const DoubleDouble& a, const DoubleDouble& b) {
+	return a.hi < b.hi || (a.hi == b.hi && a.lo <= b.lo);
+}
+
+// found by argument dependent lookup, so formulas written with 'using std::abs' work for both tiers
+inline DoubleDouble abs(const DoubleDouble& a) {
+	return a.hi < 0.0 || (a.hi == 0.0 && a.lo < 0.0) ? -a : a;
+}
+
+inline DoubleDouble floor(const DoubleDouble& a) {
+	double hi = std::floor(a.hi);
+	if (hi != a.hi)
+		return DoubleDouble(hi);
+	return DoubleDouble::quickTwoSum(hi, std::floor(a.lo));
+}
+
+// the double nearest the value, for what only needs a double (smooth coloring, trap distances)
+inline double toDouble(double a) {
+	return a;
+}
+
+inline double toDouble(const DoubleDouble& a) {
+	return a.hi + a.lo;
+}
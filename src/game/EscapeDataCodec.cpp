@@ -0,0 +1,72 @@
+#include "game/EscapeDataCodec.h"
+
+namespace {
+
+	void writeVarint(uint64_t value, std::vector<uint8_t>& out) {
+		while (value >= 0x80) {
+			out.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back((uint8_t)value);
+	}
+
+	bool readVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value) {
+		value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (data == end)
+				return false;
+
+			uint8_t byte = *data++;
+			value |= (uint64_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+}
+
+void EscapeDataCodec::compress(const int* itters, size_t count, std::vector<uint8_t>& out)
+{
+	out.clear();
+
+	int64_t previous = 0;
+	size_t i = 0;
+	while (i < count) {
+		int64_t value = itters[i];
+		size_t run = 1;
+		while (i + run < count && itters[i + run] == value)
+			run++;
+
+		int64_t delta = value - previous;
+		writeVarint((uint64_t)((delta << 1) ^ (delta >> 63)), out);
+		writeVarint(run - 1, out);
+
+		previous = value;
+		i += run;
+	}
+}
+
+bool EscapeDataCodec::decompress(const uint8_t* data, size_t size, int* itters, size_t count)
+{
+	const uint8_t* end = data + size;
+
+	int64_t previous = 0;
+	size_t i = 0;
+	while (data != end) {
+		uint64_t zigzag, extraRun;
+		if (!readVarint(data, end, zigzag) || !readVarint(data, end, extraRun))
+			return false;
+
+		int64_t value = previous + ((int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1));
+		if (extraRun >= count - i)
+			return false;
+
+		for (size_t j = 0; j <= extraRun; j++)
+			itters[i++] = (int)value;
+
+		previous = value;
+	}
+
+	return i == count;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// lossless compression for itteration buffers
+// neighbouring pixels usually have the same or a very close escape count, so each value is stored as a zigzag varint delta from the
+// previous value followed by a varint count of how many times the new value repeats, the large flat interior and exterior bands collapse to a few bytes
+namespace EscapeDataCodec {
+
+	void compress(const int* itters, size_t count, std::vector<uint8_t>& out);
+
+	// returns false if 'data' does not decode to exactly 'count' values
+	bool decompress(const uint8_t* data, size_t size, int* itters, size_t count);
+
+}
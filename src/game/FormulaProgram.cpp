@@ -0,0 +1,618 @@
+#include "game/FormulaProgram.h"
+#include "game/OrbitTrap.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+// recursive descent parser that emits bytecode as it goes, expressions made only of constants are worked out while compiling
+class FormulaParser {
+public:
+	FormulaParser(const std::string& source, FormulaProgram& program) :
+		source(source),
+		program(program)
+	{
+	}
+
+	bool parse(std::string& error) {
+		Operand result = expression();
+		skipSpaces();
+		if (this->error.empty() && pos != source.size())
+			fail("unexpected '" + std::string(1, source[pos]) + "'");
+
+		if (!this->error.empty()) {
+			error = this->error + " at character " + std::to_string(pos + 1);
+			return false;
+		}
+
+		program.result = materialize(result);
+		program.degree = std::max(result.degree, 2);
+		if (!this->error.empty()) {
+			error = this->error;
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	// either a value known while compiling or a register, 'degree' is the power of z it contains
+	struct Operand {
+		bool constant;
+		double re, im;
+		int reg;
+		int degree;
+	};
+
+	Operand constant(double re, double im) {
+		return { true, re, im, -1, 0 };
+	}
+
+	Operand reg(int r, int degree) {
+		return { false, 0.0, 0.0, r, degree };
+	}
+
+	void fail(const std::string& message) {
+		if (error.empty())
+			error = message;
+	}
+
+	void skipSpaces() {
+		while (pos < source.size() && isspace((unsigned char)source[pos]))
+			pos++;
+	}
+
+	bool accept(char c) {
+		skipSpaces();
+		if (pos < source.size() && source[pos] == c) {
+			pos++;
+			return true;
+		}
+		return false;
+	}
+
+	int newRegister() {
+		if (program.registerCount == 256) {
+			fail("formula is too long");
+			return 0;
+		}
+		return program.registerCount++;
+	}
+
+	int materialize(const Operand& operand) {
+		if (!operand.constant)
+			return operand.reg;
+
+		if (!std::isfinite(operand.re) || !std::isfinite(operand.im)) {
+			fail("constant part divides by zero");
+			return 0;
+		}
+
+		int r = newRegister();
+		program.prologue.push_back({ FormulaProgram::Op::Const, (uint8_t)r, 0, 0, (int)program.constantsRe.size() });
+		program.constantsRe.push_back(operand.re);
+		program.constantsIm.push_back(operand.im);
+		return r;
+	}
+
+	Operand emit(FormulaProgram::Op op, const Operand& a, const Operand* b, int n, int degree) {
+		int ra = materialize(a);
+		int rb = b ? materialize(*b) : 0;
+		int r = newRegister();
+		program.body.push_back({ op, (uint8_t)r, (uint8_t)ra, (uint8_t)rb, n });
+		return reg(r, degree);
+	}
+
+	Operand binary(char op, const Operand& a, const Operand& b) {
+		if (a.constant && b.constant) {
+			switch (op) {
+			case '+': return constant(a.re + b.re, a.im + b.im);
+			case '-': return constant(a.re - b.re, a.im - b.im);
+			case '*': return constant(a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re);
+			default: {
+				double d = b.re * b.re + b.im * b.im;
+				return constant((a.re * b.re + a.im * b.im) / d, (a.im * b.re - a.re * b.im) / d);
+			}
+			}
+		}
+
+		switch (op) {
+		case '+': return emit(FormulaProgram::Op::Add, a, &b, 0, std::max(a.degree, b.degree));
+		case '-': return emit(FormulaProgram::Op::Sub, a, &b, 0, std::max(a.degree, b.degree));
+		case '*': return emit(FormulaProgram::Op::Mul, a, &b, 0, a.degree + b.degree);
+		default: return emit(FormulaProgram::Op::Div, a, &b, 0, a.degree - b.degree);
+		}
+	}
+
+	Operand power(const Operand& a, int n) {
+		if (n == 0)
+			return constant(1.0, 0.0);
+		if (n == 1)
+			return a;
+
+		if (a.constant) {
+			Operand p = a;
+			for (int i = 1; i < n; i++)
+				p = binary('*', p, a);
+			return p;
+		}
+
+		if (n == 2)
+			return emit(FormulaProgram::Op::Sqr, a, nullptr, 0, a.degree * 2);
+		return emit(FormulaProgram::Op::Pow, a, nullptr, n, a.degree * n);
+	}
+
+	Operand function(const std::string& name, const Operand& a) {
+		if (name == "sqr")
+			return power(a, 2);
+
+		if (a.constant) {
+			if (name == "conj") return constant(a.re, -a.im);
+			if (name == "fold") return constant(std::abs(a.re), std::abs(a.im));
+			if (name == "re") return constant(a.re, 0.0);
+			if (name == "im") return constant(a.im, 0.0);
+			if (name == "abs") return constant(std::sqrt(a.re * a.re + a.im * a.im), 0.0);
+		}
+		else {
+			if (name == "conj") return emit(FormulaProgram::Op::Conj, a, nullptr, 0, a.degree);
+			if (name == "fold") return emit(FormulaProgram::Op::Fold, a, nullptr, 0, a.degree);
+			if (name == "re") return emit(FormulaProgram::Op::Re, a, nullptr, 0, a.degree);
+			if (name == "im") return emit(FormulaProgram::Op::Im, a, nullptr, 0, a.degree);
+			if (name == "abs") return emit(FormulaProgram::Op::Abs, a, nullptr, 0, a.degree);
+		}
+
+		fail("unknown function '" + name + "'");
+		return a;
+	}
+
+	// expression := term (('+' | '-') term)*
+	Operand expression() {
+		Operand a = term();
+		for (;;) {
+			if (accept('+'))
+				a = binary('+', a, term());
+			else if (accept('-'))
+				a = binary('-', a, term());
+			else
+				return a;
+		}
+	}
+
+	// term := unary (('*' | '/') unary)*
+	Operand term() {
+		Operand a = unary();
+		for (;;) {
+			if (accept('*'))
+				a = binary('*', a, unary());
+			else if (accept('/'))
+				a = binary('/', a, unary());
+			else
+				return a;
+		}
+	}
+
+	// unary := '-' unary | factor ('^' integer)?
+	Operand unary() {
+		// every nested bracket or minus passes through here, deep nesting would run the thread out of stack
+		if (depth == maxDepth) {
+			fail("formula is nested too deeply");
+			return constant(0.0, 0.0);
+		}
+		depth++;
+		Operand a = signedFactor();
+		depth--;
+		return a;
+	}
+
+	Operand signedFactor() {
+		if (accept('-')) {
+			Operand a = unary();
+			if (a.constant)
+				return constant(-a.re, -a.im);
+			return emit(FormulaProgram::Op::Neg, a, nullptr, 0, a.degree);
+		}
+
+		Operand a = factor();
+		if (accept('^')) {
+			skipSpaces();
+			size_t start = pos;
+			while (pos < source.size() && isdigit((unsigned char)source[pos]))
+				pos++;
+
+			int n = pos > start && pos - start <= 2 ? atoi(source.substr(start, pos - start).c_str()) : -1;
+			if (n < 0 || n > 64) {
+				fail("powers must be whole numbers from 0 to 64");
+				return a;
+			}
+			a = power(a, n);
+		}
+		return a;
+	}
+
+	// factor := number | number 'i' | name | name '(' expression ')' | '(' expression ')'
+	Operand factor() {
+		skipSpaces();
+		if (pos >= source.size()) {
+			fail("formula ends too early");
+			return constant(0.0, 0.0);
+		}
+
+		if (accept('(')) {
+			Operand a = expression();
+			if (!accept(')'))
+				fail("missing ')'");
+			return a;
+		}
+
+		if (isdigit((unsigned char)source[pos]) || source[pos] == '.') {
+			char* end;
+			double value = strtod(source.c_str() + pos, &end);
+			pos = end - source.c_str();
+
+			bool imaginary = pos < source.size() && source[pos] == 'i' && (pos + 1 == source.size() || !isalnum((unsigned char)source[pos + 1]));
+			if (imaginary) {
+				pos++;
+				return constant(0.0, value);
+			}
+			return constant(value, 0.0);
+		}
+
+		if (isalpha((unsigned char)source[pos])) {
+			size_t start = pos;
+			while (pos < source.size() && isalnum((unsigned char)source[pos]))
+				pos++;
+			std::string name = source.substr(start, pos - start);
+
+			if (accept('(')) {
+				Operand a = expression();
+				if (!accept(')'))
+					fail("missing ')'");
+				return function(name, a);
+			}
+
+			if (name == "z") return reg(0, 1);
+			if (name == "c") return reg(1, 0);
+			if (name == "i") return constant(0.0, 1.0);
+
+			fail("unknown name '" + name + "'");
+			return constant(0.0, 0.0);
+		}
+
+		fail("unexpected '" + std::string(1, source[pos]) + "'");
+		return constant(0.0, 0.0);
+	}
+
+	static const int maxDepth = 64;
+
+	const std::string& source;
+	FormulaProgram& program;
+	size_t pos = 0;
+	int depth = 0;
+	std::string error;
+};
+
+namespace {
+
+	std::string glslDouble(double value) {
+		char text[40];
+		snprintf(text, sizeof(text), "%.17g", value);
+
+		std::string literal = text;
+		if (literal.find_first_of(".e") == std::string::npos)
+			literal += ".0";
+		return literal + "lf";
+	}
+
+}
+
+FormulaProgram::FormulaProgram()
+{
+}
+
+std::shared_ptr<const FormulaProgram> FormulaProgram::compile(const std::string& source, std::string& error)
+{
+	std::shared_ptr<FormulaProgram> program(new FormulaProgram());
+	program->source = source;
+
+	FormulaParser parser(program->source, *program);
+	if (!parser.parse(error))
+		return nullptr;
+
+	return program;
+}
+
+std::string FormulaProgram::builtinSource(int formula, int power)
+{
+	// in the order of MandelbrotView::Formula, these give the same results as the policies in game/Formulas.h
+	switch (formula) {
+	case 1: return "z^" + std::to_string(std::min(std::max(power, 3), 8)) + " + c";
+	case 2: return "sqr(fold(z)) + c";
+	case 3: return "sqr(conj(z)) + c";
+	default: return "z^2 + c";
+	}
+}
+
+const std::string& FormulaProgram::getSource() const
+{
+	return source;
+}
+
+const std::vector<FormulaProgram::Instruction>& FormulaProgram::getCode() const
+{
+	return body;
+}
+
+int FormulaProgram::getRegisterCount() const
+{
+	return registerCount;
+}
+
+int FormulaProgram::getDegree() const
+{
+	return degree;
+}
+
+void FormulaProgram::step(double x, double y, double cx, double cy, double& nx, double& ny) const
+{
+	double re[256], im[256];
+	re[0] = x;
+	im[0] = y;
+	re[1] = cx;
+	im[1] = cy;
+
+	for (const Instruction& in : prologue) {
+		re[in.dst] = constantsRe[in.n];
+		im[in.dst] = constantsIm[in.n];
+	}
+	run(re, im, 1, 1);
+
+	nx = re[result];
+	ny = im[result];
+}
+
+void FormulaProgram::escapeCounts(const double* px, double py, bool julia, double juliaX, double juliaY, int maxItter, int count, int* itters, float* smooth,
+	const OrbitTrap* trap, float* trapDistances) const
+{
+	// kept per thread so rows do not allocate
+	thread_local std::vector<double> zx, zy, cx, cy;
+	zx.resize(count);
+	zy.resize(count);
+	cx.resize(count);
+	cy.resize(count);
+	for (int i = 0; i < count; i++) {
+		zx[i] = julia ? px[i] : 0.0;
+		zy[i] = julia ? py : 0.0;
+		cx[i] = julia ? juliaX : px[i];
+		cy[i] = julia ? juliaY : py;
+	}
+
+	escapeCountsOfPoints(&zx[0], &zy[0], &cx[0], &cy[0], maxItter, count, itters, smooth, trap, trapDistances);
+}
+
+void FormulaProgram::escapeCountsOfPoints(const double* zx, const double* zy, const double* cx, const double* cy, int maxItter, int count, int* itters, float* smooth,
+	const OrbitTrap* trap, float* trapDistances) const
+{
+	const int batch = 256;
+
+	// the registers of every program this thread has run, sized for the one with the most
+	thread_local std::vector<double> re, im;
+	re.resize(std::max(re.size(), (size_t)registerCount * batch));
+	im.resize(re.size());
+	double* zRe = &re[0];
+	double* zIm = &im[0];
+	double* cRe = &re[batch];
+	double* cIm = &im[batch];
+	int pixel[batch];
+
+	// the closest each orbit has come to the trap, packed along with z and c
+	bool tracking = trap && trapDistances && trap->shape != OrbitTrap::Shape::None;
+	double closest[batch];
+
+	auto finish = [&](int p, int k, int itter, double x, double y) {
+		itters[p] = itter;
+		if (tracking)
+			OrbitTraps::dispatch(*trap, [&](const auto& trapPolicy) { trapDistances[p] = (float)trapPolicy.distance(closest[k]); });
+		if (!smooth)
+			return;
+
+		if (itter >= maxItter) {
+			smooth[p] = (float)maxItter;
+			return;
+		}
+
+		double logZ = log(x * x + y * y) / 2.0;
+		double value = itter + 1 - log(logZ / log(2.0)) / log((double)degree);
+		smooth[p] = (float)std::min(std::max(value, 0.0), (double)maxItter);
+	};
+
+	for (int begin = 0; begin < count; begin += batch) {
+		int active = std::min(batch, count - begin);
+
+		for (int k = 0; k < active; k++) {
+			pixel[k] = begin + k;
+			zRe[k] = zx[begin + k];
+			zIm[k] = zy[begin + k];
+			cRe[k] = cx[begin + k];
+			cIm[k] = cy[begin + k];
+			closest[k] = std::numeric_limits<double>::infinity();
+		}
+
+		for (const Instruction& in : prologue) {
+			std::fill(&re[(size_t)in.dst * batch], &re[(size_t)in.dst * batch] + batch, constantsRe[in.n]);
+			std::fill(&im[(size_t)in.dst * batch], &im[(size_t)in.dst * batch] + batch, constantsIm[in.n]);
+		}
+
+		for (int itter = 0; itter < maxItter && active > 0; itter++) {
+			// finish the pixels that escaped and pack the rest to the front, only z and c live from one itteration to the next
+			int kept = 0;
+			for (int k = 0; k < active; k++) {
+				double x = zRe[k], y = zIm[k];
+				if (x * x + y * y > 2 * 2) {
+					finish(pixel[k], k, itter, x, y);
+					continue;
+				}
+
+				zRe[kept] = x;
+				zIm[kept] = y;
+				cRe[kept] = cRe[k];
+				cIm[kept] = cIm[k];
+				closest[kept] = closest[k];
+				pixel[kept] = pixel[k];
+				kept++;
+			}
+			active = kept;
+
+			run(&re[0], &im[0], batch, active);
+			if (result != 0) {
+				std::copy(&re[(size_t)result * batch], &re[(size_t)result * batch] + active, zRe);
+				std::copy(&im[(size_t)result * batch], &im[(size_t)result * batch] + active, zIm);
+			}
+
+			// the trap is measured after the step like the built in kernel does, so the escaping z counts too
+			if (tracking) {
+				OrbitTraps::dispatch(*trap, [&](const auto& trapPolicy) {
+					for (int k = 0; k < active; k++)
+						closest[k] = std::min(closest[k], trapPolicy.measure(zRe[k], zIm[k]));
+				});
+			}
+		}
+
+		for (int k = 0; k < active; k++)
+			finish(pixel[k], k, maxItter, zRe[k], zIm[k]);
+	}
+}
+
+void FormulaProgram::run(double* re, double* im, int stride, int count) const
+{
+	// every instruction is a simple loop over the lanes so the compiler can vectorize each one
+	for (const Instruction& in : body) {
+		double* dRe = re + (size_t)in.dst * stride;
+		double* dIm = im + (size_t)in.dst * stride;
+		const double* aRe = re + (size_t)in.a * stride;
+		const double* aIm = im + (size_t)in.a * stride;
+		const double* bRe = re + (size_t)in.b * stride;
+		const double* bIm = im + (size_t)in.b * stride;
+
+		switch (in.op) {
+		case Op::Const:
+			for (int k = 0; k < count; k++) { dRe[k] = constantsRe[in.n]; dIm[k] = constantsIm[in.n]; }
+			break;
+		case Op::Add:
+			for (int k = 0; k < count; k++) { dRe[k] = aRe[k] + bRe[k]; dIm[k] = aIm[k] + bIm[k]; }
+			break;
+		case Op::Sub:
+			for (int k = 0; k < count; k++) { dRe[k] = aRe[k] - bRe[k]; dIm[k] = aIm[k] - bIm[k]; }
+			break;
+		case Op::Mul:
+			for (int k = 0; k < count; k++) {
+				double x = aRe[k] * bRe[k] - aIm[k] * bIm[k];
+				double y = aRe[k] * bIm[k] + aIm[k] * bRe[k];
+				dRe[k] = x;
+				dIm[k] = y;
+			}
+			break;
+		case Op::Div:
+			for (int k = 0; k < count; k++) {
+				double d = bRe[k] * bRe[k] + bIm[k] * bIm[k];
+				double x = (aRe[k] * bRe[k] + aIm[k] * bIm[k]) / d;
+				double y = (aIm[k] * bRe[k] - aRe[k] * bIm[k]) / d;
+				dRe[k] = x;
+				dIm[k] = y;
+			}
+			break;
+		case Op::Neg:
+			for (int k = 0; k < count; k++) { dRe[k] = -aRe[k]; dIm[k] = -aIm[k]; }
+			break;
+		case Op::Sqr:
+			for (int k = 0; k < count; k++) {
+				double x = (aRe[k] * aRe[k]) - (aIm[k] * aIm[k]);
+				double y = 2 * aRe[k] * aIm[k];
+				dRe[k] = x;
+				dIm[k] = y;
+			}
+			break;
+		case Op::Pow:
+			// multiplied in the same order as Formulas::complexPower so z^n + c matches the built in Multibrot exactly
+			for (int k = 0; k < count; k++) {
+				double x = aRe[k], y = aIm[k];
+				double px = x, py = y;
+				for (int i = 1; i < in.n; i++) {
+					double t = px * x - py * y;
+					py = px * y + py * x;
+					px = t;
+				}
+				dRe[k] = px;
+				dIm[k] = py;
+			}
+			break;
+		case Op::Conj:
+			for (int k = 0; k < count; k++) { dRe[k] = aRe[k]; dIm[k] = -aIm[k]; }
+			break;
+		case Op::Fold:
+			for (int k = 0; k < count; k++) { dRe[k] = std::abs(aRe[k]); dIm[k] = std::abs(aIm[k]); }
+			break;
+		case Op::Re:
+			for (int k = 0; k < count; k++) { dRe[k] = aRe[k]; dIm[k] = 0.0; }
+			break;
+		case Op::Im:
+			for (int k = 0; k < count; k++) { dRe[k] = aIm[k]; dIm[k] = 0.0; }
+			break;
+		case Op::Abs:
+			for (int k = 0; k < count; k++) { dRe[k] = std::sqrt(aRe[k] * aRe[k] + aIm[k] * aIm[k]); dIm[k] = 0.0; }
+			break;
+		}
+	}
+}
+
+std::string FormulaProgram::generateGLSL() const
+{
+	auto name = [](int r) {
+		return r == 0 ? std::string("z") : r == 1 ? std::string("c") : "r" + std::to_string(r);
+	};
+
+	std::string glsl =
+		"dvec2 cmul(dvec2 a, dvec2 b) {\n"
+		"	return dvec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);\n"
+		"}\n"
+		"\n"
+		"dvec2 cdiv(dvec2 a, dvec2 b) {\n"
+		"	double d = b.x * b.x + b.y * b.y;\n"
+		"	return dvec2((a.x * b.x + a.y * b.y) / d, (a.y * b.x - a.x * b.y) / d);\n"
+		"}\n"
+		"\n"
+		"dvec2 customFormula(dvec2 z, dvec2 c) {\n";
+
+	for (const Instruction& in : prologue)
+		glsl += "	dvec2 " + name(in.dst) + " = dvec2(" + glslDouble(constantsRe[in.n]) + ", " + glslDouble(constantsIm[in.n]) + ");\n";
+
+	for (const Instruction& in : body) {
+		std::string d = "	dvec2 " + name(in.dst) + " = ";
+		std::string a = name(in.a), b = name(in.b);
+
+		switch (in.op) {
+		case Op::Const: glsl += d + "dvec2(" + glslDouble(constantsRe[in.n]) + ", " + glslDouble(constantsIm[in.n]) + ");\n"; break;
+		case Op::Add: glsl += d + a + " + " + b + ";\n"; break;
+		case Op::Sub: glsl += d + a + " - " + b + ";\n"; break;
+		case Op::Mul: glsl += d + "cmul(" + a + ", " + b + ");\n"; break;
+		case Op::Div: glsl += d + "cdiv(" + a + ", " + b + ");\n"; break;
+		case Op::Neg: glsl += d + "-" + a + ";\n"; break;
+		case Op::Sqr: glsl += d + "dvec2(" + a + ".x * " + a + ".x - " + a + ".y * " + a + ".y, 2.0lf * " + a + ".x * " + a + ".y);\n"; break;
+		case Op::Pow:
+			glsl += d + a + ";\n";
+			for (int i = 1; i < in.n; i++)
+				glsl += "	" + name(in.dst) + " = cmul(" + name(in.dst) + ", " + a + ");\n";
+			break;
+		case Op::Conj: glsl += d + "dvec2(" + a + ".x, -" + a + ".y);\n"; break;
+		case Op::Fold: glsl += d + "abs(" + a + ");\n"; break;
+		case Op::Re: glsl += d + "dvec2(" + a + ".x, 0.0lf);\n"; break;
+		case Op::Im: glsl += d + "dvec2(" + a + ".y, 0.0lf);\n"; break;
+		case Op::Abs: glsl += d + "dvec2(sqrt(dot(" + a + ", " + a + ")), 0.0lf);\n"; break;
+		}
+	}
+
+	glsl += "	return " + name(result) + ";\n}\n";
+	return glsl;
+}
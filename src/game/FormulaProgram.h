@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct OrbitTrap;
+
+// a custom itteration formula typed in at runtime, like "z^3 + c" or "sqr(fold(z)) + c"
+// the source is compiled once into register based bytecode, which the cpu runs over whole batches of pixels one instruction at a time
+// and which can also be turned into a glsl function for the shader path
+//
+// the language is complex arithmetic on z and c:
+//   numbers, imaginary numbers (2i, 0.5i, i), z, c, + - * /, unary -, integer powers (z^5) and brackets
+//   sqr(x), conj(x), fold(x) = |re x| + |im x|i, re(x), im(x), abs(x) = |x|
+class FormulaProgram {
+public:
+	enum class Op : uint8_t { Const, Add, Sub, Mul, Div, Neg, Sqr, Pow, Conj, Fold, Re, Im, Abs };
+
+	// registers hold complex numbers, register 0 is z and register 1 is c, 'n' is a constant index for Const or the exponent for Pow
+	struct Instruction {
+		Op op;
+		uint8_t dst, a, b;
+		int n;
+	};
+
+	// returns nullptr and describes the problem in 'error' if the source does not compile
+	static std::shared_ptr<const FormulaProgram> compile(const std::string& source, std::string& error);
+
+	// source code of a built in formula (MandelbrotView::Formula), so the shader path can run them too
+	static std::string builtinSource(int formula, int power);
+
+	const std::string& getSource() const;
+	const std::vector<Instruction>& getCode() const;
+	int getRegisterCount() const;
+
+	// highest power of z in the formula (at least 2), used for smooth coloring
+	int getDegree() const;
+
+	// a single step z -> f(z, c), for code that itterates a handful of points at a time
+	void step(double x, double y, double cx, double cy, double& nx, double& ny) const;
+
+	// escape counts of 'count' pixels of one row (x coordinates in 'px', all at height 'py'), same results as the built in kernels give
+	// pixels still going are packed to the front of the batch after every itteration so no time is spent on the ones that escaped
+	// with a trap, 'trapDistances' gets the same closest distances the built in kernels give
+	void escapeCounts(const double* px, double py, bool julia, double juliaX, double juliaY, int maxItter, int count, int* itters, float* smooth,
+		const OrbitTrap* trap = nullptr, float* trapDistances = nullptr) const;
+
+	// the same for 'count' unrelated points, each with its own starting z and c
+	void escapeCountsOfPoints(const double* zx, const double* zy, const double* cx, const double* cy, int maxItter, int count, int* itters, float* smooth,
+		const OrbitTrap* trap = nullptr, float* trapDistances = nullptr) const;
+
+	// "dvec2 customFormula(dvec2 z, dvec2 c)" plus the complex helpers it needs, for a shader using GL_ARB_gpu_shader_fp64
+	std::string generateGLSL() const;
+
+private:
+	FormulaProgram();
+
+	// one pass of the body over lanes [0, count) of the register file
+	void run(double* re, double* im, int stride, int count) const;
+
+	std::string source;
+	std::vector<Instruction> prologue; // constant loads, done once per batch
+	std::vector<Instruction> body;     // done every itteration
+	std::vector<double> constantsRe, constantsIm;
+	int registerCount = 2;
+	int result = 0;
+	int degree = 2;
+
+	friend class FormulaParser;
+};
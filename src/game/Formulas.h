@@ -0,0 +1,194 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+#include "game/OrbitTrap.h"
+#include "game/DoubleDouble.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// formula policies for the escape time kernel, each one is a single step z -> f(z, c)
+// the kernel is a template over the policy so every formula gets its own fully inlined loop with no branching on the formula inside it
+// and over the number type, double or DoubleDouble for views zoomed in past what a double can resolve
+namespace Formulas {
+
+	// z^N by repeated multiplication, unrolled at compile time
+	template<int N, typename T>
+	inline void complexPower(const T& x, const T& y, T& rx, T& ry) {
+		if constexpr (N == 1) {
+			rx = x;
+			ry = y;
+		}
+		else {
+			T px, py;
+			complexPower<N - 1>(x, y, px, py);
+			rx = px * x - py * y;
+			ry = px * y + py * x;
+		}
+	}
+
+	// z^2 + c, written exactly like the original loop so the results match MandelbrotCPU::mandelbrotAt bit for bit
+	struct Mandelbrot {
+		static constexpr int power = 2;
+
+		template<typename T>
+		static inline void step(const T& x, const T& y, const T& cx, const T& cy, T& nx, T& ny) {
+			nx = (x * x) - (y * y) + cx;
+			ny = 2 * x * y + cy;
+		}
+	};
+
+	// z^N + c
+	template<int N>
+	struct Multibrot {
+		static constexpr int power = N;
+
+		template<typename T>
+		static inline void step(const T& x, const T& y, const T& cx, const T& cy, T& nx, T& ny) {
+			complexPower<N>(x, y, nx, ny);
+			nx += cx;
+			ny += cy;
+		}
+	};
+
+	// (|re z| + i|im z|)^2 + c
+	struct BurningShip {
+		static constexpr int power = 2;
+
+		template<typename T>
+		static inline void step(const T& x, const T& y, const T& cx, const T& cy, T& nx, T& ny) {
+			using std::abs;
+			nx = (x * x) - (y * y) + cx;
+			ny = 2 * abs(x * y) + cy;
+		}
+	};
+
+	// conj(z)^2 + c
+	struct Tricorn {
+		static constexpr int power = 2;
+
+		template<typename T>
+		static inline void step(const T& x, const T& y, const T& cx, const T& cy, T& nx, T& ny) {
+			nx = (x * x) - (y * y) + cx;
+			ny = -2 * x * y + cy;
+		}
+	};
+
+	// escape counts of 'Lanes' points at once, each with its own starting z and its own c
+	// the inner loops over the lanes have no branches so the compiler turns them into simd
+	// a lane that has escaped is frozen (its z stops changing) and the loop ends once every lane has escaped or maxItter is reached
+	// if 'smooth' is given it gets the fractional escape count (n + 1 - log(log|z|) / log(power)) of every lane
+	// with a tracked trap policy (game/OrbitTrap.h) 'trapDistances' gets the closest any z of the orbit came to the trap, escaping z included
+	template<typename Formula, int Lanes, typename Trap = OrbitTraps::None, typename T = double>
+	inline void escapeCountsOfPoints(const T* zx, const T* zy, const T* cx, const T* cy, int maxItter, int* itters, float* smooth,
+		const Trap& trap = Trap(), float* trapDistances = nullptr) {
+		T x[Lanes], y[Lanes], c0[Lanes], c1[Lanes];
+		double closest[Lanes];
+		int itter[Lanes];
+
+		for (int l = 0; l < Lanes; l++) {
+			x[l] = zx[l];
+			y[l] = zy[l];
+			c0[l] = cx[l];
+			c1[l] = cy[l];
+			closest[l] = std::numeric_limits<double>::infinity();
+			itter[l] = 0;
+		}
+
+		for (int i = 0; i < maxItter; i++) {
+			int anyActive = 0;
+
+			for (int l = 0; l < Lanes; l++) {
+				int active = x[l] * x[l] + y[l] * y[l] <= 2 * 2;
+
+				T nx, ny;
+				Formula::step(x[l], y[l], c0[l], c1[l], nx, ny);
+				x[l] = active ? nx : x[l];
+				y[l] = active ? ny : y[l];
+				itter[l] += active;
+				anyActive |= active;
+
+				if constexpr (Trap::tracked) {
+					double measured = trap.measure(toDouble(nx), toDouble(ny));
+					closest[l] = active && measured < closest[l] ? measured : closest[l];
+				}
+			}
+
+			if (!anyActive)
+				break;
+		}
+
+		for (int l = 0; l < Lanes; l++) {
+			itters[l] = itter[l];
+
+			if constexpr (Trap::tracked)
+				trapDistances[l] = (float)trap.distance(closest[l]);
+
+			if (smooth) {
+				if (itter[l] >= maxItter) {
+					smooth[l] = (float)maxItter;
+				}
+				else {
+					double fx = toDouble(x[l]), fy = toDouble(y[l]);
+					double logZ = log(fx * fx + fy * fy) / 2.0;
+					double value = itter[l] + 1 - log(logZ / log(2.0)) / log((double)Formula::power);
+					smooth[l] = (float)std::fmin(std::fmax(value, 0.0), (double)maxItter);
+				}
+			}
+		}
+	}
+
+	// escape counts of 'Lanes' pixels of one row at height py
+	// in Julia mode z starts at the pixel and c is (cx, cy), otherwise z starts at 0 and c is the pixel
+	template<typename Formula, bool Julia, int Lanes, typename Trap = OrbitTraps::None, typename T = double>
+	inline void escapeCounts(const T* px, const T& py, double cx, double cy, int maxItter, int* itters, float* smooth,
+		const Trap& trap = Trap(), float* trapDistances = nullptr) {
+		T zx[Lanes], zy[Lanes], c0[Lanes], c1[Lanes];
+
+		for (int l = 0; l < Lanes; l++) {
+			zx[l] = Julia ? px[l] : T(0.0);
+			zy[l] = Julia ? py : T(0.0);
+			c0[l] = Julia ? T(cx) : px[l];
+			c1[l] = Julia ? T(cy) : py;
+		}
+
+		escapeCountsOfPoints<Formula, Lanes, Trap, T>(zx, zy, c0, c1, maxItter, itters, smooth, trap, trapDistances);
+	}
+
+	// calls fn(Formula(), std::integral_constant<bool, Julia>()) with the policy of the view's formula (not Custom), so a generic lambda
+	// can instantiate its own loop for it: the formula is switched on once here and never inside the loop
+	template<bool Julia, typename Fn>
+	void dispatchFormula(const MandelbrotView& view, Fn&& fn) {
+		std::integral_constant<bool, Julia> julia;
+
+		switch (view.formula) {
+		case MandelbrotView::Formula::Mandelbrot: fn(Mandelbrot(), julia); break;
+		case MandelbrotView::Formula::BurningShip: fn(BurningShip(), julia); break;
+		case MandelbrotView::Formula::Tricorn: fn(Tricorn(), julia); break;
+		case MandelbrotView::Formula::Multibrot:
+			switch (std::min(std::max(view.power, 3), 8)) {
+			case 3: fn(Multibrot<3>(), julia); break;
+			case 4: fn(Multibrot<4>(), julia); break;
+			case 5: fn(Multibrot<5>(), julia); break;
+			case 6: fn(Multibrot<6>(), julia); break;
+			case 7: fn(Multibrot<7>(), julia); break;
+			case 8: fn(Multibrot<8>(), julia); break;
+			}
+			break;
+		case MandelbrotView::Formula::Custom:
+			// runs through FormulaProgram instead, there is no policy for it
+			break;
+		}
+	}
+
+	template<typename Fn>
+	void dispatch(const MandelbrotView& view, Fn&& fn) {
+		if (view.julia)
+			dispatchFormula<true>(view, fn);
+		else
+			dispatchFormula<false>(view, fn);
+	}
+
+}
@@ -0,0 +1,472 @@
+#include "game/FrameStream.h"
+#include "game/EscapeDataCodec.h"
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+	const uint32_t maxMessageSize = 1u << 30;
+
+	class MessageWriter {
+	public:
+		MessageWriter(std::vector<uint8_t>& out) : out(out) {}
+
+		void u8(uint8_t value) { out.push_back(value); }
+		void u16(uint16_t value) { little(value, 2); }
+		void u32(uint32_t value) { little(value, 4); }
+		void u64(uint64_t value) { little(value, 8); }
+		void i32(int value) { little((uint32_t)value, 4); }
+		void f32(float value) { uint32_t bits; memcpy(&bits, &value, 4); little(bits, 4); }
+		void f64(double value) { uint64_t bits; memcpy(&bits, &value, 8); little(bits, 8); }
+		void bytes(const std::vector<uint8_t>& data) { out.insert(out.end(), data.begin(), data.end()); }
+
+		// overwrites 4 bytes written earlier, for sizes and counts only known at the end
+		void patchU32(size_t position, uint32_t value) {
+			for (int i = 0; i < 4; i++)
+				out[position + i] = (uint8_t)(value >> (8 * i));
+		}
+
+	private:
+		void little(uint64_t value, int size) {
+			for (int i = 0; i < size; i++)
+				out.push_back((uint8_t)(value >> (8 * i)));
+		}
+
+		std::vector<uint8_t>& out;
+	};
+
+	// reads past the end return zeros and set 'failed' instead of reading out of bounds
+	class MessageReader {
+	public:
+		MessageReader(const std::vector<uint8_t>& in) : in(in) {}
+
+		uint8_t u8() { return (uint8_t)little(1); }
+		uint16_t u16() { return (uint16_t)little(2); }
+		uint32_t u32() { return (uint32_t)little(4); }
+		uint64_t u64() { return little(8); }
+		int i32() { return (int)(uint32_t)little(4); }
+		float f32() { uint32_t bits = (uint32_t)little(4); float value; memcpy(&value, &bits, 4); return value; }
+		double f64() { uint64_t bits = little(8); double value; memcpy(&value, &bits, 8); return value; }
+
+		const uint8_t* bytes(size_t size) {
+			if (in.size() - position < size) {
+				failed = true;
+				return nullptr;
+			}
+			position += size;
+			return &in[position - size];
+		}
+
+		bool failed = false;
+
+	private:
+		uint64_t little(int size) {
+			const uint8_t* data = bytes(size);
+			uint64_t value = 0;
+			for (int i = 0; data && i < size; i++)
+				value |= (uint64_t)data[i] << (8 * i);
+			return value;
+		}
+
+		const std::vector<uint8_t>& in;
+		size_t position = 0;
+	};
+
+}
+
+uint64_t FrameStream::now()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameStream::Sender::Sender(uint16_t port, int threadCount) :
+	threadCount(threadCount > 0 ? threadCount : Parallel::defaultThreadCount()),
+	listener(Socket::listenLoopback(port)),
+	cache((size_t)256 << 20)
+{
+	if (!listener.isValid())
+		return;
+
+	acceptThread = std::thread(&Sender::acceptViewers, this);
+	renderThread = std::thread(&Sender::renderFrames, this);
+}
+
+FrameStream::Sender::~Sender()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	listener.shutdown();
+
+	if (acceptThread.joinable())
+		acceptThread.join();
+	if (renderThread.joinable())
+		renderThread.join();
+}
+
+bool FrameStream::Sender::isListening()
+{
+	return listener.isValid();
+}
+
+void FrameStream::Sender::show(const MandelbrotView& view, int width, int height)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingView = view;
+		pendingWidth = width;
+		pendingHeight = height;
+		pendingRequested = now();
+		pending = true;
+	}
+	wake.notify_one();
+}
+
+void FrameStream::Sender::flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [&]() { return stopping || !renderThread.joinable() || (!pending && !busy); });
+}
+
+FrameStream::Sender::Stats FrameStream::Sender::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void FrameStream::Sender::acceptViewers()
+{
+	while (true) {
+		Socket socket = listener.accept();
+		if (!socket.isValid()) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (stopping)
+				return;
+			continue;
+		}
+
+		socket.setNoDelay();
+		{
+			std::lock_guard<std::mutex> lock(viewerMutex);
+			Viewer viewer;
+			viewer.socket = std::move(socket);
+			viewers.push_back(std::move(viewer));
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			newViewers = true;
+		}
+		wake.notify_one();
+	}
+}
+
+void FrameStream::Sender::renderFrames()
+{
+	while (true) {
+		MandelbrotView view;
+		int width = 0, height = 0;
+		uint64_t requested = 0;
+		bool render = false;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]() { return stopping || pending || (newViewers && hasFrame); });
+			if (stopping)
+				return;
+
+			render = pending;
+			view = pendingView;
+			width = pendingWidth;
+			height = pendingHeight;
+			requested = pending ? pendingRequested : now();
+			pending = false;
+			newViewers = false;
+			busy = true;
+		}
+
+		// the stream is made of cached tiles, views too deep for the cache are not sent
+		if (render && !TileCache::canPlace(view, width, height)) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				busy = false;
+			}
+			idle.notify_all();
+			continue;
+		}
+
+		std::vector<uint8_t> changes;
+		uint64_t itterated = 0;
+		if (render) {
+			TileCache::Placement previous = placement;
+			placement = TileCache::place(view, width, height, false, OrbitTrap());
+
+			uint64_t computedBefore = cache.getStats().samplesComputed;
+			{
+				TileCache::Rows rows = cache.prepare(placement, 0, height, threadCount);
+				itters.resize((size_t)width * height);
+				for (int y = 0; y < height; y++)
+					rows.copyRow(y, &itters[(size_t)y * width], nullptr, nullptr);
+			}
+			itterated = cache.getStats().samplesComputed - computedBefore;
+
+			// the last frame is only any use if it is on the same lattice at the same level, then the views are a whole number of pixels apart
+			bool scrolls = hasFrame && previous.lattice == placement.lattice && previous.level == placement.level &&
+				previous.width == width && previous.height == height;
+			int scrollX = scrolls ? (int)std::max<int64_t>(-width, std::min<int64_t>(width, placement.originX - previous.originX)) : 0;
+			int scrollY = scrolls ? (int)std::max<int64_t>(-height, std::min<int64_t>(height, placement.originY - previous.originY)) : 0;
+
+			frameNumber++;
+			changes = encode(scrolls ? &lastItters : nullptr, scrollX, scrollY, requested);
+			hasFrame = true;
+		}
+
+		// viewers that connected since the last frame get all of this one, encoded only if someone needs it
+		std::vector<uint8_t> whole;
+		uint64_t bytes = 0;
+		int viewerCount;
+		{
+			std::lock_guard<std::mutex> lock(viewerMutex);
+			for (size_t i = 0; i < viewers.size();) {
+				Viewer& viewer = viewers[i];
+				const std::vector<uint8_t>* message = &changes;
+				if (viewer.needsWholeFrame) {
+					if (whole.empty())
+						whole = encode(nullptr, 0, 0, requested);
+					message = &whole;
+				}
+
+				if (message->empty()) {
+					i++;
+					continue;
+				}
+
+				if (viewer.socket.sendAll(message->data(), message->size())) {
+					viewer.needsWholeFrame = false;
+					bytes += message->size();
+					i++;
+				}
+				else {
+					viewers.erase(viewers.begin() + i);
+				}
+			}
+			viewerCount = (int)viewers.size();
+		}
+
+		if (render)
+			lastItters = itters;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.frames += render ? 1 : 0;
+			stats.bytes += bytes;
+			stats.samplesItterated += itterated;
+			stats.viewers = viewerCount;
+			busy = false;
+		}
+		idle.notify_all();
+	}
+}
+
+std::vector<uint8_t> FrameStream::Sender::encode(const std::vector<int>* previous, int scrollX, int scrollY, uint64_t requested)
+{
+	int width = placement.width, height = placement.height;
+
+	std::vector<uint8_t> message;
+	MessageWriter out(message);
+	out.u32(0); // size, filled in at the end
+	out.u8('M');
+	out.u8('B');
+	out.u8('F');
+	out.u8('S');
+	out.u32(frameNumber);
+	out.u64(requested);
+	out.i32(width);
+	out.i32(height);
+	out.i32(placement.view.maxItter);
+	out.f32(placement.view.colorShiftFactor);
+	out.f64(placement.view.camX);
+	out.f64(placement.view.camY);
+	out.f64(placement.view.camZoom);
+	out.i32(scrollX);
+	out.i32(scrollY);
+	out.u8(previous ? 0 : 1);
+	size_t tileCountPosition = message.size();
+	out.u32(0);
+
+	uint32_t tileCount = 0;
+	uint64_t unchanged = 0;
+	std::vector<int> values, xored;
+	std::vector<uint8_t> packedValues, packedXor;
+
+	for (int tileY = 0; tileY * tileSize < height; tileY++) {
+		for (int tileX = 0; tileX * tileSize < width; tileX++) {
+			int x0 = tileX * tileSize, y0 = tileY * tileSize;
+			int x1 = std::min(width, x0 + tileSize), y1 = std::min(height, y0 + tileSize);
+
+			values.clear();
+			xored.clear();
+			bool changed = false;
+			for (int y = y0; y < y1; y++) {
+				for (int x = x0; x < x1; x++) {
+					int value = itters[(size_t)y * width + x];
+
+					// what the viewer has here after scrolling, the pixels that scrolled into view start at 0
+					int sx = x + scrollX, sy = y + scrollY;
+					int before = previous && sx >= 0 && sx < width && sy >= 0 && sy < height ? (*previous)[(size_t)sy * width + sx] : 0;
+
+					values.push_back(value);
+					xored.push_back(value ^ before);
+					changed = changed || value != before;
+				}
+			}
+
+			if (!changed) {
+				unchanged++;
+				continue;
+			}
+
+			packedValues.clear();
+			packedXor.clear();
+			EscapeDataCodec::compress(&values[0], values.size(), packedValues);
+			EscapeDataCodec::compress(&xored[0], xored.size(), packedXor);
+			bool useXor = packedXor.size() < packedValues.size();
+
+			out.u16((uint16_t)tileX);
+			out.u16((uint16_t)tileY);
+			out.u8(useXor ? 0 : 1);
+			out.u32((uint32_t)(useXor ? packedXor : packedValues).size());
+			out.bytes(useXor ? packedXor : packedValues);
+			tileCount++;
+		}
+	}
+
+	out.patchU32(tileCountPosition, tileCount);
+	out.patchU32(0, (uint32_t)(message.size() - 4));
+
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.tilesSent += tileCount;
+	stats.tilesUnchanged += unchanged;
+	return message;
+}
+
+bool FrameStream::Receiver::connect(uint16_t port)
+{
+	socket = Socket::connectLoopback(port);
+	width = height = 0;
+	return socket.isValid();
+}
+
+void FrameStream::Receiver::interrupt()
+{
+	socket.shutdown();
+}
+
+void FrameStream::Receiver::close()
+{
+	socket.close();
+}
+
+bool FrameStream::Receiver::receiveExactly(void* data, size_t size)
+{
+	uint8_t* bytes = (uint8_t*)data;
+	while (size > 0) {
+		int received = socket.receive(bytes, size);
+		if (received <= 0)
+			return false;
+		bytes += received;
+		size -= received;
+	}
+	return true;
+}
+
+bool FrameStream::Receiver::receive(Frame& frame)
+{
+	uint8_t sizeBytes[4];
+	if (!receiveExactly(sizeBytes, 4))
+		return false;
+	uint32_t size = sizeBytes[0] | sizeBytes[1] << 8 | sizeBytes[2] << 16 | (uint32_t)sizeBytes[3] << 24;
+	if (size > maxMessageSize)
+		return false;
+
+	std::vector<uint8_t> message(size);
+	if (size > 0 && !receiveExactly(&message[0], size))
+		return false;
+
+	MessageReader in(message);
+	const uint8_t* magic = in.bytes(4);
+	if (!magic || memcmp(magic, "MBFS", 4) != 0)
+		return false;
+
+	frame.number = in.u32();
+	uint64_t requested = in.u64();
+	int frameWidth = in.i32(), frameHeight = in.i32();
+	frame.maxItter = in.i32();
+	frame.colorShiftFactor = in.f32();
+	frame.camX = in.f64();
+	frame.camY = in.f64();
+	frame.camZoom = in.f64();
+	int scrollX = in.i32(), scrollY = in.i32();
+	frame.wholeFrame = in.u8() != 0;
+	uint32_t tileCount = in.u32();
+
+	if (in.failed || frameWidth <= 0 || frameHeight <= 0 || (uint64_t)frameWidth * frameHeight > (1u << 28))
+		return false;
+	if (!frame.wholeFrame && (frameWidth != width || frameHeight != height))
+		return false;
+
+	// the last image scrolled into place, or nothing for a whole frame
+	scrolled.assign((size_t)frameWidth * frameHeight, 0);
+	if (!frame.wholeFrame) {
+		for (int y = 0; y < height; y++) {
+			int sy = y + scrollY;
+			if (sy < 0 || sy >= height)
+				continue;
+
+			int xBegin = std::max(0, -scrollX), xEnd = std::min(width, width - scrollX);
+			if (xBegin < xEnd)
+				std::copy(&current[(size_t)sy * width + xBegin + scrollX], &current[(size_t)sy * width + xEnd + scrollX], &scrolled[(size_t)y * width + xBegin]);
+		}
+	}
+	width = frameWidth;
+	height = frameHeight;
+
+	std::vector<int> values;
+	for (uint32_t t = 0; t < tileCount; t++) {
+		int tileX = in.u16(), tileY = in.u16();
+		bool useXor = in.u8() == 0;
+		uint32_t packedSize = in.u32();
+		const uint8_t* packed = in.bytes(packedSize);
+		if (in.failed)
+			return false;
+
+		int x0 = tileX * tileSize, y0 = tileY * tileSize;
+		int x1 = std::min(width, x0 + tileSize), y1 = std::min(height, y0 + tileSize);
+		if (x0 >= width || y0 >= height)
+			return false;
+
+		values.resize((size_t)(x1 - x0) * (y1 - y0));
+		if (!EscapeDataCodec::decompress(packed, packedSize, &values[0], values.size()))
+			return false;
+
+		size_t i = 0;
+		for (int y = y0; y < y1; y++) {
+			int* row = &scrolled[(size_t)y * width];
+			for (int x = x0; x < x1; x++, i++)
+				row[x] = useXor ? row[x] ^ values[i] : values[i];
+		}
+	}
+
+	current.swap(scrolled);
+
+	frame.width = width;
+	frame.height = height;
+	frame.itters = current;
+	frame.tiles = (int)tileCount;
+	frame.bytes = (size_t)size + 4;
+	frame.latencyMilliseconds = (now() - requested) / 1000.0;
+	return true;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+#include "game/TileCache.h"
+#include "engine/Socket.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// streams the escape data of an interactive session to viewer processes over a loopback socket
+//
+// every frame is rendered on the sender's own thread through a TileCache, so views are placed on its lattice and a pan at the same zoom is an exact
+// whole pixel scroll of the frame before. a frame message says how far to scroll the last image and then carries only the 64x64 tiles that still
+// differ, each as the xor with the scrolled image (which is mostly zeros and compresses to almost nothing) or as plain counts, whichever is smaller,
+// both packed with EscapeDataCodec. a pan costs about the strip it uncovers, in bandwidth and in itterations. changing the zoom, maxItter or formula
+// sends the whole frame, and a viewer that connects part way through gets a whole frame first
+//
+// message: u32 size, then 'MBFS', u32 frame number, u64 microseconds on the steady clock when the frame was asked for, i32 width, height, maxItter,
+// f32 color shift, f64 camX, camY, camZoom, i32 scrollX, scrollY, u8 whole frame, u32 tile count, and for each tile u16 x, u16 y (in tiles),
+// u8 encoding (0 xor, 1 counts), u32 size and the packed data. all little endian, rows from the bottom up like the textures
+namespace FrameStream {
+
+	const uint16_t defaultPort = 8338;
+	const int tileSize = 64;
+
+	struct Frame {
+		uint32_t number = 0;
+		int width = 0, height = 0;
+		int maxItter = 0;
+		float colorShiftFactor = 0.0f;
+		double camX = 0.0, camY = 0.0, camZoom = 1.0; // the view after it was placed on the lattice
+		std::vector<int> itters; // bottom row first
+
+		// about the message it came in
+		bool wholeFrame = false;
+		int tiles = 0;
+		size_t bytes = 0;
+		double latencyMilliseconds = 0.0; // from show() on the sender to here, only meaningful between processes on the same machine
+	};
+
+	class Sender {
+	public:
+		struct Stats {
+			uint64_t frames = 0;
+			uint64_t bytes = 0;        // every message sent to every viewer
+			uint64_t tilesSent = 0;
+			uint64_t tilesUnchanged = 0;
+			uint64_t samplesItterated = 0;
+			int viewers = 0;
+		};
+
+		// listens on 127.0.0.1:'port' straight away, check isListening()
+		Sender(uint16_t port = defaultPort, int threadCount = 0);
+		~Sender();
+
+		Sender(const Sender&) = delete;
+
+		bool isListening();
+
+		// renders the view and sends what changed to every viewer, a view that has not started rendering yet is replaced by a newer one
+		void show(const MandelbrotView& view, int width, int height);
+
+		// waits until every view passed to show() so far has been sent
+		void flush();
+
+		Stats getStats();
+
+	private:
+		void acceptViewers();
+		void renderFrames();
+
+		// the frame message for viewers that have 'previous' (scrolled by scrollX, scrollY), or a whole frame if it is null
+		std::vector<uint8_t> encode(const std::vector<int>* previous, int scrollX, int scrollY, uint64_t requested);
+
+		struct Viewer {
+			Socket socket;
+			bool needsWholeFrame = true;
+		};
+
+		int threadCount;
+		Socket listener;
+		std::thread acceptThread, renderThread;
+
+		std::mutex mutex;
+		std::condition_variable wake, idle;
+		bool stopping = false;
+		bool pending = false, busy = false;
+		bool newViewers = false;
+		MandelbrotView pendingView;
+		int pendingWidth = 0, pendingHeight = 0;
+		uint64_t pendingRequested = 0;
+		Stats stats;
+
+		std::mutex viewerMutex; // held while sending, so never while 'mutex' is
+		std::vector<Viewer> viewers;
+
+		// only used by the render thread
+		TileCache cache;
+		TileCache::Placement placement;
+		bool hasFrame = false;
+		std::vector<int> itters, lastItters;
+		uint32_t frameNumber = 0;
+	};
+
+	class Receiver {
+	public:
+		// false if nothing is listening on the port
+		bool connect(uint16_t port = defaultPort);
+
+		// blocks until the next frame has arrived and been applied to the last one, false once the connection has closed or sent something invalid
+		bool receive(Frame& frame);
+
+		// makes a receive() blocked on another thread return false, close() must still be called afterwards
+		void interrupt();
+
+		void close();
+
+	private:
+		bool receiveExactly(void* data, size_t size);
+
+		Socket socket;
+		std::vector<int> current, scrolled;
+		int width = 0, height = 0;
+	};
+
+	// microseconds on the steady clock, which is the same clock in every process on a machine
+	uint64_t now();
+
+}
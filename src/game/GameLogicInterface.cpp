@@ -1,6 +1,28 @@
 ﻿
 #include "game/GameLogicInterface.h"
-
+#include "game/MandelbrotCPU.h"
+#include "game/PrefetchRenderer.h"
+#include "game/NavigationHistory.h"
+#include "game/GigapixelExporter.h"
+#include "game/Benchmark.h"
+#include "game/Palette.h"
+#include "game/ItterationEstimator.h"
+#include "game/FormulaProgram.h"
+#include "game/JuliaAtlas.h"
+#include "game/Buddhabrot.h"
+#include "game/OrbitTrap.h"
+#include "game/ImageExport.h"
+#include "game/FrameStream.h"
+#include "game/StreamViewer.h"
+#include "game/RenderScheduler.h"
+#include "game/BackgroundExport.h"
+#include "game/ViewState.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include <string>
 
 // -------------------------------- The Mandelbrot Algorithm Psudocode ---------------------------------------------
@@ -27,46 +49,381 @@ namespace {
 
     bool renderWithGPU = true;
 
-    Texture tex(1080, 720);
+    Texture tex(1080, 720, Texture::Format::RGBA8);
 
     double camZoom = 1.0f;
     double camX = -0.5f;
     double camY = 0.0f;
+    double camXLow = 0.0, camYLow = 0.0; // the rest of the center past a double, so deep views can be moved around precisely
 
     int maxItter = 300;
+    bool autoItter = false; // maxItter is picked from a quick sample of every new view
+    MandelbrotView estimatedView; // the view maxItter was last picked for
+    bool estimateValid = false;
+
+    MandelbrotView::Formula formula = MandelbrotView::Formula::Mandelbrot;
+    int power = 3;
+    bool julia = false;
+    double juliaX = -0.8, juliaY = 0.156;
+
+    // Tab starts typing a custom formula, Enter compiles it and Escape gives up
+    std::shared_ptr<const FormulaProgram> customProgram;
+    bool editingFormula = false;
+    std::string formulaInput;
+    std::string formulaError;
     float colorShiftFactor = 2.0f;
 
     bool rerender = true;
+
+    Palette palette;
+    bool smoothColoring = false; // only used by the cpu export, the display always shows whole itteration counts
+    bool histogramColoring = false; // only used on the cpu, the gpu shader colors every pixel on its own
     bool saveFlag = false;
+    bool saveLarge = false; // Ctrl+Shift+S saves at 16k instead of 4k
+    bool antiAliasedExport = true; // X, the 4k export supersamples the pixels on edges (always on the cpu)
+    bool benchmarkFlag = false;
+    bool atlasFlag = false;
+
+    // T cycles through the orbit traps, a trap colors the view on the cpu from how close each orbit came to it instead of its escape count
+    // the distances are kept with the escape data so the trap colors ([ and ], K and L) are changed without itterating again
+    OrbitTrap trap;
+    float trapScale = 0.1f;
+    std::vector<float> currentTraps;
+    bool currentTrapsValid = false;
+
+    // U swaps the escape time image for a nebulabrot of the same view, built up on the cpu while it is on screen
+    Buddhabrot buddhabrot;
+    bool buddhabrotMode = false;
+    int buddhabrotVersion = -1;
+
+    // every cpu render goes through it, the frame on screen first, then prefetching, then the exports on half of its threads
+    RenderScheduler* scheduler = nullptr;
+
+    PrefetchRenderer* prefetcher = nullptr;
+    bool prefetchIssued = false;
+    float prefetchMouseX = 0.0f, prefetchMouseY = 0.0f;
+
+    NavigationHistory history;
+    bool wasNavigating = false;
+
+    // escape data of the view on screen, only valid when it was rendered on the cpu or came from the prefetcher
+    std::vector<int> currentItters;
+    bool currentIttersValid = false;
+
+    // V streams the escape data of every frame to viewer processes (--view), which are sent only the tiles that changed
+    std::unique_ptr<FrameStream::Sender> streamSender;
+
+    // set when this process was started with --view, it then only shows the frames another session streams to it
+    StreamViewer* streamViewer = nullptr;
+
+    // Ctrl+S exports are written while exploring carries on
+    BackgroundExport backgroundExport;
+
+    // 16 times the size of the 4k export in each direction, about 8GB of rgba
+    GigapixelExporter posterExporter;
+    const std::string posterFilepath = "mandelbrot-poster(61440x34560).pam";
+
+    MandelbrotView currentView() {
+        MandelbrotView view;
+        view.camX = camX;
+        view.camY = camY;
+        view.camXLow = camXLow;
+        view.camYLow = camYLow;
+        view.camZoom = camZoom;
+        view.maxItter = maxItter;
+        view.colorShiftFactor = colorShiftFactor;
+        view.formula = formula;
+        view.power = power;
+        view.julia = julia;
+        view.juliaX = juliaX;
+        view.juliaY = juliaY;
+        view.program = customProgram;
+        return view;
+    }
+
+    // moves the center by (dx, dy) with MandelbrotView::pan, which likelyNextViews() uses too
+    void moveCamera(double dx, double dy) {
+        MandelbrotView view = currentView();
+        view.pan(dx, dy);
+        camX = view.camX;
+        camY = view.camY;
+        camXLow = view.camXLow;
+        camYLow = view.camYLow;
+    }
+
+    // the gpu only has doubles, views zoomed in past them are rendered on the cpu with the precision tier they need
+    bool usingGPU(int width, int height) {
+        return renderWithGPU && MandelbrotCPU::precisionFor(currentView(), width, height) == MandelbrotCPU::Precision::Double;
+    }
+
+    // held keys do nothing while a formula is being typed
+    bool keyHeld(int key) {
+        return !editingFormula && window.keyIsDown(key);
+    }
+
+    // the views that the next key press would produce, these must use the exact same arithmetic as update() and keyCallback()
+    std::vector<MandelbrotView> likelyNextViews(float deltaTime) {
+        MandelbrotView view = currentView();
+        std::vector<MandelbrotView> views;
+
+        // the gpu does not give us the escape data of the view on screen, render it so that the history can keep a copy
+        // the neighbours are left out, showPrefetched() never displays them while the shader draws every frame
+        if (usingGPU(tex.getWidth(), tex.getHeight())) {
+            views.push_back(view);
+            return views;
+        }
+
+        MandelbrotView zoomIn = view;
+        zoomIn.pan(window.getMouseX() * camZoom, window.getMouseY() * camZoom);
+        zoomIn.camZoom *= 0.4;
+        views.push_back(zoomIn);
+
+        MandelbrotView zoomOut = view;
+        zoomOut.pan(-window.getMouseX() * camZoom, -window.getMouseY() * camZoom);
+        zoomOut.camZoom *= 1.6;
+        views.push_back(zoomOut);
+
+        double panStep = camZoom * 0.05 * ((double)deltaTime / 16.0);
+        MandelbrotView up = view, left = view, down = view, right = view;
+        up.pan(0.0, panStep);
+        left.pan(-panStep, 0.0);
+        down.pan(0.0, -panStep);
+        right.pan(panStep, 0.0);
+        views.push_back(up);
+        views.push_back(left);
+        views.push_back(down);
+        views.push_back(right);
+
+        return views;
+    }
+
+    // uploads raw itteration counts as a 16 or 32 bit integer texture and colors them on the gpu into 'texture'
+    // this sends 2 bytes per pixel instead of 16 and a color shift change only needs this pass, not a new upload from the cpu
+    void displayItterations(Texture& texture, const std::vector<int>& itters) {
+
+        static std::string vertexShaderString =
+            "#version 330 core\n"
+            "\n"
+            "layout(location = 0) in vec2 position;\n"
+            "layout(location = 1) in vec2 uvCoord;\n"
+            "\n"
+            "uniform vec2 u_stretch;\n"
+            "uniform vec2 u_translation;\n"
+            "uniform float u_aspectRatio;\n"
+            "\n"
+            "uniform vec2 u_texture_stretch;\n"
+            "uniform vec2 u_texture_translation;\n"
+            "\n"
+            "out vec2 v_texCoord;\n"
+            "\n"
+            "void main()\n"
+            "{\n"
+            "	gl_Position = vec4((position[0] / u_aspectRatio) * u_stretch[0] + (u_translation[0] / u_aspectRatio), position[1] * u_stretch[1] + u_translation[1], 0, 1);\n"
+            "	v_texCoord = vec2(uvCoord[0] * u_texture_stretch[0] + u_texture_translation[0], uvCoord[1] * u_texture_stretch[1] + u_texture_translation[1]);\n"
+            "};\n";
+
+        static std::string fragmentShaderString =
+            "#version 330 core\n"
+            "\n"
+            "layout(location = 0) out vec4 color;\n"
+            "\n"
+            "in vec2 v_texCoord;\n"
+            "\n"
+            "uniform int u_maxItter;\n"
+            "\n"
+            "uniform usampler2D u_texture;\n"
+            "uniform sampler2D u_palette;\n"
+            "\n"
+            "void main()\n"
+            "{\n"
+            "   int itter = min(int(texture(u_texture, v_texCoord).r), u_maxItter);\n"
+            ""
+            "   // the palette is laid out in rows of 1024 entries so it fits within the max texture size\n"
+            "	color = texelFetch(u_palette, ivec2(itter % 1024, itter / 1024), 0);\n"
+            "};\n";
+
+        static Shader sh = Shader(vertexShaderString, fragmentShaderString);
+        static Texture itterTex;
+        static Texture paletteTex;
+        static int paletteTexVersion = -1;
+
+        // the palette texture is the same table the cpu exports use, so the screen and exported images match exactly
+        if (histogramColoring)
+            palette.updateHistogram(&itters[0], itters.size(), maxItter, colorShiftFactor);
+        else
+            palette.update(maxItter, colorShiftFactor);
+        if (paletteTexVersion != palette.getVersion()) {
+            static std::vector<uint32_t> paletteRows;
+            paletteRows = palette.getTable();
+            paletteRows.resize((paletteRows.size() + 1023) / 1024 * 1024, 0);
+            paletteTex.generateFromData(1024, (int)paletteRows.size() / 1024, (const uint8_t*)&paletteRows[0]);
+            paletteTexVersion = palette.getVersion();
+        }
+
+        sh.setUniform1i("u_maxItter", palette.getMaxItter());
+        sh.setUniform1i("u_palette", 1);
+
+        if (maxItter <= 0xFFFF) {
+            static std::vector<uint16_t> values;
+            values.assign(itters.begin(), itters.end());
+            itterTex.generateFromData(texture.getWidth(), texture.getHeight(), &values[0]);
+        }
+        else {
+            static std::vector<uint32_t> values;
+            values.assign(itters.begin(), itters.end());
+            itterTex.generateFromData(texture.getWidth(), texture.getHeight(), &values[0]);
+        }
+
+        static TexturedQuad colorQuad;
+        colorQuad.setShader(sh);
+        colorQuad.setTexture(itterTex);
 
-    std::array<float, 3> colorRotator(float colorShift) {
+        paletteTex.bind(1);
 
-        colorShift *= colorShiftFactor;
-        
-        float r = 1.0f - (cos(colorShift * 3.14159f * 1.0f) + 1.0f) / 2.0f;
-        float g = 1.0f - (cos(colorShift * 3.14159f * 3.0f) + 1.0f) / 2.0f;
-        float b = 1.0f - (cos(colorShift * 3.14159f * 5.0f) + 1.0f) / 2.0f;
-        
-        return { r, g, b };
+        texture.bindAsRenderTarget();
+        colorQuad.setX(ViewportManager::getLeftViewportBound());
+        colorQuad.setY(ViewportManager::getBottomViewportBound());
+        colorQuad.setWidth(ViewportManager::getRightViewportBound() - ViewportManager::getLeftViewportBound());
+        colorQuad.setHeight(ViewportManager::getTopViewportBound() - ViewportManager::getBottomViewportBound());
+        colorQuad.render();
+        texture.unbindAsRenderTarget();
+
+        paletteTex.bind(1);
+        paletteTex.unbind();
+        glActiveTexture(GL_TEXTURE0);
+    }
 
+    // displays a view that was already rendered by the prefetcher, returns false if it was not ready
+    // in gpu mode the frame is always drawn by the shader so the look does not change between hits and misses
+    bool showPrefetched(Texture& texture) {
+        if (!prefetcher || texture.getWidth() != prefetcher->getWidth() || texture.getHeight() != prefetcher->getHeight())
+            return false;
+        if (usingGPU(texture.getWidth(), texture.getHeight()))
+            return false;
+
+        if (!prefetcher->take(currentView(), currentItters))
+            return false;
+
+        displayItterations(texture, currentItters);
+        currentIttersValid = true;
+        return true;
     }
 
-    int mandelbrotAt(double x, double y, int maxItter) {
-        double x0 = x;
-        double y0 = y;
+    // the escape data of the view on screen if it is known, nullptr otherwise
+    const std::vector<int>* knownItters() {
+        if (currentIttersValid)
+            return &currentItters;
+
+        static std::vector<int> prefetched;
+        if (prefetcher->peek(currentView(), prefetched))
+            return &prefetched;
+
+        return nullptr;
+    }
 
-        double x1 = 0, y1 = 0;
-        int itter = 0;
+    // call before any key press moves the camera or changes the itteration count
+    void recordHistory() {
+        history.leave(currentView(), knownItters(), tex.getWidth(), tex.getHeight());
+    }
 
-        while (x1 * x1 + y1 * y1 <= 2*2 && itter < maxItter) {
-            double xTemp = (x1 * x1) - (y1 * y1) + x0;
-            y1 = 2 * x1 * y1 + y0;
-            x1 = xTemp;
-            itter++;
+    // estimates maxItter for the view, returns true if it changed
+    // a view is only estimated once, renders that keep the camera and formula where they were (a color shift) do not estimate again
+    // the change is a history step of its own, so going back returns to the same view with the itterations it had
+    bool pickAutoItter() {
+        if (estimateValid && currentView().sameItterations(estimatedView))
+            return false;
+
+        int suggested = ItterationEstimator::estimate(currentView(), tex.getWidth(), tex.getHeight()).maxItter;
+        bool changed = ItterationEstimator::worthChanging(maxItter, suggested);
+        if (changed) {
+            recordHistory();
+            maxItter = suggested;
         }
 
-        return itter;
+        estimatedView = currentView();
+        estimateValid = true;
+        return changed;
+    }
 
+    void goToHistoryEntry(const NavigationHistory::Entry* entry) {
+        if (!entry)
+            return;
+
+        camX = entry->view.camX;
+        camY = entry->view.camY;
+        camXLow = entry->view.camXLow;
+        camYLow = entry->view.camYLow;
+        camZoom = entry->view.camZoom;
+        maxItter = entry->view.maxItter;
+        colorShiftFactor = entry->view.colorShiftFactor;
+        formula = entry->view.formula;
+        power = entry->view.power;
+        julia = entry->view.julia;
+        juliaX = entry->view.juliaX;
+        juliaY = entry->view.juliaY;
+        if (entry->view.program)
+            customProgram = entry->view.program;
+
+        prefetcher->cancel();
+        prefetchIssued = false;
+
+        // the history only keeps escape counts, trap distances have to be itterated again
+        if (trap.shape == OrbitTrap::Shape::None && !buddhabrotMode && history.decompress(*entry, tex.getWidth(), tex.getHeight(), currentItters)) {
+            displayItterations(tex, currentItters);
+            currentIttersValid = true;
+            rerender = false;
+        }
+        else {
+            rerender = true;
+        }
+    }
+
+    // the same shader as generateMandelbrot_gpu with the loop body replaced by FormulaProgram::generateGLSL
+    std::string formulaFragmentShader(const FormulaProgram& program) {
+        return
+            "#version 330 core\n"
+            "#extension GL_ARB_gpu_shader_fp64 : enable\n"
+            "\n"
+            "layout(location = 0) out vec4 color;\n"
+            "\n"
+            "in vec2 v_texCoord;\n"
+            "\n"
+            "uniform uvec2 u_zoom2i;\n"
+            "uniform uvec2 u_manTransX2i;\n"
+            "uniform uvec2 u_manTransY2i;\n"
+            "uniform uvec2 u_juliaX2i;\n"
+            "uniform uvec2 u_juliaY2i;\n"
+            "uniform int u_julia;\n"
+            "uniform int u_maxItter;\n"
+            "uniform float u_colorShiftFactor;\n"
+            "\n"
+            + program.generateGLSL() +
+            "\n"
+            "void main()\n"
+            "{\n"
+            "   double u_zoom = packDouble2x32(u_zoom2i);\n"
+            "   dvec2 pixel = dvec2(v_texCoord[0] * 3.5f - 1.75f, v_texCoord[1] * 2.0f - 1.0f) * u_zoom;\n"
+            "   pixel += dvec2(packDouble2x32(u_manTransX2i), packDouble2x32(u_manTransY2i));\n"
+            "\n"
+            "   dvec2 juliaC = dvec2(packDouble2x32(u_juliaX2i), packDouble2x32(u_juliaY2i));\n"
+            "   dvec2 z = u_julia != 0 ? pixel : dvec2(0.0lf, 0.0lf);\n"
+            "   dvec2 c = u_julia != 0 ? juliaC : pixel;\n"
+            "\n"
+            "   int itter = 0;\n"
+            "   while (dot(z, z) <= 2 * 2 && itter < u_maxItter) {\n"
+            "       z = customFormula(z, c);\n"
+            "       itter = itter + 1;\n"
+            "   }\n"
+            "\n"
+            "   float colorShift = float(itter) / float(u_maxItter);\n"
+            "\n"
+            "   colorShift *= u_colorShiftFactor;\n"
+            "   float r = 1.0f - (cos(colorShift * 3.14159f * 1.0f) + 1.0f) / 2.0f;\n"
+            "   float g = 1.0f - (cos(colorShift * 3.14159f * 3.0f) + 1.0f) / 2.0f;\n"
+            "   float b = 1.0f - (cos(colorShift * 3.14159f * 5.0f) + 1.0f) / 2.0f;\n"
+            "\n"
+            "	color = vec4(r, g, b, 1.0f);\n"
+            "};\n";
     }
 
     void generateMandelbrot_gpu(Texture& texture) {
@@ -147,7 +504,39 @@ namespace {
             "	color = vec4(r, g, b, 1.0f);\n"
             "};\n";
 
-        static Shader sh = Shader(vertexShaderString, fragmentShaderString);
+        static Shader mandelbrotShader = Shader(vertexShaderString, fragmentShaderString);
+
+        // any other formula, or a julia set, gets a shader generated from its source which is kept until the formula changes
+        static std::unique_ptr<Shader> formulaShader;
+        static std::string formulaShaderSource;
+
+        bool plainMandelbrot = formula == MandelbrotView::Formula::Mandelbrot && !julia;
+        if (!plainMandelbrot) {
+            std::shared_ptr<const FormulaProgram> program = customProgram;
+            if (formula != MandelbrotView::Formula::Custom || !program) {
+                std::string error;
+                program = FormulaProgram::compile(FormulaProgram::builtinSource((int)formula, power), error);
+                if (!program) {
+                    printf("could not compile the builtin formula %d: %s\n", (int)formula, error.c_str());
+                    plainMandelbrot = true;
+                }
+            }
+
+            if (program && (!formulaShader || program->getSource() != formulaShaderSource)) {
+                formulaShader.reset(new Shader(vertexShaderString, formulaFragmentShader(*program)));
+                formulaShaderSource = program->getSource();
+            }
+        }
+        Shader& sh = plainMandelbrot ? mandelbrotShader : *formulaShader;
+
+        if (!plainMandelbrot) {
+            unsigned int juliaC[4];
+            *((double*)(&juliaC[0])) = juliaX;
+            *((double*)(&juliaC[2])) = juliaY;
+            sh.setUniform2ui("u_juliaX2i", juliaC[0], juliaC[1]);
+            sh.setUniform2ui("u_juliaY2i", juliaC[2], juliaC[3]);
+            sh.setUniform1i("u_julia", julia ? 1 : 0);
+        }
 
         sh.setUniform1i("u_maxItter", maxItter);
         sh.setUniform1f("u_colorShiftFactor", colorShiftFactor);
@@ -179,60 +568,174 @@ namespace {
 
     }
 
-    void generateMandelbrot_cpu(Texture & texture) {
-        std::vector<std::array<float, 4>> pixelData(texture.getWidth() * texture.getHeight());
-        //fillWithMandelbrotData(pixelData, 1920, camX, camY, camZoom);
+    // colors the trap distances of the view on screen into 'texture'
+    void displayTraps(Texture& texture, const std::vector<float>& trapDistances) {
+        static std::vector<uint8_t> pixels;
+        pixels.resize(trapDistances.size() * 4);
 
-        for (int x = 0; x < texture.getWidth(); x++) {
-            for (int y = 0; y < pixelData.size() / texture.getWidth(); y++) {
+        const size_t chunk = 1 << 16;
+        scheduler->forEach(RenderScheduler::Priority::Interactive, (int)((trapDistances.size() + chunk - 1) / chunk), [&](int i) {
+            size_t begin = i * chunk;
+            size_t count = std::min(chunk, trapDistances.size() - begin);
+            MandelbrotCPU::colorizeTrapsRGBA8(&trapDistances[begin], count, trapScale, colorShiftFactor, &pixels[begin * 4]);
+        });
 
-                double x0 = (double)x / texture.getWidth();
-                double y0 = (double)y / texture.getHeight();
+        texture.generateFromData(texture.getWidth(), texture.getHeight(), &pixels[0]);
+    }
 
-                x0 *= 3.5;
-                x0 -= 1.75;
-                y0 *= 2.0;
-                y0 -= 1.0;
+    // escape counts and trap distances in the same pass
+    void generateTraps_cpu(Texture& texture, std::vector<int>& itters, std::vector<float>& trapDistances) {
+        int width = texture.getWidth(), height = texture.getHeight();
+        itters.resize((size_t)width * height);
+        trapDistances.resize((size_t)width * height);
 
-                x0 *= camZoom;
-                y0 *= camZoom;
+        MandelbrotView view = currentView();
+        scheduler->forEach(RenderScheduler::Priority::Interactive, height, [&](int y) {
+            MandelbrotCPU::renderRow(view, width, height, y, 0, width, &itters[(size_t)y * width], nullptr, &trap, &trapDistances[(size_t)y * width]);
+        });
 
-                x0 += camX;
-                y0 += camY;
+        displayTraps(texture, trapDistances);
+    }
 
-                float man = (float)mandelbrotAt(x0, y0, maxItter) / (float)maxItter;
-                std::array<float, 3> color = colorRotator(man);
+    void generateMandelbrot_cpu(Texture & texture, std::vector<int>& itters) {
+        itters.resize(texture.getWidth() * texture.getHeight());
 
-                pixelData[x + y * texture.getWidth()] = { color[0], color[1], color[2], 1.0f };
+        // bands of rows are handed out to every core, ahead of any prefetching or exports
+        const int bandHeight = 16;
+        int bandCount = (texture.getHeight() + bandHeight - 1) / bandHeight;
+        MandelbrotView view = currentView();
+        scheduler->forEach(RenderScheduler::Priority::Interactive, bandCount, [&](int band) {
+            int rowEnd = std::min((band + 1) * bandHeight, texture.getHeight());
+            MandelbrotCPU::renderItterations(view, texture.getWidth(), texture.getHeight(), &itters[0], band * bandHeight, rowEnd);
+        });
 
-            }
+        displayItterations(texture, itters);
+    }
+
+    // renders straight to a png on the cpu without creating a texture, so the size is not limited by vram
+    // it is written in the background at export priority, so the view can still be explored meanwhile
+    void exportMandelbrot_cpu(const std::string& filepath, int width, int height, bool antiAliased) {
+        if (backgroundExport.isRunning()) {
+            printf("%s is still being written\n", backgroundExport.getFilepath().c_str());
+            return;
+        }
+
+        ImageExport::Settings settings;
+        settings.paletteMode = histogramColoring ? Palette::Mode::Histogram : Palette::Mode::Linear;
+        settings.smooth = smoothColoring;
+        settings.trap = trap;
+        settings.trapScale = trapScale;
+        settings.antiAliased = antiAliased;
+        settings.runner = scheduler->runner(RenderScheduler::Priority::Export);
+        settings.threadCount = 1; // only compresses, on the export's own thread
+
+        // the export is the same view as the screen so the histogram of the screen is used
+        backgroundExport.start(filepath, currentView(), width, height, settings, currentIttersValid ? &currentItters : nullptr);
+    }
+
+    void updateViewer() {
+        static FrameStream::Frame frame;
+        static std::vector<uint8_t> pixels;
+        if (streamViewer->takeFrame(frame)) {
+            pixels.resize(frame.itters.size() * 4);
+            palette.update(frame.maxItter, frame.colorShiftFactor);
+            palette.colorize(&frame.itters[0], frame.itters.size(), &pixels[0]);
+            tex.generateFromData(frame.width, frame.height, &pixels[0]);
         }
 
-        texture.generateFromData(texture.getWidth(), texture.getHeight(), &pixelData[0][0], pixelData.size());
+        glClearColor(0, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        static TexturedQuad tq;
+        tq.setTexture(tex);
+        tq.setX(ViewportManager::getLeftViewportBound());
+        tq.setY(ViewportManager::getBottomViewportBound());
+        tq.setWidth(ViewportManager::getRightViewportBound() - ViewportManager::getLeftViewportBound());
+        tq.setHeight(ViewportManager::getTopViewportBound() - ViewportManager::getBottomViewportBound());
+        tq.render();
+
+        char viewerText[150];
+        if (!streamViewer->isConnected())
+            sprintf_s(viewerText, 150, "Waiting for a stream on port %d (V in the other window)", streamViewer->getPort());
+        else if (frame.number == 0)
+            sprintf_s(viewerText, 150, "Connected to port %d", streamViewer->getPort());
+        else
+            sprintf_s(viewerText, 150, "Frame %u: %d tiles, %.1f KB, %.1f ms behind, Zoom: %f", frame.number, frame.tiles, frame.bytes / 1024.0,
+                frame.latencyMilliseconds, 1.0 / frame.camZoom);
+
+        static BitmapText viewerDisplay;
+        viewerDisplay.setText(viewerText);
+        viewerDisplay.setPosition(ViewportManager::getLeftViewportBound(), ViewportManager::getTopViewportBound() - 0.08f);
+        viewerDisplay.setCharHeight(0.06f);
+        viewerDisplay.setColor(1, 1, 1);
+        viewerDisplay.render();
     }
 	
 }
 
+void GameLogicInterface::initViewer(uint16_t port) {
+	window.setResolution(1920, 1080);
+
+    streamViewer = new StreamViewer(port);
+}
+
 void GameLogicInterface::init() {
 	window.setResolution(1920, 1080);
 
-    if (renderWithGPU)
+    scheduler = new RenderScheduler();
+    prefetcher = new PrefetchRenderer(tex.getWidth(), tex.getHeight(), 12, scheduler);
+    posterExporter.setRunner(scheduler->runner(RenderScheduler::Priority::Export), scheduler->getExportThreadCount());
+
+    bool gpu = usingGPU(tex.getWidth(), tex.getHeight());
+    if (gpu)
         generateMandelbrot_gpu(tex);
     else
-        generateMandelbrot_cpu(tex);
+        generateMandelbrot_cpu(tex, currentItters);
 
+    currentIttersValid = !gpu;
 }
 
 // deltaTime is the milliseconds between frames. Use this for calculating movement to avoid slowing down if there is lag 
 void GameLogicInterface::update(float deltaTime) {
 
+    if (streamViewer) {
+        updateViewer();
+        return;
+    }
+
+    if (benchmarkFlag) {
+        Benchmark::pixelFormats(3840, 2160);
+        Benchmark::colorizers(3840, 2160);
+        Benchmark::formulas(3840, 2160);
+        Benchmark::partitions(1280, 720, 8);
+        Benchmark::stream(1080, 720);
+        Benchmark::scheduler(1280, 720);
+        benchmarkFlag = false;
+    }
+
     if (saveFlag) {
-        Texture newT = Texture(3840, 2160);
-        generateMandelbrot_gpu(newT);
-        newT.saveToFile("mandelbrot-image(4k).png");
+        if (saveLarge) {
+            exportMandelbrot_cpu("mandelbrot-image(16k).png", 15360, 8640, antiAliasedExport);
+        }
+        else if (usingGPU(3840, 2160) && !antiAliasedExport && trap.shape == OrbitTrap::Shape::None) {
+            Texture newT = Texture(3840, 2160, Texture::Format::RGBA8);
+            generateMandelbrot_gpu(newT);
+            newT.saveToFile("mandelbrot-image(4k).png");
+        }
+        else {
+            exportMandelbrot_cpu("mandelbrot-image(4k).png", 3840, 2160, antiAliasedExport);
+        }
         saveFlag = false;
     }
 
+    // a julia thumbnail for every c on a grid over the view on screen
+    if (atlasFlag) {
+        MandelbrotView view = currentView();
+        view.julia = false;
+        JuliaAtlas::exportPng("julia-atlas.png", view, JuliaAtlas::Layout());
+        atlasFlag = false;
+    }
+
 	glClearColor(0, 0, 0, 1);
 	glClear(GL_COLOR_BUFFER_BIT);
 
@@ -246,43 +749,109 @@ void GameLogicInterface::update(float deltaTime) {
     tq.render();
 
 
-    if (window.keyIsDown(GLFW_KEY_W)) {
-        camY += camZoom * 0.05 * ((double)deltaTime / 16.0);
+    bool navigating = keyHeld(GLFW_KEY_W) || keyHeld(GLFW_KEY_A) || keyHeld(GLFW_KEY_S) || keyHeld(GLFW_KEY_D) ||
+        keyHeld(GLFW_KEY_O) || keyHeld(GLFW_KEY_P);
+
+    // a continuous pan or zoom is one history step, recorded when it starts
+    if (navigating && !wasNavigating)
+        recordHistory();
+
+    wasNavigating = navigating;
+
+    if (keyHeld(GLFW_KEY_W)) {
+        moveCamera(0.0, camZoom * 0.05 * ((double)deltaTime / 16.0));
         rerender = true;
     }
-    if (window.keyIsDown(GLFW_KEY_A)) {
-        camX -= camZoom * 0.05 * ((double)deltaTime / 16.0);
+    if (keyHeld(GLFW_KEY_A)) {
+        moveCamera(-camZoom * 0.05 * ((double)deltaTime / 16.0), 0.0);
         rerender = true;
     }
-    if (window.keyIsDown(GLFW_KEY_S)) {
-        camY -= camZoom * 0.05 * ((double)deltaTime / 16.0);
+    if (keyHeld(GLFW_KEY_S)) {
+        moveCamera(0.0, -camZoom * 0.05 * ((double)deltaTime / 16.0));
         rerender = true;
     }
-    if (window.keyIsDown(GLFW_KEY_D)) {
-        camX += camZoom * 0.05 * ((double)deltaTime / 16.0);
+    if (keyHeld(GLFW_KEY_D)) {
+        moveCamera(camZoom * 0.05 * ((double)deltaTime / 16.0), 0.0);
         rerender = true;
     }
 
-    if (window.keyIsDown(GLFW_KEY_O)) {
+    if (keyHeld(GLFW_KEY_O)) {
         camZoom += (1.01 * camZoom - camZoom) * ((double)deltaTime / 16.0);
         rerender = true;
-    } else if (window.keyIsDown(GLFW_KEY_P)) {
+    } else if (keyHeld(GLFW_KEY_P)) {
         camZoom -= (1.01 * camZoom - camZoom) * ((double)deltaTime / 16.0);
         rerender = true;
     }
 
+    // automatic itterations stay put while a pan or zoom is held and are picked once for the view it stops on
+    if (autoItter && !navigating && pickAutoItter())
+        rerender = true;
+
     if (rerender) {
-        if (renderWithGPU)
-            generateMandelbrot_gpu(tex);
-        else
-            generateMandelbrot_cpu(tex);
+        // a real render always wins over speculative work
+        prefetcher->cancel();
+
+        // the escape data on hand is from before the camera moved, so it is not kept with the history step
+        currentIttersValid = false;
+
+        currentTrapsValid = false;
+
+        if (buddhabrotMode) {
+            buddhabrot.start(currentView(), tex.getWidth(), tex.getHeight());
+            buddhabrotVersion = -1;
+            currentIttersValid = false;
+        }
+        else if (trap.shape != OrbitTrap::Shape::None) {
+            // the prefetcher only keeps escape counts so traps are always rendered here
+            generateTraps_cpu(tex, currentItters, currentTraps);
+            currentIttersValid = true;
+            currentTrapsValid = true;
+        }
+        else if (!showPrefetched(tex)) {
+            bool gpu = usingGPU(tex.getWidth(), tex.getHeight());
+            if (gpu)
+                generateMandelbrot_gpu(tex);
+            else
+                generateMandelbrot_cpu(tex, currentItters);
+
+            currentIttersValid = !gpu;
+        }
+
+        if (streamSender)
+            streamSender->show(currentView(), tex.getWidth(), tex.getHeight());
 
         rerender = false;
+        prefetchIssued = false;
+    }
+    else {
+        // the zoom targets follow the cursor, the prediction is refreshed once they have moved by more than a pixel
+        // (they move by the mouse position times camZoom, and a pixel is 3.5 * camZoom / width across)
+        // in gpu mode only the view on screen is prefetched so the cursor does not matter
+        bool mouseMoved = !usingGPU(tex.getWidth(), tex.getHeight()) && (std::abs(window.getMouseX() - prefetchMouseX) > 3.5f / tex.getWidth() ||
+            std::abs(window.getMouseY() - prefetchMouseY) > 2.0f / tex.getHeight());
+
+        if (!navigating && !buddhabrotMode && trap.shape == OrbitTrap::Shape::None && (!prefetchIssued || mouseMoved)) {
+            prefetchMouseX = window.getMouseX();
+            prefetchMouseY = window.getMouseY();
+            prefetcher->prefetch(likelyNextViews(deltaTime));
+            prefetchIssued = true;
+        }
+    }
+
+
+    if (buddhabrotMode && buddhabrotVersion != buddhabrot.getVersion()) {
+        buddhabrotVersion = buddhabrot.getVersion();
+
+        static std::vector<uint8_t> pixels;
+        buddhabrot.getImage(pixels);
+        tex.generateFromData(buddhabrot.getWidth(), buddhabrot.getHeight(), &pixels[0]);
     }
 
 
     std::string itterTxt = "Process Itterations: ";
     itterTxt.append(std::to_string(maxItter));
+    if (autoItter)
+        itterTxt.append(" (auto)");
 
     static BitmapText maxItterCounter;
     maxItterCounter.setText(itterTxt);
@@ -292,8 +861,12 @@ void GameLogicInterface::update(float deltaTime) {
     maxItterCounter.render();
 
 
+    const char* trapNames[5] = { "", "point", "line", "cross", "circle" };
     char colorShiftText[100];
-    sprintf_s(colorShiftText, 100, "Color Shift Factor: %.0f", colorShiftFactor);
+    if (trap.shape == OrbitTrap::Shape::None)
+        sprintf_s(colorShiftText, 100, "Color Shift Factor: %.0f", colorShiftFactor);
+    else
+        sprintf_s(colorShiftText, 100, "Color Shift Factor: %.0f (%s trap, scale %.3f)", colorShiftFactor, trapNames[(int)trap.shape], trapScale);
 
     static BitmapText colorShiftCounter;
     colorShiftCounter.setText(colorShiftText);
@@ -303,8 +876,9 @@ void GameLogicInterface::update(float deltaTime) {
     colorShiftCounter.render();
 
 
-    char posText[100];
-    sprintf_s(posText, 100, "Pos(%.5f, %.5f)", camX, camY);
+    // exact decimals with as many digits as the zoom needs, Ctrl+C copies them
+    ViewState location = ViewState::capture(currentView());
+    std::string posText = "Pos(" + location.getCenterX() + ", " + location.getCenterY() + ")";
 
     static BitmapText posDisplay;
     posDisplay.setText(posText);
@@ -314,8 +888,9 @@ void GameLogicInterface::update(float deltaTime) {
     posDisplay.render();
 
 
-    char zoomText[100];
-    sprintf_s(zoomText, 100, "Zoom: %f", 1.0 / camZoom);
+    MandelbrotCPU::Precision precision = MandelbrotCPU::precisionFor(currentView(), tex.getWidth(), tex.getHeight());
+    const char* precisionNames[] = { "", " (double-double)", " (past double-double)" };
+    std::string zoomText = "Zoom: " + location.getZoom() + precisionNames[(int)precision];
 
     static BitmapText zoomDisplay;
     zoomDisplay.setText(zoomText);
@@ -323,10 +898,139 @@ void GameLogicInterface::update(float deltaTime) {
     zoomDisplay.setCharHeight(0.06f);
     zoomDisplay.setColor(1, 1, 1);
     zoomDisplay.render();
+
+
+    char prefetchText[100];
+    sprintf_s(prefetchText, 100, "Prefetch Hits: %.0f%% (%d/%d)", prefetcher->getHitRate() * 100.0f, prefetcher->getHits(), prefetcher->getLookups());
+
+    static BitmapText prefetchDisplay;
+    prefetchDisplay.setText(prefetchText);
+    prefetchDisplay.setPosition(ViewportManager::getLeftViewportBound(), ViewportManager::getTopViewportBound() - 0.08f * 5);
+    prefetchDisplay.setCharHeight(0.06f);
+    prefetchDisplay.setColor(1, 1, 1);
+    prefetchDisplay.render();
+
+
+    if (posterExporter.isRunning()) {
+        char posterText[100];
+        sprintf_s(posterText, 100, "Poster Export: %s", posterExporter.getTracker().getEstimate().describe().c_str());
+
+        static BitmapText posterDisplay;
+        posterDisplay.setText(posterText);
+        posterDisplay.setPosition(ViewportManager::getLeftViewportBound(), ViewportManager::getBottomViewportBound() + 0.02f);
+        posterDisplay.setCharHeight(0.06f);
+        posterDisplay.setColor(1, 1, 1);
+        posterDisplay.render();
+    }
+
+    if (backgroundExport.isRunning()) {
+        char exportText[100];
+        sprintf_s(exportText, 100, "Exporting %s: %s", backgroundExport.getFilepath().c_str(), backgroundExport.getTracker().getEstimate().describe().c_str());
+
+        static BitmapText exportDisplay;
+        exportDisplay.setText(exportText);
+        exportDisplay.setPosition(ViewportManager::getLeftViewportBound(), ViewportManager::getBottomViewportBound() + 0.02f + 0.08f);
+        exportDisplay.setCharHeight(0.06f);
+        exportDisplay.setColor(1, 1, 1);
+        exportDisplay.render();
+    }
+
+
+    char historyText[100];
+    sprintf_s(historyText, 100, "History: %d/%d (%.1f MB)", history.getPosition(), history.getSize(), history.getMemoryUsage() / (1024.0 * 1024.0));
+
+    static BitmapText historyDisplay;
+    historyDisplay.setText(historyText);
+    historyDisplay.setPosition(ViewportManager::getLeftViewportBound(), ViewportManager::getTopViewportBound() - 0.08f * 6);
+    historyDisplay.setCharHeight(0.06f);
+    historyDisplay.setColor(1, 1, 1);
+    historyDisplay.render();
+
+
+    const char* formulaNames[4] = { "z^2 + c", "z^n + c", "Burning Ship", "Tricorn" };
+    std::string formulaText = "Formula: ";
+    if (editingFormula) {
+        formulaText += formulaInput + "_";
+    }
+    else if (formula == MandelbrotView::Formula::Custom) {
+        formulaText += customProgram->getSource();
+    }
+    else if (formula == MandelbrotView::Formula::Multibrot) {
+        formulaText += FormulaProgram::builtinSource((int)formula, power);
+    }
+    else {
+        formulaText += formulaNames[(int)formula];
+    }
+
+    if (julia && !editingFormula) {
+        char juliaText[100];
+        sprintf_s(juliaText, 100, " (julia %.4f, %.4f)", juliaX, juliaY);
+        formulaText += juliaText;
+    }
+
+    static BitmapText formulaDisplay;
+    formulaDisplay.setText(formulaText);
+    formulaDisplay.setPosition(ViewportManager::getLeftViewportBound(), ViewportManager::getTopViewportBound() - 0.08f * 7);
+    formulaDisplay.setCharHeight(0.06f);
+    formulaDisplay.setColor(1, 1, 1);
+    formulaDisplay.render();
+
+    if (editingFormula && !formulaError.empty()) {
+        static BitmapText formulaErrorDisplay;
+        formulaErrorDisplay.setText(formulaError);
+        formulaErrorDisplay.setPosition(ViewportManager::getLeftViewportBound(), ViewportManager::getTopViewportBound() - 0.08f * 8);
+        formulaErrorDisplay.setCharHeight(0.06f);
+        formulaErrorDisplay.setColor(1, 0.3f, 0.3f);
+        formulaErrorDisplay.render();
+    }
+    else if (buddhabrotMode) {
+        char buddhabrotText[100];
+        sprintf_s(buddhabrotText, 100, "Nebulabrot: %.1fM orbits, %.0f%% accepted", buddhabrot.getOrbitCount() / 1e6, buddhabrot.getAcceptanceRate() * 100.0f);
+
+        static BitmapText buddhabrotDisplay;
+        buddhabrotDisplay.setText(buddhabrotText);
+        buddhabrotDisplay.setPosition(ViewportManager::getLeftViewportBound(), ViewportManager::getTopViewportBound() - 0.08f * 8);
+        buddhabrotDisplay.setCharHeight(0.06f);
+        buddhabrotDisplay.setColor(1, 1, 1);
+        buddhabrotDisplay.render();
+    }
+
+    if (streamSender) {
+        FrameStream::Sender::Stats streamStats = streamSender->getStats();
+        char streamText[100];
+        sprintf_s(streamText, 100, "Streaming on port %d: %d viewers, %llu frames, %.1f MB sent", FrameStream::defaultPort, streamStats.viewers,
+            (unsigned long long)streamStats.frames, streamStats.bytes / (1024.0 * 1024.0));
+
+        static BitmapText streamDisplay;
+        streamDisplay.setText(streamText);
+        streamDisplay.setPosition(ViewportManager::getLeftViewportBound(), ViewportManager::getTopViewportBound() - 0.08f * 9);
+        streamDisplay.setCharHeight(0.06f);
+        streamDisplay.setColor(1, 1, 1);
+        streamDisplay.render();
+    }
    
 }
 
 void GameLogicInterface::cleanup() {
+    // stopping here saves the poster progress so it can be resumed next time with Ctrl+G
+    posterExporter.cancel();
+    posterExporter.wait();
+
+    backgroundExport.cancel();
+    backgroundExport.wait();
+
+    buddhabrot.stop();
+    streamSender.reset();
+
+    delete prefetcher;
+    prefetcher = nullptr;
+
+    // after everything that renders with it
+    delete scheduler;
+    scheduler = nullptr;
+
+    delete streamViewer;
+    streamViewer = nullptr;
 
 }
 
@@ -342,20 +1046,188 @@ void GameLogicInterface::mouseButtonCallback(int button, int action, int mods)
 
 void GameLogicInterface::keyCallback(int key, int scancode, int action, int mods)
 {
+    // a viewer only shows what it is sent
+    if (streamViewer)
+        return;
+
+    // while typing a formula the keys are text, the characters themselves arrive through characterCallback
+    if (editingFormula) {
+        if (action == GLFW_RELEASE)
+            return;
+
+        if (key == GLFW_KEY_BACKSPACE && !formulaInput.empty()) {
+            formulaInput.pop_back();
+        }
+        else if (key == GLFW_KEY_ESCAPE) {
+            editingFormula = false;
+        }
+        else if (key == GLFW_KEY_ENTER || key == GLFW_KEY_KP_ENTER) {
+            std::shared_ptr<const FormulaProgram> program = FormulaProgram::compile(formulaInput, formulaError);
+            if (program) {
+                recordHistory();
+                customProgram = program;
+                formula = MandelbrotView::Formula::Custom;
+                editingFormula = false;
+                rerender = true;
+            }
+        }
+        return;
+    }
+
+    if (key == GLFW_KEY_TAB && action == GLFW_PRESS) {
+        editingFormula = true;
+        formulaError.clear();
+        formulaInput = formula == MandelbrotView::Formula::Custom ? customProgram->getSource() : FormulaProgram::builtinSource((int)formula, power);
+        return;
+    }
     
     if (key == GLFW_KEY_S && (mods & GLFW_MOD_CONTROL)) {
         saveFlag = true;
+        saveLarge = (mods & GLFW_MOD_SHIFT) != 0;
+    }
+
+    if (key == GLFW_KEY_X && action == GLFW_PRESS) {
+        antiAliasedExport = !antiAliasedExport;
+    }
+
+    // Ctrl+C copies the location on screen as command line options (--headless renders it) and Ctrl+V goes to a copied one
+    if (key == GLFW_KEY_C && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL)) {
+        std::string location = ViewState::capture(currentView()).toArguments() + " --itters " + std::to_string(maxItter);
+        glfwSetClipboardString(window.getHandle(), location.c_str());
+        printf("%s\n", location.c_str());
+    }
+    else if (key == GLFW_KEY_C && action == GLFW_PRESS && !(mods & GLFW_MOD_CONTROL)) {
+        smoothColoring = !smoothColoring;
+    }
+
+    if (key == GLFW_KEY_V && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL)) {
+        const char* clipboard = glfwGetClipboardString(window.getHandle());
+        ViewState location = ViewState::capture(currentView());
+        MandelbrotView view = currentView();
+        if (clipboard && location.parseArguments(clipboard) && location.apply(view)) {
+            recordHistory();
+            camX = view.camX;
+            camY = view.camY;
+            camXLow = view.camXLow;
+            camYLow = view.camYLow;
+            camZoom = view.camZoom;
+
+            const char* itters = strstr(clipboard, "--itters ");
+            if (itters && atoi(itters + 9) > 0)
+                maxItter = atoi(itters + 9);
+            rerender = true;
+        }
+        else {
+            printf("the clipboard has no location to go to, copy one with Ctrl+C\n");
+        }
+        return;
+    }
+
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        histogramColoring = !histogramColoring;
+        if (currentIttersValid && trap.shape == OrbitTrap::Shape::None)
+            displayItterations(tex, currentItters);
+    }
+
+    if (key == GLFW_KEY_F5 && action == GLFW_PRESS) {
+        benchmarkFlag = true;
+    }
+
+    // renders in the background on the cpu, an interrupted poster is picked up where it left off
+    if (key == GLFW_KEY_G && (mods & GLFW_MOD_CONTROL) && action == GLFW_PRESS && !posterExporter.isRunning()) {
+        if (GigapixelExporter::canResume(posterFilepath))
+            posterExporter.resume(posterFilepath);
+        else
+            posterExporter.start(posterFilepath, currentView(), 61440, 34560);
     }
 
+    if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        goToHistoryEntry(history.back(currentView(), knownItters(), tex.getWidth(), tex.getHeight()));
+    }
+    else if (key == GLFW_KEY_F && action == GLFW_PRESS) {
+        goToHistoryEntry(history.forward());
+    }
+
+    // changing it by hand turns the automatic selection off
     if (key == GLFW_KEY_9 && action == GLFW_PRESS) {
-        maxItter -= 10;
+        recordHistory();
+        // at least one itteration, colors are picked by itters / maxItter
+        maxItter = std::max(maxItter - 10, 1);
+        autoItter = false;
         rerender = true;
     }
     else if (key == GLFW_KEY_0 && action == GLFW_PRESS) {
+        recordHistory();
         maxItter += 10;
+        autoItter = false;
+        rerender = true;
+    }
+    else if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+        autoItter = !autoItter;
+        estimateValid = false;
+    }
+
+    // M cycles through the formulas, N steps the power of z^n + c
+    if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+        recordHistory();
+        if (formula == MandelbrotView::Formula::Custom)
+            formula = MandelbrotView::Formula::Mandelbrot;
+        else
+            formula = (MandelbrotView::Formula)(((int)formula + 1) % 4);
+        rerender = true;
+    }
+    else if (key == GLFW_KEY_N && action == GLFW_PRESS && formula == MandelbrotView::Formula::Multibrot) {
+        recordHistory();
+        power = power == 8 ? 3 : power + 1;
+        rerender = true;
+    }
+
+    // Ctrl+J writes an atlas of julia sets over the view, J on its own shows the julia set of the point in the middle of the screen
+    // and pressing it again goes back to where it was taken from
+    if (key == GLFW_KEY_J && action == GLFW_PRESS && (mods & GLFW_MOD_CONTROL)) {
+        atlasFlag = true;
+    }
+    else if (key == GLFW_KEY_J && action == GLFW_PRESS) {
+        recordHistory();
+        julia = !julia;
+        if (julia) {
+            juliaX = camX;
+            juliaY = camY;
+            camX = 0.0;
+            camY = 0.0;
+        }
+        else {
+            camX = juliaX;
+            camY = juliaY;
+        }
+        camXLow = 0.0;
+        camYLow = 0.0;
+        camZoom = 1.0;
+        rerender = true;
+    }
+
+    if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+        buddhabrotMode = !buddhabrotMode;
+        if (!buddhabrotMode)
+            buddhabrot.stop();
         rerender = true;
     }
 
+    if (key == GLFW_KEY_V && action == GLFW_PRESS && !(mods & GLFW_MOD_CONTROL)) {
+        if (streamSender) {
+            streamSender.reset();
+        }
+        else {
+            streamSender.reset(new FrameStream::Sender());
+            if (streamSender->isListening())
+                streamSender->show(currentView(), tex.getWidth(), tex.getHeight());
+            else {
+                printf("could not stream, port %d is already taken\n", FrameStream::defaultPort);
+                streamSender.reset();
+            }
+        }
+    }
+
     if (key == GLFW_KEY_1 && action == GLFW_PRESS) {
         renderWithGPU = true;
     }
@@ -365,17 +1237,32 @@ void GameLogicInterface::keyCallback(int key, int scancode, int action, int mods
 
     if (key == GLFW_KEY_K && action == GLFW_PRESS) {
         colorShiftFactor -= 1;
-        rerender = true;
+        if (currentTrapsValid)
+            displayTraps(tex, currentTraps);
+        else
+            rerender = true;
     }
     else if (key == GLFW_KEY_L && action == GLFW_PRESS) {
         colorShiftFactor += 1;
+        if (currentTrapsValid)
+            displayTraps(tex, currentTraps);
+        else
+            rerender = true;
+    }
+
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        trap.shape = (OrbitTrap::Shape)(((int)trap.shape + 1) % 5);
         rerender = true;
     }
+    else if ((key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET) && action == GLFW_PRESS && currentTrapsValid) {
+        trapScale *= key == GLFW_KEY_LEFT_BRACKET ? 0.8f : 1.25f;
+        displayTraps(tex, currentTraps);
+    }
 
 
     if (key == GLFW_KEY_E && action == GLFW_PRESS) {
-        camX += window.getMouseX() * camZoom;
-        camY += window.getMouseY() * camZoom;
+        recordHistory();
+        moveCamera(window.getMouseX() * camZoom, window.getMouseY() * camZoom);
 
         camZoom *= 0.4;
 
@@ -383,8 +1270,8 @@ void GameLogicInterface::keyCallback(int key, int scancode, int action, int mods
     }
 
     else if (key == GLFW_KEY_Q && action == GLFW_PRESS) {
-        camX -= window.getMouseX() * camZoom;
-        camY -= window.getMouseY() * camZoom;
+        recordHistory();
+        moveCamera(-window.getMouseX() * camZoom, -window.getMouseY() * camZoom);
 
         camZoom *= 1.6;
 
@@ -395,4 +1282,6 @@ void GameLogicInterface::keyCallback(int key, int scancode, int action, int mods
 
 void GameLogicInterface::characterCallback(unsigned int codepoint)
 {
+    if (editingFormula && codepoint >= 32 && codepoint < 127 && formulaInput.size() < 200)
+        formulaInput += (char)codepoint;
 }
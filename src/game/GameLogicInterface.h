@@ -13,6 +13,9 @@
 
 namespace GameLogicInterface {
 	void init();
+
+	// instead of init(), shows the frames another session streams to 'port' (--view)
+	void initViewer(uint16_t port);
 	void update(float deltaTime);
 	void cleanup();
 
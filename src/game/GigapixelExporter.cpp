@@ -0,0 +1,457 @@
+#include "game/GigapixelExporter.h"
+#include "game/FormulaProgram.h"
+#include "game/CostMap.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+	const char progressMagic[8] = { 'M', 'B', 'P', 'R', 'O', 'G', '0', '1' };
+
+	// the least time between checkpoints while rendering, it is longer when they are slow
+	const std::chrono::seconds progressInterval(2);
+	const int checkpointRatio = 100;
+
+	std::string pamHeader(int width, int height) {
+		return "P7\nWIDTH " + std::to_string(width) + "\nHEIGHT " + std::to_string(height) + "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+	}
+
+	std::string progressPath(const std::string& filepath) {
+		return filepath + ".progress";
+	}
+
+	// the image is next to its progress file, only its name is kept so the two can be moved together
+	std::string fileName(const std::string& filepath) {
+		size_t slash = filepath.find_last_of("/\\");
+		return slash == std::string::npos ? filepath : filepath.substr(slash + 1);
+	}
+
+	double millisecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+}
+
+GigapixelExporter::GigapixelExporter()
+{
+}
+
+GigapixelExporter::~GigapixelExporter()
+{
+	cancel();
+	wait();
+}
+
+bool GigapixelExporter::start(const std::string& filepath, const MandelbrotView& view, int width, int height)
+{
+	Job newJob;
+	newJob.view = view;
+	newJob.width = width;
+	newJob.height = height;
+
+	return begin(filepath, newJob, false);
+}
+
+bool GigapixelExporter::resume(const std::string& filepath)
+{
+	// the workers of an export still running read tilesDone, they are stopped before it is replaced
+	cancel();
+	wait();
+
+	Job savedJob;
+	std::vector<uint8_t> savedTiles;
+	if (!loadProgress(filepath, savedJob, savedTiles))
+		return false;
+
+	tilesDone = savedTiles;
+	return begin(filepath, savedJob, true);
+}
+
+bool GigapixelExporter::canResume(const std::string& filepath)
+{
+	Job savedJob;
+	std::vector<uint8_t> savedTiles;
+	return loadProgress(filepath, savedJob, savedTiles);
+}
+
+void GigapixelExporter::cancel()
+{
+	cancelled = true;
+}
+
+void GigapixelExporter::wait()
+{
+	for (std::thread& worker : workers) {
+		if (worker.joinable())
+			worker.join();
+	}
+	workers.clear();
+}
+
+bool GigapixelExporter::isRunning()
+{
+	return workersRunning > 0;
+}
+
+float GigapixelExporter::getProgress()
+{
+	return tracker.getEstimate().fraction;
+}
+
+RenderProgress& GigapixelExporter::getTracker()
+{
+	return tracker;
+}
+
+std::string GigapixelExporter::getFilepath()
+{
+	return filepath;
+}
+
+GigapixelExporter::Stats GigapixelExporter::getStats()
+{
+	std::lock_guard<std::mutex> lock(saveMutex);
+	Stats current = stats;
+	current.elapsedMilliseconds = millisecondsSince(started);
+	return current;
+}
+
+double GigapixelExporter::Stats::getOverhead() const
+{
+	return elapsedMilliseconds > 0.0 ? checkpointMilliseconds / (elapsedMilliseconds * threadCount) : 0.0;
+}
+
+bool GigapixelExporter::begin(const std::string& filepath, const Job& job, bool resuming)
+{
+	cancel();
+	wait();
+
+	this->filepath = filepath;
+	this->job = job;
+
+	std::string header = pamHeader(job.width, job.height);
+	headerSize = header.size();
+
+	uint64_t fileSize = headerSize + (uint64_t)job.width * job.height * 4;
+
+	// tiles marked as done are only worth keeping if the image they were written to is still there
+	if (resuming) {
+		std::ifstream existing(filepath, std::ios::binary | std::ios::ate);
+		if (!existing.good() || (uint64_t)existing.tellg() != fileSize)
+			resuming = false;
+	}
+
+	if (!file.open(filepath, fileSize, resuming))
+		return false;
+
+	MappedFile::Region headerRegion = file.map(0, header.size());
+	if (!headerRegion.data)
+		return false;
+	memcpy(headerRegion.data, header.data(), header.size());
+	file.unmap(headerRegion);
+
+	palette.update(job.view.maxItter, job.view.colorShiftFactor);
+
+	tileCount = getTilesAcross() * getTilesDown();
+	if (!resuming || (int)tilesDone.size() != tileCount)
+		tilesDone.assign(tileCount, 0);
+
+	tilesDoneCount = (int)std::count(tilesDone.begin(), tilesDone.end(), 1);
+	nextTile = 0;
+	cancelled = false;
+	lastSave = std::chrono::steady_clock::now();
+	saveInterval = progressInterval;
+
+	if (!saveProgress(tilesDone))
+		return false;
+
+	int threadCount = runner ? runnerThreadCount : std::max(1, (int)std::thread::hardware_concurrency());
+
+	// the tiles done before resuming count as their predicted cost
+	CostMap costs(job.view, job.width, job.height, 192, runner ? 1 : threadCount);
+	tracker.begin(costs.getTotal());
+	for (int tile = 0; tile < tileCount; tile++) {
+		if (!tilesDone[tile])
+			continue;
+		int x0 = (tile % getTilesAcross()) * job.tileWidth;
+		int row0 = (tile / getTilesAcross()) * job.tileHeight;
+		tracker.skip(costs.cost(x0, std::max(0, job.height - row0 - job.tileHeight), std::min(job.width, x0 + job.tileWidth), job.height - row0));
+	}
+
+	stats = Stats();
+	stats.threadCount = threadCount;
+	stats.tilesResumed = tilesDoneCount;
+	started = std::chrono::steady_clock::now();
+
+	if (runner) {
+		// one item per tile, each claims whichever tile is next like a worker thread would
+		workersRunning = 1;
+		workers.emplace_back([this]() {
+			runner(tileCount, [this](int) { workTile(); });
+			workerFinished();
+		});
+		return true;
+	}
+
+	workersRunning = threadCount;
+	for (int i = 0; i < threadCount; i++) {
+		workers.emplace_back([this]() { workerLoop(); });
+	}
+
+	return true;
+}
+
+int GigapixelExporter::getTilesAcross()
+{
+	return (job.width + job.tileWidth - 1) / job.tileWidth;
+}
+
+int GigapixelExporter::getTilesDown()
+{
+	return (job.height + job.tileHeight - 1) / job.tileHeight;
+}
+
+void GigapixelExporter::setRunner(const Parallel::Runner& runner, int threadCount)
+{
+	this->runner = runner;
+	runnerThreadCount = std::max(1, threadCount);
+}
+
+void GigapixelExporter::workerLoop()
+{
+	while (workTile())
+		;
+
+	workerFinished();
+}
+
+bool GigapixelExporter::workTile()
+{
+	int tile = nextTile++;
+	// tiles are only ever written by the worker that claimed them so reading this without the lock is safe
+	while (tile < tileCount && tilesDone[tile])
+		tile = nextTile++;
+	if (cancelled || tile >= tileCount)
+		return false;
+
+	// a tile that could not be written is left undone so the final save never records a hole as finished
+	if (!renderTile(tile))
+		return false;
+
+	bool due;
+	{
+		std::lock_guard<std::mutex> lock(progressMutex);
+		tilesDone[tile] = 1;
+		tilesDoneCount++;
+
+		due = std::chrono::steady_clock::now() - lastSave > saveInterval;
+		if (due)
+			lastSave = std::chrono::steady_clock::now();
+	}
+
+	if (due)
+		checkpoint();
+	return true;
+}
+
+void GigapixelExporter::workerFinished()
+{
+	// the last worker out writes the final state, and only counts itself out once it is written and the file is closed
+	// so isRunning() never says the export is over while it still reads tilesDone
+	std::lock_guard<std::mutex> lock(progressMutex);
+	if (workersRunning == 1) {
+		if (tilesDoneCount == tileCount) {
+			file.flush();
+			file.close();
+			std::remove(progressPath(filepath).c_str());
+			tracker.finish();
+		}
+		else {
+			saveProgress(tilesDone);
+			file.close();
+		}
+	}
+	workersRunning--;
+}
+
+void GigapixelExporter::checkpoint()
+{
+	std::unique_lock<std::mutex> saving(saveMutex, std::try_to_lock);
+	if (!saving.owns_lock())
+		return;
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<uint8_t> done;
+	{
+		std::lock_guard<std::mutex> lock(progressMutex);
+		done = tilesDone;
+	}
+	saveProgress(done);
+
+	auto took = std::chrono::steady_clock::now() - start;
+	stats.checkpoints++;
+	stats.checkpointMilliseconds += std::chrono::duration<double, std::milli>(took).count();
+
+	std::lock_guard<std::mutex> lock(progressMutex);
+	saveInterval = std::max<std::chrono::steady_clock::duration>(progressInterval, took * checkpointRatio);
+}
+
+bool GigapixelExporter::renderTile(int tile)
+{
+	int x0 = (tile % getTilesAcross()) * job.tileWidth;
+	int row0 = (tile / getTilesAcross()) * job.tileHeight;
+	int tileWidth = std::min(job.tileWidth, job.width - x0);
+	int tileHeight = std::min(job.tileHeight, job.height - row0);
+
+	uint64_t stride = (uint64_t)job.width * 4;
+	uint64_t offset = headerSize + row0 * stride + (uint64_t)x0 * 4;
+	size_t length = (size_t)((tileHeight - 1) * stride + (uint64_t)tileWidth * 4);
+
+	MappedFile::Region region = file.map(offset, length);
+	if (!region.data) {
+		cancelled = true;
+		return false;
+	}
+
+	std::vector<int> itters(tileWidth);
+	for (int row = 0; row < tileHeight; row++) {
+		// image rows go from the top down and y = 0 of the view is the bottom
+		MandelbrotCPU::renderRow(job.view, job.width, job.height, job.height - 1 - (row0 + row), x0, x0 + tileWidth, &itters[0]);
+		tracker.addRow(&itters[0], tileWidth);
+
+		palette.colorize(&itters[0], tileWidth, region.data + row * stride);
+	}
+
+	file.unmap(region);
+	return true;
+}
+
+bool GigapixelExporter::saveProgress(const std::vector<uint8_t>& done)
+{
+	if (!file.flush())
+		return false;
+
+	std::string path = progressPath(filepath);
+	std::string tempPath = path + ".tmp";
+
+	{
+		std::ofstream out(tempPath, std::ios::binary);
+		if (!out.good())
+			return false;
+
+		int32_t size[4] = { job.width, job.height, job.tileWidth, job.tileHeight };
+		out.write(progressMagic, sizeof(progressMagic));
+		out.write((const char*)&job.view.camX, sizeof(double));
+		out.write((const char*)&job.view.camY, sizeof(double));
+		out.write((const char*)&job.view.camZoom, sizeof(double));
+		out.write((const char*)&job.view.camXLow, sizeof(double));
+		out.write((const char*)&job.view.camYLow, sizeof(double));
+		out.write((const char*)&job.view.maxItter, sizeof(int32_t));
+		out.write((const char*)&job.view.colorShiftFactor, sizeof(float));
+		int32_t formula[3] = { (int32_t)job.view.formula, job.view.power, job.view.julia ? 1 : 0 };
+		out.write((const char*)formula, sizeof(formula));
+		out.write((const char*)&job.view.juliaX, sizeof(double));
+		out.write((const char*)&job.view.juliaY, sizeof(double));
+		std::string source = job.view.program ? job.view.program->getSource() : "";
+		int32_t sourceLength = (int32_t)source.size();
+		out.write((const char*)&sourceLength, sizeof(int32_t));
+		out.write(source.data(), sourceLength);
+		out.write((const char*)size, sizeof(size));
+
+		// the partial image this belongs to, a checkpoint is no use with any other file
+		std::string image = fileName(filepath);
+		int32_t imageNameLength = (int32_t)image.size();
+		uint64_t imageSize = headerSize + (uint64_t)job.width * job.height * 4;
+		out.write((const char*)&imageNameLength, sizeof(int32_t));
+		out.write(image.data(), imageNameLength);
+		out.write((const char*)&imageSize, sizeof(uint64_t));
+
+		// a bit per tile, a 16k x 16k poster in 256 x 64 tiles is 2KB
+		std::vector<uint8_t> bitmap((done.size() + 7) / 8, 0);
+		for (size_t tile = 0; tile < done.size(); tile++)
+			bitmap[tile / 8] |= done[tile] << (tile % 8);
+		out.write((const char*)&bitmap[0], bitmap.size());
+
+		if (!out.good())
+			return false;
+	}
+
+	// rename over the old file so a crash while saving never leaves a half written progress file
+	std::remove(path.c_str());
+	return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+bool GigapixelExporter::loadProgress(const std::string& filepath, Job& job, std::vector<uint8_t>& tilesDone)
+{
+	std::ifstream in(progressPath(filepath), std::ios::binary);
+	if (!in.good())
+		return false;
+
+	char magic[8];
+	int32_t size[4];
+	in.read(magic, sizeof(magic));
+	in.read((char*)&job.view.camX, sizeof(double));
+	in.read((char*)&job.view.camY, sizeof(double));
+	in.read((char*)&job.view.camZoom, sizeof(double));
+	in.read((char*)&job.view.camXLow, sizeof(double));
+	in.read((char*)&job.view.camYLow, sizeof(double));
+	in.read((char*)&job.view.maxItter, sizeof(int32_t));
+	in.read((char*)&job.view.colorShiftFactor, sizeof(float));
+	int32_t formula[3];
+	in.read((char*)formula, sizeof(formula));
+	in.read((char*)&job.view.juliaX, sizeof(double));
+	in.read((char*)&job.view.juliaY, sizeof(double));
+	int32_t sourceLength = 0;
+	in.read((char*)&sourceLength, sizeof(int32_t));
+	if (sourceLength < 0 || sourceLength > 4096)
+		return false;
+	std::string source(sourceLength, '\0');
+	in.read(&source[0], source.size());
+	in.read((char*)size, sizeof(size));
+
+	if (!in.good() || memcmp(magic, progressMagic, sizeof(magic)) != 0 || size[0] <= 0 || size[1] <= 0 || size[2] <= 0 || size[3] <= 0)
+		return false;
+
+	job.view.formula = (MandelbrotView::Formula)formula[0];
+	job.view.power = formula[1];
+	job.view.julia = formula[2] != 0;
+
+	if (job.view.formula == MandelbrotView::Formula::Custom) {
+		std::string error;
+		job.view.program = FormulaProgram::compile(source, error);
+		if (!job.view.program)
+			return false;
+	}
+
+	job.width = size[0];
+	job.height = size[1];
+	job.tileWidth = size[2];
+	job.tileHeight = size[3];
+
+	size_t tileCount = (size_t)((job.width + job.tileWidth - 1) / job.tileWidth) * ((job.height + job.tileHeight - 1) / job.tileHeight);
+	tilesDone.assign(tileCount, 0);
+
+	int32_t imageNameLength = 0;
+	in.read((char*)&imageNameLength, sizeof(int32_t));
+	if (imageNameLength < 0 || imageNameLength > 4096)
+		return false;
+	std::string image(imageNameLength, '\0');
+	in.read(&image[0], image.size());
+	uint64_t imageSize = 0;
+	in.read((char*)&imageSize, sizeof(uint64_t));
+	if (!in.good() || image != fileName(filepath) || imageSize != pamHeader(job.width, job.height).size() + (uint64_t)job.width * job.height * 4)
+		return false;
+
+	std::vector<uint8_t> bitmap((tileCount + 7) / 8);
+	in.read((char*)&bitmap[0], bitmap.size());
+	if (in.gcount() != (std::streamsize)bitmap.size())
+		return false;
+
+	for (size_t tile = 0; tile < tileCount; tile++)
+		tilesDone[tile] = (bitmap[tile / 8] >> (tile % 8)) & 1;
+	return true;
+}
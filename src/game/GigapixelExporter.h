@@ -0,0 +1,129 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+#include "game/Palette.h"
+#include "game/RenderProgress.h"
+#include "engine/MappedFile.h"
+#include "engine/Parallel.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// renders exports of any size on the cpu straight into a memory mapped PAM (P7, rgba) file
+// worker threads map only the tile they are working on and write colors directly into it, so memory use does not depend on the output size
+// completed tiles are recorded in '<filepath>.progress' so an interrupted export can be resumed without redoing them
+//
+// the progress file is a checkpoint: the view and size, the name and size of the partial image it belongs to and a bitmap of the finished tiles.
+// it is rewritten while rendering by whichever worker finishes a tile once it is due, the others keep going, and the time between checkpoints
+// grows to 100 times what the last one took so they never cost more than 1% of one worker
+class GigapixelExporter {
+public:
+	struct Stats {
+		int threadCount = 0;
+		int tilesResumed = 0;              // already done in the checkpoint this export resumed from
+		int checkpoints = 0;
+		double checkpointMilliseconds = 0.0; // spent writing checkpoints, by the worker that wrote each one
+		double elapsedMilliseconds = 0.0;    // since this run started
+
+		// share of the workers' time that went into checkpoints
+		double getOverhead() const;
+	};
+
+	GigapixelExporter();
+
+	// stops the export, progress so far is kept so it can be resumed
+	~GigapixelExporter();
+
+	GigapixelExporter(const GigapixelExporter&) = delete;
+
+	// starts rendering in the background, returns false if the output file could not be created
+	bool start(const std::string& filepath, const MandelbrotView& view, int width, int height);
+
+	// continues an export that was interrupted, the view and size are read from the progress file
+	bool resume(const std::string& filepath);
+
+	// true if 'filepath' has a progress file from an unfinished export
+	static bool canResume(const std::string& filepath);
+
+	// renders the tiles of later exports with 'runner' (which uses about 'threadCount' threads) from one thread of its own instead of a thread per core
+	void setRunner(const Parallel::Runner& runner, int threadCount);
+
+	// stops the workers after their current tile and saves progress
+	void cancel();
+
+	// blocks until the export is finished or cancelled
+	void wait();
+
+	bool isRunning();
+
+	// fraction of the predicted itterations done, including the tiles that were done before resuming
+	float getProgress();
+
+	// with the time left, and once finished how far off the prediction was
+	RenderProgress& getTracker();
+
+	std::string getFilepath();
+
+	Stats getStats();
+
+private:
+	struct Job {
+		MandelbrotView view;
+		int width = 0, height = 0;
+		int tileWidth = 256, tileHeight = 64;
+	};
+
+	bool begin(const std::string& filepath, const Job& job, bool resuming);
+
+	int getTilesAcross();
+	int getTilesDown();
+
+	void workerLoop();
+
+	// claims, renders and records the next tile that is not done, false once there are none left or the export was cancelled
+	bool workTile();
+
+	// called by each worker as it stops, the last one finishes the file or saves progress
+	void workerFinished();
+
+	// false if the tile's part of the file could not be mapped, the export is cancelled then
+	bool renderTile(int tile);
+
+	// flushes the image to disk and then records the tiles in 'done', in that order so a crash never marks a tile that was lost
+	// 'done' must be a copy taken before the flush if workers are still running
+	bool saveProgress(const std::vector<uint8_t>& done);
+
+	// a periodic saveProgress() from a worker, skipped if another worker is already writing one
+	void checkpoint();
+
+	static bool loadProgress(const std::string& filepath, Job& job, std::vector<uint8_t>& tilesDone);
+
+	std::string filepath;
+	Job job;
+	MappedFile file;
+	uint64_t headerSize = 0;
+	Palette palette;
+	RenderProgress tracker;
+
+	std::vector<std::thread> workers;
+	Parallel::Runner runner;
+	int runnerThreadCount = 0;
+	std::atomic<int> nextTile{ 0 };
+	std::atomic<bool> cancelled{ false };
+	std::atomic<int> workersRunning{ 0 };
+
+	std::mutex progressMutex;
+	std::vector<uint8_t> tilesDone; // one byte per tile so workers never share a byte
+	std::atomic<int> tilesDoneCount{ 0 };
+	int tileCount = 0;
+	std::chrono::steady_clock::time_point lastSave;
+	std::chrono::steady_clock::duration saveInterval;
+
+	std::mutex saveMutex;
+	Stats stats;
+	std::chrono::steady_clock::time_point started;
+};
@@ -0,0 +1,471 @@
+#include "game/HeadlessRenderer.h"
+#include "game/ImageExport.h"
+#include "game/ItterationEstimator.h"
+#include "game/FormulaProgram.h"
+#include "game/Benchmark.h"
+#include "game/BatchRenderer.h"
+#include "game/TileServer.h"
+#include "game/FrameStream.h"
+#include "game/RenderFarm.h"
+#include "game/GigapixelExporter.h"
+#include "game/ViewState.h"
+#include "engine/PngWriter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace {
+
+	void printUsage() {
+		printf(
+			"usage: --headless [options]   renders one image on the cpu without opening a window\n"
+			"  --center x,y                 middle of the view (default -0.5,0), with as many digits as it needs\n"
+			"  --zoom z                     magnification, the Zoom shown on screen like 500 or 2.5e20 (default 1)\n"
+			"  --size WxH                   image size (default 3840x2160)\n"
+			"  --itters n|auto              maxItter, auto picks it from a sample of the view (default 300)\n"
+			"  --palette linear|histogram|smooth\n"
+			"  --color-shift f              color shift factor (default 2)\n"
+			"  --formula name|source        mandelbrot, burning-ship, tricorn, multibrot:n or any formula like \"sqr(fold(z)) + c\"\n"
+			"  --julia x,y                  julia set of c = x + yi\n"
+			"  --trap point|line|cross|circle, --trap-scale s\n"
+			"  --no-aa                      one sample per pixel instead of supersampling the edges\n"
+			"  --threads n                  worker threads (default every core)\n"
+			"  --output file.png            (default mandelbrot-image.png)\n"
+			"  --output file.pam            renders any size straight into the file with checkpoints, one sample per pixel in the linear palette\n"
+			"   or: --resume file.pam       continues a .pam export from its checkpoint after a crash or Ctrl+C\n"
+			"   or: --batch manifest.jsonl  renders every job of a json lines manifest, the options above are the defaults of each job\n"
+			"  --cache-mb n                 memory for the escape data shared between jobs (default 1024)\n"
+			"   or: --serve                 serves png tiles over http on 127.0.0.1 until stopped, see TileServer.h for the urls\n"
+			"  --port n                     (default 8337)\n"
+			"  --cache-mb n                 memory for finished tiles (default 256)\n"
+			"  --farm n                     renders on n worker processes instead, one sample per pixel rows only (no smooth palette or traps)\n"
+			"  --balanced                   gives each farm worker one band cut from a cost estimate of the view instead of many small ones\n"
+			"  --farm-scaling n             renders the image with 1 to n single threaded workers and prints the throughput of each\n"
+			"   or: --farm-worker           renders bands for a --farm on --port (default 8340) until it is finished\n"
+			"   or: --view                  prints the frames streamed by a session (V in the app) and writes each one to --output if given\n"
+			"  --port n                     (default 8338)\n"
+			"   or: --benchmark             prints the cpu benchmark tables\n");
+	}
+
+	bool parsePair(const char* text, char separator, double& a, double& b) {
+		const char* split = strchr(text, separator);
+		if (!split)
+			return false;
+
+		char* end;
+		a = strtod(text, &end);
+		if (end != split)
+			return false;
+		b = strtod(split + 1, &end);
+		return *end == '\0';
+	}
+
+	// waits for a .pam export, printing the progress now and then
+	int finishPoster(GigapixelExporter& exporter) {
+		auto lastReport = std::chrono::steady_clock::now();
+		while (exporter.isRunning()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			if (std::chrono::steady_clock::now() - lastReport > std::chrono::seconds(5)) {
+				printf("%s: %s\n", exporter.getFilepath().c_str(), exporter.getTracker().getEstimate().describe().c_str());
+				lastReport = std::chrono::steady_clock::now();
+			}
+		}
+		exporter.wait();
+
+		GigapixelExporter::Stats stats = exporter.getStats();
+		if (exporter.getProgress() < 1.0f) {
+			printf("%s: stopped at %.1f%%, run it again with --resume\n", exporter.getFilepath().c_str(), exporter.getProgress() * 100.0f);
+			return 1;
+		}
+
+		printf("%s: %.1f s, %d tiles were done before resuming, %d checkpoints took %.1f ms (%.3f%% of the workers' time)\n", exporter.getFilepath().c_str(),
+			stats.elapsedMilliseconds / 1000.0, stats.tilesResumed, stats.checkpoints, stats.checkpointMilliseconds, stats.getOverhead() * 100.0);
+		printf("%s: the itterations were predicted %+.1f%% off\n", exporter.getFilepath().c_str(), exporter.getTracker().getError() * 100.0);
+		return 0;
+	}
+
+	// a console viewer for FrameStream, the window build shows the frames instead
+	int viewStream(uint16_t port, const std::string& output) {
+		FrameStream::Receiver receiver;
+		if (!receiver.connect(port)) {
+			printf("nothing is streaming on 127.0.0.1:%d\n", port);
+			return 1;
+		}
+
+		FrameStream::Frame frame;
+		Palette palette;
+		std::vector<uint8_t> rgba;
+		while (receiver.receive(frame)) {
+			printf("frame %u: %dx%d, %s, %d tiles, %.1f KB, %.1f ms\n", frame.number, frame.width, frame.height, frame.wholeFrame ? "whole" : "delta",
+				frame.tiles, frame.bytes / 1024.0, frame.latencyMilliseconds);
+
+			if (output.empty())
+				continue;
+
+			size_t pixelCount = frame.itters.size();
+			rgba.resize(pixelCount * 4);
+			palette.update(frame.maxItter, frame.colorShiftFactor);
+			palette.colorize(&frame.itters[0], pixelCount, &rgba[0]);
+
+			// the frames are bottom row first
+			PngWriter png(output, frame.width, frame.height);
+			for (int y = frame.height - 1; y >= 0; y--)
+				png.writeRow(&rgba[(size_t)y * frame.width * 4]);
+			png.finish();
+		}
+
+		printf("the stream has ended\n");
+		receiver.close();
+		return 0;
+	}
+
+}
+
+bool HeadlessRenderer::requested(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--headless") == 0 || strcmp(argv[i], "--batch") == 0 || strcmp(argv[i], "--serve") == 0 || strcmp(argv[i], "--benchmark") == 0 ||
+			strcmp(argv[i], "--farm") == 0 || strcmp(argv[i], "--farm-scaling") == 0 || strcmp(argv[i], "--farm-worker") == 0 || strcmp(argv[i], "--resume") == 0)
+			return true;
+
+#ifdef HEADLESS_ONLY
+	// the window build has its own viewer
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--view") == 0)
+			return true;
+#endif
+	return false;
+}
+
+int HeadlessRenderer::run(int argc, char** argv)
+{
+	MandelbrotView view;
+	ViewState location; // the center and zoom exactly as given, applied to the view once every option is read
+	int width = 3840, height = 2160;
+	bool autoItter = false;
+	std::string output; // mandelbrot-image.png unless it is given
+	ImageExport::Settings settings;
+	std::string manifest;
+	bool serve = false;
+	bool viewing = false;
+	int port = 0;
+	int farmWorkers = 0;
+	bool farmScaling = false;
+	bool farmWorker = false;
+	bool balanced = false;
+	std::string resume;
+	int failAfter = 0;
+	size_t cacheMb = 0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string option = argv[i];
+
+		if (option == "--headless")
+			continue;
+		if (option == "--benchmark") {
+			Benchmark::colorizers(3840, 2160);
+			Benchmark::formulas(3840, 2160);
+			Benchmark::partitions(1280, 720, 8);
+			Benchmark::stream(1080, 720);
+			Benchmark::scheduler(1280, 720);
+			return 0;
+		}
+		if (option == "--help") {
+			printUsage();
+			return 0;
+		}
+		if (option == "--serve") {
+			serve = true;
+			continue;
+		}
+		if (option == "--farm-worker") {
+			farmWorker = true;
+			continue;
+		}
+		if (option == "--balanced") {
+			balanced = true;
+			continue;
+		}
+		if (option == "--view") {
+			viewing = true;
+			continue;
+		}
+		if (option == "--no-aa") {
+			settings.antiAliased = false;
+			continue;
+		}
+
+		// everything else takes a value
+		if (i + 1 >= argc) {
+			printf("%s needs a value\n", option.c_str());
+			printUsage();
+			return 1;
+		}
+		const char* value = argv[++i];
+		bool valid = true;
+
+		if (option == "--center") {
+			valid = location.setCenter(value);
+		}
+		else if (option == "--zoom") {
+			valid = location.setZoom(value);
+		}
+		else if (option == "--size") {
+			double w, h;
+			valid = parsePair(value, 'x', w, h) && w >= 1 && h >= 1;
+			width = (int)w;
+			height = (int)h;
+		}
+		else if (option == "--itters") {
+			autoItter = strcmp(value, "auto") == 0;
+			view.maxItter = atoi(value);
+			valid = autoItter || view.maxItter > 0;
+		}
+		else if (option == "--palette") {
+			settings.paletteMode = strcmp(value, "histogram") == 0 ? Palette::Mode::Histogram : Palette::Mode::Linear;
+			settings.smooth = strcmp(value, "smooth") == 0;
+			valid = settings.smooth || strcmp(value, "linear") == 0 || strcmp(value, "histogram") == 0;
+		}
+		else if (option == "--color-shift") {
+			view.colorShiftFactor = (float)atof(value);
+		}
+		else if (option == "--formula") {
+			std::string error;
+			if (!parseFormula(value, view, error)) {
+				printf("--formula %s: %s\n", value, error.c_str());
+				return 1;
+			}
+		}
+		else if (option == "--julia") {
+			view.julia = true;
+			valid = parsePair(value, ',', view.juliaX, view.juliaY);
+		}
+		else if (option == "--trap") {
+			valid = parseTrap(value, settings.trap.shape);
+		}
+		else if (option == "--trap-scale") {
+			settings.trapScale = (float)atof(value);
+			valid = settings.trapScale > 0.0f;
+		}
+		else if (option == "--threads") {
+			settings.threadCount = atoi(value);
+			valid = settings.threadCount > 0;
+		}
+		else if (option == "--output") {
+			output = value;
+		}
+		else if (option == "--batch") {
+			manifest = value;
+		}
+		else if (option == "--port") {
+			port = atoi(value);
+			valid = port > 0 && port < 65536;
+		}
+		else if (option == "--farm" || option == "--farm-scaling") {
+			farmWorkers = atoi(value);
+			farmScaling = option == "--farm-scaling";
+			valid = farmWorkers > 0 && farmWorkers <= 256;
+		}
+		else if (option == "--fail-after") {
+			failAfter = atoi(value);
+			valid = failAfter > 0;
+		}
+		else if (option == "--resume") {
+			resume = value;
+		}
+		else if (option == "--cache-mb") {
+			cacheMb = (size_t)atoi(value);
+			valid = cacheMb > 0;
+		}
+		else {
+			printf("unknown option %s\n", option.c_str());
+			printUsage();
+			return 1;
+		}
+
+		if (!valid) {
+			printf("bad value for %s: %s\n", option.c_str(), value);
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (!location.apply(view)) {
+		printf("--center or --zoom is too large to render\n");
+		return 1;
+	}
+	MandelbrotCPU::Precision precision = MandelbrotCPU::precisionFor(view, width, height);
+	if (precision == MandelbrotCPU::Precision::DoubleDouble)
+		printf("--zoom %s needs double-double precision, the image will take several times longer\n", location.getZoom().c_str());
+	else if (precision == MandelbrotCPU::Precision::Beyond)
+		printf("--zoom %s is past double-double precision, neighbouring pixels will repeat\n", location.getZoom().c_str());
+
+	if (!manifest.empty()) {
+		BatchRenderer::Job defaults;
+		defaults.view = view;
+		defaults.width = width;
+		defaults.height = height;
+		defaults.autoItter = autoItter;
+		defaults.settings = settings;
+
+		std::vector<BatchRenderer::Job> jobs;
+		std::string error;
+		if (!BatchRenderer::readManifest(manifest, defaults, jobs, error)) {
+			printf("%s: %s\n", manifest.c_str(), error.c_str());
+			return 1;
+		}
+		return BatchRenderer::run(jobs, settings.threadCount, (cacheMb ? cacheMb : 1024) << 20) == 0 ? 0 : 1;
+	}
+
+	if (farmWorker)
+		return RenderFarm::work(port ? (uint16_t)port : RenderFarm::defaultPort, settings.threadCount, failAfter);
+
+	if (!resume.empty()) {
+		GigapixelExporter exporter;
+		if (!exporter.resume(resume)) {
+			printf("%s has no checkpoint to resume from\n", resume.c_str());
+			return 1;
+		}
+		return finishPoster(exporter);
+	}
+
+	if (viewing)
+		return viewStream(port ? (uint16_t)port : FrameStream::defaultPort, output);
+
+	if (serve) {
+		TileServer::Settings serverSettings;
+		if (port)
+			serverSettings.port = (uint16_t)port;
+		if (cacheMb)
+			serverSettings.cacheBytes = cacheMb << 20;
+		serverSettings.renderThreads = settings.threadCount;
+		return TileServer(serverSettings).run() ? 0 : 1;
+	}
+
+	if (autoItter)
+		view.maxItter = ItterationEstimator::estimate(view, width, height).maxItter;
+
+	if (output.empty())
+		output = "mandelbrot-image.png";
+
+	if (output.size() > 4 && output.compare(output.size() - 4, 4, ".pam") == 0) {
+		GigapixelExporter exporter;
+		if (!exporter.start(output, view, width, height)) {
+			printf("could not write %s\n", output.c_str());
+			return 1;
+		}
+		return finishPoster(exporter);
+	}
+
+	// progress and time left are printed every few seconds from a prediction of the itterations the image takes
+	RenderProgress tracker;
+	if (!farmScaling) {
+		tracker.begin(RenderProgress::predict(view, width, height, settings.threadCount));
+		settings.tracker = &tracker;
+	}
+
+	if (farmWorkers) {
+		RenderFarm::Settings farm;
+		farm.workers = farmWorkers;
+		farm.threadsPerWorker = settings.threadCount;
+		farm.balanced = balanced;
+		if (port)
+			farm.port = (uint16_t)port;
+
+		if (farmScaling) {
+			RenderFarm::scaling(output, view, width, height, settings, farm);
+			return 0;
+		}
+
+		RenderFarm::Result result;
+		{
+			RenderProgress::Printer printer(output, tracker);
+			result = RenderFarm::exportPng(output, view, width, height, settings, farm);
+		}
+		tracker.finish();
+		if (!result.image.written) {
+			printf("--farm: %s\n", result.error.c_str());
+			return 1;
+		}
+
+		std::string perWorker;
+		for (int bands : result.bandsPerWorker)
+			perWorker += (perWorker.empty() ? "" : " ") + std::to_string(bands);
+		printf("%s: %dx%d, maxItter %d, %.0f ms (%.2f Mpx/s) on %d workers, checksum %08x\n", output.c_str(), width, height, view.maxItter,
+			result.image.milliseconds, result.image.pixels / result.image.milliseconds / 1000.0, farmWorkers, result.image.checksum);
+		printf("%d bands, per worker %s, %d handed out again, %d duplicated, the itterations were predicted %+.1f%% off\n", result.bands, perWorker.c_str(),
+			result.bandsReassigned, result.bandsDuplicated, tracker.getError() * 100.0);
+
+		// how close the cost estimate came, the actual share is of the processor time of all the bands
+		if (balanced) {
+			double totalMs = 0.0;
+			for (const RenderFarm::BandReport& band : result.bandReports)
+				totalMs += band.cpuMilliseconds;
+
+			printf("cost pre-pass %.0f ms\n%-12s %7s %10s %10s %9s\n", result.prepassMilliseconds, "rows", "worker", "predicted", "cpu ms", "actual");
+			for (const RenderFarm::BandReport& band : result.bandReports)
+				printf("%5d-%-6d %7d %9.1f%% %10.0f %8.1f%%\n", band.y0, band.y1, band.worker, band.predicted * 100.0, band.cpuMilliseconds,
+					100.0 * band.cpuMilliseconds / totalMs);
+		}
+		return 0;
+	}
+
+	ImageExport::Result result;
+	{
+		RenderProgress::Printer printer(output, tracker);
+		result = ImageExport::exportPng(output, view, width, height, settings);
+	}
+	tracker.finish();
+	if (!result.written) {
+		printf("could not write %s\n", output.c_str());
+		return 1;
+	}
+
+	printf("%s: %dx%d, maxItter %d, %.0f ms (%.2f Mpx/s), %.2f samples per pixel, checksum %08x\n", output.c_str(), width, height, view.maxItter,
+		result.milliseconds, result.pixels / result.milliseconds / 1000.0, (double)result.samples / result.pixels, result.checksum);
+	printf("the itterations were predicted %+.1f%% off\n", tracker.getError() * 100.0);
+	return 0;
+}
+
+bool HeadlessRenderer::parseFormula(const std::string& text, MandelbrotView& view, std::string& error)
+{
+	if (text == "mandelbrot") {
+		view.formula = MandelbrotView::Formula::Mandelbrot;
+	}
+	else if (text == "burning-ship") {
+		view.formula = MandelbrotView::Formula::BurningShip;
+	}
+	else if (text == "tricorn") {
+		view.formula = MandelbrotView::Formula::Tricorn;
+	}
+	else if (text.compare(0, 10, "multibrot:") == 0) {
+		view.formula = MandelbrotView::Formula::Multibrot;
+		view.power = atoi(text.c_str() + 10);
+		if (view.power < 3 || view.power > 8) {
+			error = "multibrot power must be 3 to 8";
+			return false;
+		}
+	}
+	else {
+		view.formula = MandelbrotView::Formula::Custom;
+		view.program = FormulaProgram::compile(text, error);
+		return view.program != nullptr;
+	}
+	return true;
+}
+
+bool HeadlessRenderer::parseTrap(const std::string& text, OrbitTrap::Shape& shape)
+{
+	const char* shapes[] = { "none", "point", "line", "cross", "circle" };
+	for (int i = 0; i < 5; i++) {
+		if (text == shapes[i]) {
+			shape = (OrbitTrap::Shape)i;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+#include "game/OrbitTrap.h"
+
+#include <string>
+
+// renders from the command line on the cpu with no window or opengl context, for batch renders on servers without a gpu,
+// benchmarking and regression checks (the checksum it prints only changes if the output image does)
+//
+//   --headless [--center x,y] [--zoom z] [--size WxH] [--itters n|auto] [--palette linear|histogram|smooth] [--color-shift f]
+//              [--formula name|source] [--julia x,y] [--trap point|line|cross|circle] [--trap-scale s] [--no-aa] [--threads n] [--output file.png|file.pam]
+//   --headless ... --farm n | --farm-scaling n   renders on worker processes (see RenderFarm.h)
+//   --farm-worker [--port n] [--threads n] [--fail-after n]   one of those workers, started by the coordinator
+//   --resume file.pam   continues a .pam export from its checkpoint (see GigapixelExporter.h)
+//   --batch manifest.jsonl [--cache-mb n]   renders every job of a manifest (see BatchRenderer.h), the other options are the defaults of each job
+//   --serve [--port n] [--cache-mb n]   serves tiles over http on 127.0.0.1 (see TileServer.h)
+//   --view [--port n] [--output file.png]   prints the frames a session streams (see FrameStream.h), only in HEADLESS_ONLY builds or with --headless
+//   --benchmark   prints the cpu benchmark tables
+//
+// a build with HEADLESS_ONLY defined leaves out everything that needs glfw or glew, only the cpu sources are needed to compile it
+namespace HeadlessRenderer {
+
+	// true if the arguments ask for a headless run, main() checks this before creating the window
+	bool requested(int argc, char** argv);
+
+	// returns the process exit code
+	int run(int argc, char** argv);
+
+	// the values of --formula and --trap, also used for the same members of a batch manifest
+	bool parseFormula(const std::string& text, MandelbrotView& view, std::string& error);
+	bool parseTrap(const std::string& text, OrbitTrap::Shape& shape);
+
+}
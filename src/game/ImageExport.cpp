@@ -0,0 +1,158 @@
+#include "game/ImageExport.h"
+#include "engine/PngWriter.h"
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+namespace {
+
+	uint32_t fnv1a(uint32_t hash, const uint8_t* data, size_t size) {
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ data[i]) * 16777619u;
+		return hash;
+	}
+
+}
+
+ImageExport::Result ImageExport::exportPng(const std::string& filepath, const MandelbrotView& view, int width, int height, const Settings& settings,
+	const std::vector<int>* histogramItters)
+{
+	auto start = std::chrono::steady_clock::now();
+	Result result;
+
+	int threadCount = settings.threadCount > 0 ? settings.threadCount : Parallel::defaultThreadCount();
+	bool trapped = settings.trap.shape != OrbitTrap::Shape::None;
+	bool smooth = settings.smooth && settings.paletteMode == Palette::Mode::Linear && !trapped;
+
+	Palette palette;
+	if (settings.paletteMode == Palette::Mode::Histogram) {
+		// the histogram of the whole image is known before its first row is rendered from a small copy of it
+		std::vector<int> preview;
+		if (!histogramItters) {
+			int previewWidth = std::max(1, width / 8), previewHeight = std::max(1, height / 8);
+			preview.resize((size_t)previewWidth * previewHeight);
+			Parallel::forEach(previewHeight, threadCount, [&](int y) {
+				MandelbrotCPU::renderRow(view, previewWidth, previewHeight, y, 0, previewWidth, &preview[(size_t)y * previewWidth]);
+			});
+			histogramItters = &preview;
+		}
+		palette.updateHistogram(&(*histogramItters)[0], histogramItters->size(), view.maxItter, view.colorShiftFactor, threadCount);
+	}
+	else {
+		palette.update(view.maxItter, view.colorShiftFactor);
+	}
+
+	// when the colors fit in a palette the file is written as an indexed png, which is a quarter of the data to compress
+	// anti-aliasing blends colors so it never is
+	std::vector<std::array<uint8_t, 3>> indexedColors;
+	std::vector<uint8_t> paletteIndex;
+	bool indexed = !smooth && !trapped && !settings.antiAliased && palette.buildIndexed(indexedColors, paletteIndex);
+
+	std::unique_ptr<PngWriter> png(indexed ? new PngWriter(filepath, width, height, indexedColors, threadCount) : new PngWriter(filepath, width, height, 4, threadCount));
+	if (!png->isOpen())
+		return result;
+
+	auto colorize = [&](const int* itters, const float* smoothItters, const float* trapDistances, size_t count, uint8_t* rgba) {
+		if (trapDistances)
+			MandelbrotCPU::colorizeTrapsRGBA8(trapDistances, count, settings.trapScale, view.colorShiftFactor, rgba);
+		else if (smoothItters)
+			palette.colorizeSmooth(smoothItters, count, rgba);
+		else
+			palette.colorize(itters, count, rgba);
+	};
+
+	const int bandHeight = 16;
+	std::vector<int> itters((size_t)width * bandHeight);
+	std::vector<float> smoothItters(smooth ? (size_t)width * bandHeight : 0);
+	std::vector<float> trapDistances(trapped ? (size_t)width * bandHeight : 0);
+	std::vector<uint8_t> pixels((size_t)width * bandHeight * (indexed ? 1 : 4));
+
+	// the one sample per pixel rows, counted as they are made
+	AdaptiveSampler::RowSource rowSource = [&](int y, int* rowItters, float* smoothRow, float* trapRow) {
+		if (settings.rowSource)
+			settings.rowSource(y, rowItters, smoothRow, trapRow);
+		else
+			MandelbrotCPU::renderRow(view, width, height, y, 0, width, rowItters, smoothRow, &settings.trap, trapRow);
+		if (settings.tracker)
+			settings.tracker->addRow(rowItters, width);
+	};
+
+	std::unique_ptr<AdaptiveSampler> sampler;
+	if (settings.antiAliased) {
+		sampler.reset(new AdaptiveSampler(view, width, height, settings.trap, smooth, colorize, 12, threadCount));
+		if (settings.rowSource || settings.tracker)
+			sampler->setRowSource(rowSource);
+		if (settings.runner)
+			sampler->setRunner(settings.runner);
+	}
+
+	auto forEachRow = [&](int count, const std::function<void(int)>& job) {
+		if (settings.runner)
+			settings.runner(count, job);
+		else
+			Parallel::forEach(count, threadCount, job);
+	};
+
+	uint32_t checksum = 2166136261u;
+
+	// png rows go from the top down and row 0 of the view is the bottom
+	for (int top = height; top > 0; top -= bandHeight) {
+		if (settings.cancelled && settings.cancelled()) {
+			png.reset();
+			std::remove(filepath.c_str());
+			result.cancelled = true;
+			return result;
+		}
+
+		int rows = std::min(bandHeight, top);
+		size_t count = (size_t)width * rows;
+
+		// the sampler also looks at the rows just above and below the band
+		if (settings.prepareRows)
+			settings.prepareRows(std::max(top - rows - 1, 0), std::min(top + 1, height));
+
+		if (sampler) {
+			sampler->renderBand(top, rows, &pixels[0]);
+		}
+		else {
+			forEachRow(rows, [&](int row) {
+				float* smoothRow = smooth ? &smoothItters[(size_t)row * width] : nullptr;
+				float* trapRow = trapped ? &trapDistances[(size_t)row * width] : nullptr;
+				rowSource(top - 1 - row, &itters[(size_t)row * width], smoothRow, trapRow);
+			});
+
+			if (indexed) {
+				for (size_t i = 0; i < count; i++)
+					pixels[i] = paletteIndex[itters[i]];
+			}
+			else {
+				colorize(&itters[0], smooth ? &smoothItters[0] : nullptr, trapped ? &trapDistances[0] : nullptr, count, &pixels[0]);
+			}
+		}
+
+		// indexed rows are hashed as the rgba they stand for, so the checksum does not depend on how the file was written
+		if (indexed) {
+			for (size_t i = 0; i < count; i++) {
+				const std::array<uint8_t, 3>& color = indexedColors[pixels[i]];
+				const uint8_t rgba[4] = { color[0], color[1], color[2], 255 };
+				checksum = fnv1a(checksum, rgba, 4);
+			}
+		}
+		else {
+			checksum = fnv1a(checksum, &pixels[0], count * 4);
+		}
+		png->writeRows(&pixels[0], rows);
+	}
+
+	result.written = png->finish();
+	result.pixels = (uint64_t)width * height;
+	result.samples = sampler ? sampler->getSampleCount() : result.pixels;
+	result.edgePixels = sampler ? sampler->getEdgePixelCount() : 0;
+	result.checksum = checksum;
+	result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
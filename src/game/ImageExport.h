@@ -0,0 +1,59 @@
+#pragma once
+
+#include "game/AdaptiveSampler.h"
+#include "game/MandelbrotCPU.h"
+#include "game/OrbitTrap.h"
+#include "game/Palette.h"
+#include "game/RenderProgress.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// cpu png export of a view, the code behind Ctrl+S and the --headless command line
+// nothing here touches opengl so it runs on machines with no gpu or display
+namespace ImageExport {
+
+	struct Settings {
+		Palette::Mode paletteMode = Palette::Mode::Linear;
+		bool smooth = false; // fractional escape counts, ignored in histogram mode
+
+		OrbitTrap trap; // colors by trap distance instead when it has a shape
+		float trapScale = 0.1f;
+
+		bool antiAliased = true; // supersamples the edges with AdaptiveSampler
+
+		int threadCount = 0; // 0 uses every core
+
+		// where the one sample per pixel rows come from, MandelbrotCPU::renderRow of the view if it is empty
+		// prepareRows(yBegin, yEnd) is called before any row in that range is asked for, rowSource may then be called from several threads at once
+		std::function<void(int yBegin, int yEnd)> prepareRows;
+		AdaptiveSampler::RowSource rowSource;
+
+		// spreads the rows of each band instead of threadCount threads when set, threadCount is then only used for compressing
+		Parallel::Runner runner;
+
+		// counts the cost of every one sample per pixel row when set, begin() and finish() are left to the caller so one can span several exports
+		RenderProgress* tracker = nullptr;
+
+		// checked before each band, the export stops and the file is removed once it returns true
+		std::function<bool()> cancelled;
+	};
+
+	struct Result {
+		bool written = false;
+		bool cancelled = false;
+		uint64_t pixels = 0;
+		uint64_t samples = 0;    // every escape count worked out, more than 'pixels' when anti-aliased
+		uint64_t edgePixels = 0; // pixels that were supersampled
+		double milliseconds = 0.0;
+		uint32_t checksum = 0;   // fnv-1a of the rgba rows (indexed pngs included), the same view and settings always give the same value
+	};
+
+	// renders in bands of rows straight into a png so the size is not limited by memory
+	// histogram coloring is built from 'histogramItters' (usually the view on screen) or from a small render of the view if it is null
+	Result exportPng(const std::string& filepath, const MandelbrotView& view, int width, int height, const Settings& settings,
+		const std::vector<int>* histogramItters = nullptr);
+
+}
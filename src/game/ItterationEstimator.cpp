@@ -0,0 +1,186 @@
+#include "game/ItterationEstimator.h"
+#include "game/Formulas.h"
+#include "game/FormulaProgram.h"
+#include "game/DoubleDouble.h"
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+	// the state of one sample is kept between passes so doubling the limit only costs the extra itterations
+	// T is double, or DoubleDouble for views the renderer draws in DoubleDouble so the samples land where its pixels do
+	template<typename T>
+	struct Sample {
+		T x0, y0; // c
+		T x, y;   // z
+		int itter;
+
+		// periodicity check, an orbit that comes back to a point it has visited is stuck in a cycle and is inside the set
+		T savedX, savedY;
+		int savedAt;
+		bool inside;
+	};
+
+	// 'step' is z -> f(z, c) as step(x, y, cx, cy, nx, ny)
+	template<typename T, typename Step>
+	void itterateTo(Sample<T>& s, int limit, const Step& step) {
+		// deep orbits shadow a cycle far more closely before they escape, so DoubleDouble ones have to come back nearer to count
+		const T epsilon = std::is_same<T, double>::value ? 1e-17 : 1e-30;
+
+		T x = s.x, y = s.y;
+		int itter = s.itter;
+
+		while (!s.inside && x * x + y * y <= 2 * 2 && itter < limit) {
+			step(x, y, s.x0, s.y0, x, y);
+			itter++;
+
+			using std::abs;
+			if (abs(x - s.savedX) < epsilon && abs(y - s.savedY) < epsilon)
+				s.inside = true;
+
+			// the saved point moves along at powers of two so cycles of any length get caught
+			if (itter == s.savedAt * 2) {
+				s.savedX = x;
+				s.savedY = y;
+				s.savedAt = itter;
+			}
+		}
+
+		s.x = x;
+		s.y = y;
+		s.itter = itter;
+	}
+
+	template<typename T>
+	bool escaped(const Sample<T>& s) {
+		return 2 * 2 < s.x * s.x + s.y * s.y;
+	}
+
+	// pixelToPlaneX and Y with the low parts of the center like the DoubleDouble rows of MandelbrotCPU::renderRow
+	template<typename T>
+	T planeX(const MandelbrotView& view, double px, int width) {
+		if constexpr (std::is_same<T, double>::value)
+			return MandelbrotCPU::pixelToPlaneX(view, px, width);
+		else
+			return DoubleDouble(view.camX, view.camXLow) + ((px / width) * 3.5 - 1.75) * view.camZoom;
+	}
+
+	template<typename T>
+	T planeY(const MandelbrotView& view, double py, int height) {
+		if constexpr (std::is_same<T, double>::value)
+			return MandelbrotCPU::pixelToPlaneY(view, py, height);
+		else
+			return DoubleDouble(view.camY, view.camYLow) + ((py / height) * 2.0 - 1.0) * view.camZoom;
+	}
+
+	// the itteration count of every sample that escaped within the final limit, which is written to 'limit'
+	template<typename T>
+	std::vector<int> escapeCountsOf(const MandelbrotView& view, int width, int height, int sampleCount, int maxLimit, int& limit, int& samplesTaken) {
+		int columns = std::max(1, (int)std::sqrt((double)sampleCount * width / height));
+		int rows = std::max(1, sampleCount / columns);
+
+		// sample the middle of each grid cell so none of them land on the edge of the image
+		std::vector<Sample<T>> samples;
+		samples.reserve((size_t)columns * rows);
+		for (int row = 0; row < rows; row++) {
+			T y0 = planeY<T>(view, (row + 0.5) * height / rows, height);
+			for (int column = 0; column < columns; column++) {
+				T x0 = planeX<T>(view, (column + 0.5) * width / columns, width);
+				if (view.julia)
+					samples.push_back({ view.juliaX, view.juliaY, x0, y0, 0, x0, y0, 1, false });
+				else
+					samples.push_back({ x0, y0, 0.0, 0.0, 0, 0.0, 0.0, 1, false });
+			}
+		}
+
+		int threadCount = Parallel::defaultThreadCount();
+		int chunkCount = std::min((int)samples.size(), threadCount * 4);
+		limit = 256;
+
+		for (;;) {
+			auto itterateAll = [&](const auto& step) {
+				Parallel::forEach(chunkCount, threadCount, [&](int c) {
+					size_t begin = samples.size() * c / chunkCount;
+					size_t end = samples.size() * (c + 1) / chunkCount;
+					for (size_t i = begin; i < end; i++)
+						itterateTo(samples[i], limit, step);
+				});
+			};
+
+			if (view.formula == MandelbrotView::Formula::Custom) {
+				if constexpr (std::is_same<T, double>::value) {
+					if (view.program)
+						itterateAll([&](double x, double y, double cx, double cy, double& nx, double& ny) { view.program->step(x, y, cx, cy, nx, ny); });
+				}
+			}
+			else {
+				Formulas::dispatch(view, [&](auto formula, auto) {
+					itterateAll([](T x, T y, const T& cx, const T& cy, T& nx, T& ny) { decltype(formula)::step(x, y, cx, cy, nx, ny); });
+				});
+			}
+
+			// if a real share of the samples only escaped in the top half of the limit, or are still undecided, the boundary has not been resolved yet
+			size_t late = 0, undecided = 0;
+			for (const Sample<T>& s : samples) {
+				if (escaped(s) && s.itter > limit / 2)
+					late++;
+				else if (!escaped(s) && !s.inside)
+					undecided++;
+			}
+
+			if ((late * 500 <= samples.size() && undecided * 100 <= samples.size()) || limit >= maxLimit)
+				break;
+
+			limit = (int)std::min((long long)limit * 2, (long long)maxLimit);
+		}
+
+		std::vector<int> escapeCounts;
+		for (const Sample<T>& s : samples)
+			if (escaped(s))
+				escapeCounts.push_back(s.itter);
+
+		samplesTaken = (int)samples.size();
+		return escapeCounts;
+	}
+
+}
+
+ItterationEstimator::Estimate ItterationEstimator::estimate(const MandelbrotView& view, int width, int height, int sampleCount, int maxLimit)
+{
+	// the samples are placed and itterated in the same precision the renderer uses for the view, custom formulas only run in doubles
+	int limit = 0, samples = 0;
+	std::vector<int> escapeCounts;
+	if (view.formula != MandelbrotView::Formula::Custom && MandelbrotCPU::precisionFor(view, width, height) != MandelbrotCPU::Precision::Double)
+		escapeCounts = escapeCountsOf<DoubleDouble>(view, width, height, sampleCount, maxLimit, limit, samples);
+	else
+		escapeCounts = escapeCountsOf<double>(view, width, height, sampleCount, maxLimit, limit, samples);
+
+	Estimate estimate;
+	estimate.limit = limit;
+	estimate.samples = samples;
+	estimate.insideFraction = samples == 0 ? 0.0f : 1.0f - (float)escapeCounts.size() / samples;
+
+	// 99.5% of the escaping samples get their own color, plus some headroom for the pixels between the samples
+	int slowest = 0;
+	if (!escapeCounts.empty()) {
+		size_t index = std::min(escapeCounts.size() - 1, escapeCounts.size() * 995 / 1000);
+		std::nth_element(escapeCounts.begin(), escapeCounts.begin() + index, escapeCounts.end());
+		slowest = escapeCounts[index];
+	}
+
+	// rounded up to a multiple of 10 so it still lines up with the 9 / 0 keys
+	long long chosen = (long long)slowest * 5 / 4;
+	chosen = (chosen + 9) / 10 * 10;
+	estimate.maxItter = (int)std::min(std::max(chosen, 100LL), (long long)maxLimit);
+
+	return estimate;
+}
+
+bool ItterationEstimator::worthChanging(int current, int suggested)
+{
+	return suggested * 4 > current * 5 || suggested * 5 < current * 4;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+
+// picks maxItter for a view from a sparse grid of sample points, so deep zooms do not need dozens of presses of 0 to show detail
+// the samples are itterated with a limit that doubles until almost none of them escape in the top half of it,
+// then maxItter is set just above the slowest escaping samples (the ones right next to the boundary)
+namespace ItterationEstimator {
+
+	struct Estimate {
+		int maxItter = 0;
+		float insideFraction = 0.0f; // fraction of the samples that never escaped, these are in the set (or need more than 'limit')
+		int limit = 0;               // the highest limit the samples were itterated to
+		int samples = 0;
+	};
+
+	// about 'sampleCount' points are spread over the view in a grid with the same aspect ratio as width x height
+	Estimate estimate(const MandelbrotView& view, int width, int height, int sampleCount = 2048, int maxLimit = 1 << 20);
+
+	// true if 'suggested' is far enough from 'current' to be worth a rerender, small changes are ignored so the value does not flicker while panning
+	bool worthChanging(int current, int suggested);
+
+}
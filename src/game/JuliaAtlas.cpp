@@ -0,0 +1,69 @@
+#include "game/JuliaAtlas.h"
+#include "game/Palette.h"
+#include "engine/PngWriter.h"
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <vector>
+
+void JuliaAtlas::renderRows(const MandelbrotView& view, const Layout& layout, int rowBegin, int rowEnd, int* itters)
+{
+	int width = layout.getWidth();
+
+	MandelbrotView thumb;
+	thumb.camX = 0.0;
+	thumb.camY = 0.0;
+	thumb.camZoom = layout.juliaZoom;
+
+	// the starting z of a column inside its thumbnail is the same for every thumbnail, as is the c of a column of thumbnails
+	std::vector<double> zx(width), cx(width), zy(width), cy(width);
+	for (int x = 0; x < width; x++) {
+		zx[x] = MandelbrotCPU::pixelToPlaneX(thumb, x % layout.thumbWidth, layout.thumbWidth);
+		cx[x] = MandelbrotCPU::pixelToPlaneX(view, x / layout.thumbWidth + 0.5, layout.columns);
+	}
+
+	for (int row = rowBegin; row < rowEnd; row++) {
+		// image rows go from the top down and y = 0 of a view is the bottom
+		int thumbRow = row / layout.thumbHeight;
+		double rowZ = MandelbrotCPU::pixelToPlaneY(thumb, layout.thumbHeight - 1 - row % layout.thumbHeight, layout.thumbHeight);
+		double rowC = MandelbrotCPU::pixelToPlaneY(view, layout.rows - 1 - thumbRow + 0.5, layout.rows);
+		std::fill(zy.begin(), zy.end(), rowZ);
+		std::fill(cy.begin(), cy.end(), rowC);
+
+		MandelbrotCPU::renderPoints(view, &zx[0], &zy[0], &cx[0], &cy[0], width, itters + (size_t)(row - rowBegin) * width);
+	}
+}
+
+bool JuliaAtlas::exportPng(const std::string& filepath, const MandelbrotView& view, const Layout& layout)
+{
+	int width = layout.getWidth();
+	int height = layout.getHeight();
+
+	PngWriter png(filepath, width, height, 4);
+	if (!png.isOpen())
+		return false;
+
+	Palette palette;
+	palette.update(view.maxItter, view.colorShiftFactor);
+
+	// one band of rows at a time keeps the memory use flat however big the atlas is
+	const int bandHeight = 64;
+	const int rowsPerJob = 4;
+	std::vector<int> itters((size_t)width * bandHeight);
+	std::vector<uint8_t> pixels((size_t)width * bandHeight * 4);
+
+	for (int top = 0; top < height; top += bandHeight) {
+		int rows = std::min(bandHeight, height - top);
+
+		Parallel::forEach((rows + rowsPerJob - 1) / rowsPerJob, Parallel::defaultThreadCount(), [&](int job) {
+			int begin = job * rowsPerJob;
+			int end = std::min(begin + rowsPerJob, rows);
+			renderRows(view, layout, top + begin, top + end, &itters[(size_t)begin * width]);
+			palette.colorize(&itters[(size_t)begin * width], (size_t)(end - begin) * width, &pixels[(size_t)begin * width * 4]);
+		});
+
+		png.writeRows(&pixels[0], rows);
+	}
+
+	return png.finish();
+}
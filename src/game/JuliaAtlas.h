@@ -0,0 +1,34 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+
+#include <string>
+
+// a grid of julia set thumbnails, one for every c on a columns x rows grid over the part of the plane a view looks at
+// the whole atlas is rendered as one image: every row of it runs through the kernel at once, so neighbouring simd lanes
+// hold pixels of different julia sets and the setup and buffers are paid for once per atlas instead of once per thumbnail
+namespace JuliaAtlas {
+
+	struct Layout {
+		int columns = 42;
+		int rows = 24;
+
+		// 7:4 like the main view so the thumbnails are not stretched
+		int thumbWidth = 140;
+		int thumbHeight = 80;
+
+		// zoom of the view inside every thumbnail, centered on 0
+		double juliaZoom = 1.0;
+
+		int getWidth() const { return columns * thumbWidth; }
+		int getHeight() const { return rows * thumbHeight; }
+	};
+
+	// escape counts of atlas rows [rowBegin, rowEnd) counted from the top, getWidth() values per row
+	// 'view' gives the c grid (camX, camY, camZoom), the formula and maxItter
+	void renderRows(const MandelbrotView& view, const Layout& layout, int rowBegin, int rowEnd, int* itters);
+
+	// renders the atlas on every core and streams it into a png, returns false if the file could not be written
+	bool exportPng(const std::string& filepath, const MandelbrotView& view, const Layout& layout);
+
+}
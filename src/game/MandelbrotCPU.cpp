@@ -0,0 +1,301 @@
+#include "game/MandelbrotCPU.h"
+#include "game/Formulas.h"
+#include "game/FormulaProgram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+bool MandelbrotView::sameItterations(const MandelbrotView& other) const
+{
+	return camX == other.camX && camY == other.camY && camXLow == other.camXLow && camYLow == other.camYLow && camZoom == other.camZoom &&
+		maxItter == other.maxItter && sameFormula(other);
+}
+
+bool MandelbrotView::sameFormula(const MandelbrotView& other) const
+{
+	if (formula != other.formula || julia != other.julia)
+		return false;
+	if (formula == Formula::Multibrot && power != other.power)
+		return false;
+	if (formula == Formula::Custom && (!program || !other.program || program->getSource() != other.program->getSource()))
+		return false;
+
+	return !julia || (juliaX == other.juliaX && juliaY == other.juliaY);
+}
+
+void MandelbrotView::pan(double dx, double dy)
+{
+	DoubleDouble x = DoubleDouble(camX, camXLow) + dx;
+	DoubleDouble y = DoubleDouble(camY, camYLow) + dy;
+	camX = x.hi;
+	camXLow = x.lo;
+	camY = y.hi;
+	camYLow = y.lo;
+}
+
+namespace {
+
+	const int lanes = 4;
+
+	// pixelToPlaneX and Y with the low parts of the center, the offset from it is small enough to work out in doubles
+	template<typename T>
+	T planeX(const MandelbrotView& view, double px, int width) {
+		if constexpr (std::is_same<T, double>::value)
+			return MandelbrotCPU::pixelToPlaneX(view, px, width);
+		else
+			return DoubleDouble(view.camX, view.camXLow) + ((px / width) * 3.5 - 1.75) * view.camZoom;
+	}
+
+	template<typename T>
+	T planeY(const MandelbrotView& view, double py, int height) {
+		if constexpr (std::is_same<T, double>::value)
+			return MandelbrotCPU::pixelToPlaneY(view, py, height);
+		else
+			return DoubleDouble(view.camY, view.camYLow) + ((py / height) * 2.0 - 1.0) * view.camZoom;
+	}
+
+	template<typename Formula, typename Trap>
+	void renderPointsWith(const MandelbrotView& view, const double* zx, const double* zy, const double* cx, const double* cy, int count, int* itters, float* smooth,
+		const Trap& trap, float* trapDistances) {
+		for (int i = 0; i < count; i += lanes) {
+			int n = std::min(lanes, count - i);
+
+			// a partial group repeats its last point in the spare lanes like renderRowWith
+			double x[lanes], y[lanes], c0[lanes], c1[lanes];
+			for (int l = 0; l < lanes; l++) {
+				int p = i + std::min(l, n - 1);
+				x[l] = zx[p];
+				y[l] = zy[p];
+				c0[l] = cx[p];
+				c1[l] = cy[p];
+			}
+
+			int laneItters[lanes];
+			float laneSmooth[lanes], laneTraps[lanes];
+			Formulas::escapeCountsOfPoints<Formula, lanes, Trap>(x, y, c0, c1, view.maxItter, laneItters, smooth ? laneSmooth : nullptr, trap, laneTraps);
+
+			for (int l = 0; l < n; l++) {
+				itters[i + l] = laneItters[l];
+				if (smooth)
+					smooth[i + l] = laneSmooth[l];
+				if constexpr (Trap::tracked)
+					trapDistances[i + l] = laneTraps[l];
+			}
+		}
+	}
+
+	template<typename Formula, bool Julia, typename Trap, typename T>
+	void renderRowWith(const MandelbrotView& view, int width, int height, int y, int xBegin, int xEnd, int* itters, float* smooth, const Trap& trap, float* trapDistances) {
+		T y0 = planeY<T>(view, y, height);
+
+		for (int x = xBegin; x < xEnd; x += lanes) {
+			int count = std::min(lanes, xEnd - x);
+
+			// a partial group repeats its last pixel in the spare lanes and only keeps the real ones
+			T x0[lanes];
+			for (int l = 0; l < lanes; l++)
+				x0[l] = planeX<T>(view, x + std::min(l, count - 1), width);
+
+			int laneItters[lanes];
+			float laneSmooth[lanes], laneTraps[lanes];
+			Formulas::escapeCounts<Formula, Julia, lanes, Trap, T>(x0, y0, view.juliaX, view.juliaY, view.maxItter, laneItters, smooth ? laneSmooth : nullptr, trap, laneTraps);
+
+			for (int l = 0; l < count; l++) {
+				itters[x - xBegin + l] = laneItters[l];
+				if (smooth)
+					smooth[x - xBegin + l] = laneSmooth[l];
+				if constexpr (Trap::tracked)
+					trapDistances[x - xBegin + l] = laneTraps[l];
+			}
+		}
+	}
+
+}
+
+int MandelbrotCPU::mandelbrotAt(double x, double y, int maxItter)
+{
+	double x0 = x;
+	double y0 = y;
+
+	double x1 = 0, y1 = 0;
+	int itter = 0;
+
+	while (x1 * x1 + y1 * y1 <= 2 * 2 && itter < maxItter) {
+		double xTemp = (x1 * x1) - (y1 * y1) + x0;
+		y1 = 2 * x1 * y1 + y0;
+		x1 = xTemp;
+		itter++;
+	}
+
+	return itter;
+}
+
+float MandelbrotCPU::mandelbrotSmoothAt(double x, double y, int maxItter)
+{
+	double x0 = x;
+	double y0 = y;
+
+	double x1 = 0, y1 = 0;
+	int itter = 0;
+
+	while (x1 * x1 + y1 * y1 <= 2 * 2 && itter < maxItter) {
+		double xTemp = (x1 * x1) - (y1 * y1) + x0;
+		y1 = 2 * x1 * y1 + y0;
+		x1 = xTemp;
+		itter++;
+	}
+
+	if (itter >= maxItter)
+		return (float)maxItter;
+
+	double logZ = log(x1 * x1 + y1 * y1) / 2.0;
+	double smooth = itter + 1 - log(logZ / log(2.0)) / log(2.0);
+	return (float)std::min(std::max(smooth, 0.0), (double)maxItter);
+}
+
+std::array<float, 3> MandelbrotCPU::colorRotator(float colorShift, float colorShiftFactor)
+{
+	colorShift *= colorShiftFactor;
+
+	float r = 1.0f - (cos(colorShift * 3.14159f * 1.0f) + 1.0f) / 2.0f;
+	float g = 1.0f - (cos(colorShift * 3.14159f * 3.0f) + 1.0f) / 2.0f;
+	float b = 1.0f - (cos(colorShift * 3.14159f * 5.0f) + 1.0f) / 2.0f;
+
+	return { r, g, b };
+}
+
+double MandelbrotCPU::pixelToPlaneX(const MandelbrotView& view, double px, int width)
+{
+	double x0 = px / width;
+	x0 *= 3.5;
+	x0 -= 1.75;
+	x0 *= view.camZoom;
+	return x0 + view.camX;
+}
+
+double MandelbrotCPU::pixelToPlaneY(const MandelbrotView& view, double py, int height)
+{
+	double y0 = py / height;
+	y0 *= 2.0;
+	y0 -= 1.0;
+	y0 *= view.camZoom;
+	return y0 + view.camY;
+}
+
+MandelbrotCPU::Precision MandelbrotCPU::precisionFor(const MandelbrotView& view, int width, int height)
+{
+	// orbits are compared against |z| <= 2, so neighbouring pixels have to differ at that scale as well as at the center's
+	double magnitude = std::max({ std::abs(view.camX), std::abs(view.camY), 2.0 });
+	double pixel = std::min(3.5 / width, 2.0 / height) * view.camZoom;
+
+	// a few dozen ulps per pixel leave the orbits room to lose some before pixels visibly merge
+	if (pixel > std::ldexp(magnitude, -46))
+		return Precision::Double;
+	if (pixel > std::ldexp(magnitude, -98))
+		return Precision::DoubleDouble;
+	return Precision::Beyond;
+}
+
+void MandelbrotCPU::renderPoints(const MandelbrotView& view, const double* zx, const double* zy, const double* cx, const double* cy, int count, int* itters, float* smooth,
+	const OrbitTrap* trap, float* trapDistances)
+{
+	OrbitTrap noTrap;
+	if (!trap || !trapDistances)
+		trap = &noTrap;
+
+	if (view.formula == MandelbrotView::Formula::Custom) {
+		if (view.program) {
+			view.program->escapeCountsOfPoints(zx, zy, cx, cy, view.maxItter, count, itters, smooth, trap, trapDistances);
+		}
+		else {
+			std::fill(itters, itters + count, 0);
+			if (trap->shape != OrbitTrap::Shape::None)
+				std::fill(trapDistances, trapDistances + count, 0.0f);
+		}
+		return;
+	}
+
+	OrbitTraps::dispatch(*trap, [&](const auto& trapPolicy) {
+		Formulas::dispatchFormula<false>(view, [&](auto formula, auto) {
+			renderPointsWith<decltype(formula)>(view, zx, zy, cx, cy, count, itters, smooth, trapPolicy, trapDistances);
+		});
+	});
+}
+
+bool MandelbrotCPU::renderItterations(const MandelbrotView& view, int width, int height, int* itters, int rowBegin, int rowEnd, const std::atomic<bool>* cancel)
+{
+	for (int y = rowBegin; y < rowEnd; y++) {
+		if (cancel && cancel->load(std::memory_order_relaxed))
+			return false;
+
+		renderRow(view, width, height, y, 0, width, itters + (size_t)y * width);
+	}
+
+	return true;
+}
+
+void MandelbrotCPU::renderRow(const MandelbrotView& view, int width, int height, int y, int xBegin, int xEnd, int* itters, float* smooth,
+	const OrbitTrap* trap, float* trapDistances)
+{
+	OrbitTrap noTrap;
+	if (!trap || !trapDistances)
+		trap = &noTrap;
+
+	if (view.formula == MandelbrotView::Formula::Custom) {
+		if (!view.program) {
+			std::fill(itters, itters + (xEnd - xBegin), 0);
+			if (trap->shape != OrbitTrap::Shape::None)
+				std::fill(trapDistances, trapDistances + (xEnd - xBegin), 0.0f);
+			return;
+		}
+
+		// kept per thread so rows do not allocate, it only grows to the widest row the thread has rendered
+		thread_local std::vector<double> x0;
+		x0.resize(xEnd - xBegin);
+		for (int x = xBegin; x < xEnd; x++)
+			x0[x - xBegin] = pixelToPlaneX(view, x, width);
+
+		view.program->escapeCounts(&x0[0], pixelToPlaneY(view, y, height), view.julia, view.juliaX, view.juliaY, view.maxItter, xEnd - xBegin, itters, smooth,
+			trap, trapDistances);
+		return;
+	}
+
+	// the trap is a third template parameter of the kernel so rows without one run exactly the loop they did before
+	// deeper views get the same loop again in DoubleDouble, which is only instantiated once per formula and never slows the double one down
+	bool precise = precisionFor(view, width, height) != Precision::Double;
+	OrbitTraps::dispatch(*trap, [&](const auto& trapPolicy) {
+		Formulas::dispatch(view, [&](auto formula, auto julia) {
+			if (precise)
+				renderRowWith<decltype(formula), decltype(julia)::value, std::decay_t<decltype(trapPolicy)>, DoubleDouble>(view, width, height, y, xBegin, xEnd, itters, smooth,
+					trapPolicy, trapDistances);
+			else
+				renderRowWith<decltype(formula), decltype(julia)::value, std::decay_t<decltype(trapPolicy)>, double>(view, width, height, y, xBegin, xEnd, itters, smooth,
+					trapPolicy, trapDistances);
+		});
+	});
+}
+
+void MandelbrotCPU::colorizeRGBA8(const int* itters, size_t pixelCount, int maxItter, float colorShiftFactor, uint8_t* rgba)
+{
+	for (size_t i = 0; i < pixelCount; i++) {
+		float man = (float)itters[i] / (float)maxItter;
+		std::array<float, 3> color = colorRotator(man, colorShiftFactor);
+		rgba[i * 4 + 0] = (uint8_t)(color[0] * 255.0f + 0.5f);
+		rgba[i * 4 + 1] = (uint8_t)(color[1] * 255.0f + 0.5f);
+		rgba[i * 4 + 2] = (uint8_t)(color[2] * 255.0f + 0.5f);
+		rgba[i * 4 + 3] = 255;
+	}
+}
+
+void MandelbrotCPU::colorizeTrapsRGBA8(const float* trapDistances, size_t pixelCount, float trapScale, float colorShiftFactor, uint8_t* rgba)
+{
+	for (size_t i = 0; i < pixelCount; i++) {
+		float man = 1.0f - std::exp(-trapDistances[i] / trapScale);
+		std::array<float, 3> color = colorRotator(man, colorShiftFactor);
+		rgba[i * 4 + 0] = (uint8_t)(color[0] * 255.0f + 0.5f);
+		rgba[i * 4 + 1] = (uint8_t)(color[1] * 255.0f + 0.5f);
+		rgba[i * 4 + 2] = (uint8_t)(color[2] * 255.0f + 0.5f);
+		rgba[i * 4 + 3] = 255;
+	}
+}
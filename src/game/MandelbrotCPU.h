@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class FormulaProgram;
+struct OrbitTrap;
+
+// everything needed to reproduce one rendered view of the set
+struct MandelbrotView {
+	// the policies in game/Formulas.h, or a FormulaProgram compiled at runtime
+	enum class Formula { Mandelbrot, Multibrot, BurningShip, Tricorn, Custom };
+
+	double camX = -0.5;
+	double camY = 0.0;
+	double camZoom = 1.0;
+
+	// the rest of the center below what camX and camY can hold, so the two make a DoubleDouble
+	// they stay 0 until a ViewState or pan() puts the digits a double rounds off there, only tiers past Double read them
+	double camXLow = 0.0;
+	double camYLow = 0.0;
+
+	int maxItter = 300;
+	float colorShiftFactor = 2.0f;
+
+	Formula formula = Formula::Mandelbrot;
+	int power = 3; // only used by Multibrot, from 3 to 8
+	std::shared_ptr<const FormulaProgram> program; // only used by Custom
+
+	// in julia mode every pixel is a starting z and c is fixed
+	bool julia = false;
+	double juliaX = -0.8;
+	double juliaY = 0.156;
+
+	// true if both views produce the same itteration data (color shift is only applied when colorizing)
+	bool sameItterations(const MandelbrotView& other) const;
+
+	// true if both views itterate the same function, whatever part of the plane they look at
+	bool sameFormula(const MandelbrotView& other) const;
+
+	// moves the center by (dx, dy) in DoubleDouble so small steps are not lost when deeply zoomed in
+	void pan(double dx, double dy);
+};
+
+// cpu implementation of the mandelbrot algorithm, none of these functions touch opengl so they are safe to call from worker threads
+namespace MandelbrotCPU {
+
+	int mandelbrotAt(double x, double y, int maxItter);
+
+	// fractional escape count (n + 1 - log2(log|z|)) for smooth coloring, points that never escape return maxItter
+	float mandelbrotSmoothAt(double x, double y, int maxItter);
+
+	std::array<float, 3> colorRotator(float colorShift, float colorShiftFactor);
+
+	// maps a pixel of a width x height image onto the complex plane, pixel (0, 0) is the bottom left corner
+	double pixelToPlaneX(const MandelbrotView& view, double px, int width);
+	double pixelToPlaneY(const MandelbrotView& view, double py, int height);
+
+	// the number type renderRow uses for a view, it only changes tier when neighbouring pixels get too close together for the one before
+	// a double lasts to a zoom of about 10^11, DoubleDouble (many times slower) to about 10^26, past that pixels merge into blocks again
+	// custom formulas and everything else that renders points (nebulabrot, julia atlas, estimates) always use doubles
+	enum class Precision { Double, DoubleDouble, Beyond };
+	Precision precisionFor(const MandelbrotView& view, int width, int height);
+
+	// escape counts of pixels [xBegin, xEnd) of row 'y' of a width x height image using the view's formula, written to itters[0 .. xEnd - xBegin)
+	// every formula goes through the same simd kernel, 'smooth' optionally gets the fractional counts too
+	// and with a trap 'trapDistances' gets how close each orbit came to it, worked out in the same loop
+	void renderRow(const MandelbrotView& view, int width, int height, int y, int xBegin, int xEnd, int* itters, float* smooth = nullptr,
+		const OrbitTrap* trap = nullptr, float* trapDistances = nullptr);
+
+	// escape counts of 'count' unrelated points using the view's formula (its julia settings are ignored), each with its own starting z and c
+	// for batches that mix pixels of many different julia sets in the same simd lanes
+	void renderPoints(const MandelbrotView& view, const double* zx, const double* zy, const double* cx, const double* cy, int count, int* itters, float* smooth = nullptr,
+		const OrbitTrap* trap = nullptr, float* trapDistances = nullptr);
+
+	// fills rows [rowBegin, rowEnd) of 'itters' (width * height values) with escape counts
+	// returns false without finishing if 'cancel' becomes true part way through, it is checked once per row
+	bool renderItterations(const MandelbrotView& view, int width, int height, int* itters, int rowBegin, int rowEnd, const std::atomic<bool>* cancel = nullptr);
+
+	// converts escape counts into 8 bit rgba, 4 bytes per pixel, for an RGBA8 texture or writing straight to an image file
+	void colorizeRGBA8(const int* itters, size_t pixelCount, int maxItter, float colorShiftFactor, uint8_t* rgba);
+
+	// colors trap distances the same way, a distance of 0 is the start of the color cycle and 'trapScale' sets how fast it moves away from it
+	// only needs the stored distances so the trap colors can be changed without itterating again
+	void colorizeTrapsRGBA8(const float* trapDistances, size_t pixelCount, float trapScale, float colorShiftFactor, uint8_t* rgba);
+
+}
@@ -0,0 +1,112 @@
+#include "game/NavigationHistory.h"
+#include "game/EscapeDataCodec.h"
+
+#include <cstdlib>
+
+NavigationHistory::NavigationHistory(size_t memoryBudgetBytes) :
+	memoryBudget(memoryBudgetBytes)
+{
+}
+
+void NavigationHistory::leave(const MandelbrotView& view, const std::vector<int>* itters, int width, int height)
+{
+	while ((int)entries.size() > position + 1) {
+		memoryUsage -= entries.back().compressedItters.size();
+		entries.pop_back();
+	}
+
+	if (position == (int)entries.size())
+		entries.emplace_back();
+
+	store(entries[position], view, itters, width, height);
+	position++;
+
+	enforceBudget();
+}
+
+const NavigationHistory::Entry* NavigationHistory::back(const MandelbrotView& current, const std::vector<int>* itters, int width, int height)
+{
+	if (position == 0)
+		return nullptr;
+
+	if (position == (int)entries.size()) {
+		entries.emplace_back();
+		store(entries[position], current, itters, width, height);
+		enforceBudget();
+	}
+
+	position--;
+	return &entries[position];
+}
+
+const NavigationHistory::Entry* NavigationHistory::forward()
+{
+	if (position + 1 >= (int)entries.size())
+		return nullptr;
+
+	position++;
+	return &entries[position];
+}
+
+bool NavigationHistory::decompress(const Entry& entry, int width, int height, std::vector<int>& itters)
+{
+	if (entry.compressedItters.empty() || entry.width != width || entry.height != height)
+		return false;
+
+	itters.resize((size_t)width * height);
+	return EscapeDataCodec::decompress(&entry.compressedItters[0], entry.compressedItters.size(), &itters[0], itters.size());
+}
+
+int NavigationHistory::getPosition()
+{
+	return position;
+}
+
+int NavigationHistory::getSize()
+{
+	return (int)entries.size();
+}
+
+size_t NavigationHistory::getMemoryUsage()
+{
+	return memoryUsage;
+}
+
+void NavigationHistory::store(Entry& entry, const MandelbrotView& view, const std::vector<int>* itters, int width, int height)
+{
+	bool sameItterations = entry.view.sameItterations(view) && entry.width == width && entry.height == height;
+	entry.view = view;
+
+	// the color shift factor is not part of the escape data so revisiting an entry with a new color keeps its buffer
+	if (sameItterations && !entry.compressedItters.empty())
+		return;
+
+	memoryUsage -= entry.compressedItters.size();
+	entry.compressedItters.clear();
+	if (!itters)
+		return;
+
+	EscapeDataCodec::compress(&(*itters)[0], itters->size(), entry.compressedItters);
+	entry.compressedItters.shrink_to_fit();
+	entry.width = width;
+	entry.height = height;
+	memoryUsage += entry.compressedItters.size();
+}
+
+void NavigationHistory::enforceBudget()
+{
+	while (memoryUsage > memoryBudget) {
+		int furthest = -1;
+		for (int i = 0; i < (int)entries.size(); i++) {
+			if (!entries[i].compressedItters.empty() && (furthest == -1 || std::abs(i - position) > std::abs(furthest - position)))
+				furthest = i;
+		}
+
+		if (furthest == -1)
+			return;
+
+		memoryUsage -= entries[furthest].compressedItters.size();
+		entries[furthest].compressedItters.clear();
+		entries[furthest].compressedItters.shrink_to_fit();
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+
+#include <cstdint>
+#include <vector>
+
+// back / forward history of visited views
+// each entry can also hold a compressed copy of its itteration buffer so returning to it is a decompress and recolor instead of a full render
+// compressed buffers are dropped oldest first (furthest from the current position) once the memory budget is exceeded, the view itself is always kept
+class NavigationHistory {
+public:
+	struct Entry {
+		MandelbrotView view;
+		int width = 0, height = 0;
+		std::vector<uint8_t> compressedItters; // empty if the itterations were never known or were evicted
+	};
+
+	NavigationHistory(size_t memoryBudgetBytes = 64 * 1024 * 1024);
+
+	// call before moving away from 'view', forward entries are discarded like in a web browser
+	// itters may be nullptr if the escape data of the view is not available (it is width * height values)
+	void leave(const MandelbrotView& view, const std::vector<int>* itters, int width, int height);
+
+	// steps backwards, 'current' is recorded first so that forward() can return to it
+	// returns nullptr if there is nowhere to go back to
+	const Entry* back(const MandelbrotView& current, const std::vector<int>* itters, int width, int height);
+	const Entry* forward();
+
+	// returns false if the entry has no stored itterations or they are a different size
+	bool decompress(const Entry& entry, int width, int height, std::vector<int>& itters);
+
+	int getPosition();
+	int getSize();
+	size_t getMemoryUsage();
+
+private:
+	void store(Entry& entry, const MandelbrotView& view, const std::vector<int>* itters, int width, int height);
+	void enforceBudget();
+
+	std::vector<Entry> entries;
+	int position = 0; // index of the entry being displayed, equal to entries.size() if the displayed view is not recorded yet
+
+	size_t memoryBudget;
+	size_t memoryUsage = 0;
+};
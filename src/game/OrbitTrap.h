@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cmath>
+
+// orbit traps color a point by how close its orbit comes to a shape, instead of by how fast it escapes
+// the closest distance is tracked inside the escape loop itself (Formulas::escapeCountsOfPoints and FormulaProgram) so it costs a few
+// instructions per itteration and no second pass over the orbit, and it is kept next to the escape counts so recoloring never itterates again
+struct OrbitTrap {
+	enum class Shape { None, Point, Line, Cross, Circle };
+
+	Shape shape = Shape::None;
+	double x = 0.0, y = 0.0; // the point, a point on the line, where the arms of the cross meet or the centre of the circle
+	double angle = 0.0;      // direction of the line in radians
+	double radius = 0.5;     // circle only
+};
+
+// the shapes as policies for the escape kernels, constructed once per batch so anything that needs a sin or cos is worked out up front
+// measure() is branch free so the lane loops that call it still vectorize, it only has to rise and fall with the distance (a point trap
+// compares squared distances) and distance() turns the smallest one into the real distance once the orbit is done
+namespace OrbitTraps {
+
+	struct None {
+		static constexpr bool tracked = false;
+		None() {}
+		None(const OrbitTrap&) {}
+		double measure(double, double) const { return 0.0; }
+		double distance(double) const { return 0.0; }
+	};
+
+	struct Point {
+		static constexpr bool tracked = true;
+		double px, py;
+		Point(const OrbitTrap& trap) : px(trap.x), py(trap.y) {}
+		double measure(double x, double y) const { return (x - px) * (x - px) + (y - py) * (y - py); }
+		double distance(double measured) const { return std::sqrt(measured); }
+	};
+
+	struct Line {
+		static constexpr bool tracked = true;
+		double px, py, nx, ny; // nx, ny is the unit normal of the line
+		Line(const OrbitTrap& trap) : px(trap.x), py(trap.y), nx(-std::sin(trap.angle)), ny(std::cos(trap.angle)) {}
+		double measure(double x, double y) const { return std::abs((x - px) * nx + (y - py) * ny); }
+		double distance(double measured) const { return measured; }
+	};
+
+	// two lines parallel to the axes
+	struct Cross {
+		static constexpr bool tracked = true;
+		double px, py;
+		Cross(const OrbitTrap& trap) : px(trap.x), py(trap.y) {}
+		double measure(double x, double y) const {
+			double dx = std::abs(x - px), dy = std::abs(y - py);
+			return dx < dy ? dx : dy;
+		}
+		double distance(double measured) const { return measured; }
+	};
+
+	struct Circle {
+		static constexpr bool tracked = true;
+		double px, py, r;
+		Circle(const OrbitTrap& trap) : px(trap.x), py(trap.y), r(trap.radius) {}
+		// |d - r| itself, |d^2 - r^2| would save the sqrt but it is |d - r| * (d + r) and ranks points inside the circle too close
+		double measure(double x, double y) const { return std::abs(std::sqrt((x - px) * (x - px) + (y - py) * (y - py)) - r); }
+		double distance(double measured) const { return measured; }
+	};
+
+	// calls fn(Trap(trap)) with the policy of the trap's shape, like Formulas::dispatchFormula the shape is switched on once outside the loop
+	template<typename Fn>
+	void dispatch(const OrbitTrap& trap, Fn&& fn) {
+		switch (trap.shape) {
+		case OrbitTrap::Shape::None: fn(None(trap)); break;
+		case OrbitTrap::Shape::Point: fn(Point(trap)); break;
+		case OrbitTrap::Shape::Line: fn(Line(trap)); break;
+		case OrbitTrap::Shape::Cross: fn(Cross(trap)); break;
+		case OrbitTrap::Shape::Circle: fn(Circle(trap)); break;
+		}
+	}
+
+}
@@ -0,0 +1,278 @@
+#include "game/Palette.h"
+#include "game/MandelbrotCPU.h"
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define PALETTE_HAS_AVX2_PATH
+#define PALETTE_AVX2_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PALETTE_HAS_AVX2_PATH
+#define PALETTE_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+#ifdef PALETTE_HAS_AVX2_PATH
+	bool cpuHasAVX2() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		bool avx2 = (info[1] & (1 << 5)) != 0;
+
+		// the os also has to save the ymm registers
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		return avx2 && osxsave && (_xgetbv(0) & 6) == 6;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	// 8 pixels per step: clamp the counts, gather their colors from the table and store 32 bytes
+	PALETTE_AVX2_TARGET size_t colorizeAVX2(const int* itters, size_t count, const uint32_t* table, int maxItter, uint8_t* rgba) {
+		const __m256i low = _mm256_setzero_si256();
+		const __m256i high = _mm256_set1_epi32(maxItter);
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256i index = _mm256_loadu_si256((const __m256i*)(itters + i));
+			index = _mm256_min_epi32(_mm256_max_epi32(index, low), high);
+			__m256i colors = _mm256_i32gather_epi32((const int*)table, index, 4);
+			_mm256_storeu_si256((__m256i*)(rgba + i * 4), colors);
+		}
+
+		return i;
+	}
+#endif
+
+	uint32_t packColor(float colorShift, float colorShiftFactor) {
+		std::array<float, 3> color = MandelbrotCPU::colorRotator(colorShift, colorShiftFactor);
+
+		uint8_t rgba[4] = {
+			(uint8_t)(color[0] * 255.0f + 0.5f),
+			(uint8_t)(color[1] * 255.0f + 0.5f),
+			(uint8_t)(color[2] * 255.0f + 0.5f),
+			255
+		};
+
+		uint32_t packed;
+		memcpy(&packed, rgba, 4);
+		return packed;
+	}
+
+}
+
+Palette::Palette()
+{
+}
+
+void Palette::update(int maxItter, float colorShiftFactor)
+{
+	if (mode == Mode::Linear && maxItter == this->maxItter && colorShiftFactor == this->colorShiftFactor)
+		return;
+
+	mode = Mode::Linear;
+	// colorizeRGBA8 divides by it, so at least one
+	this->maxItter = std::max(maxItter, 1);
+	this->colorShiftFactor = colorShiftFactor;
+
+	std::vector<int> counts(this->maxItter + 1);
+	for (int i = 0; i <= this->maxItter; i++)
+		counts[i] = i;
+
+	table.resize(this->maxItter + 1);
+	MandelbrotCPU::colorizeRGBA8(&counts[0], counts.size(), this->maxItter, colorShiftFactor, (uint8_t*)&table[0]);
+
+	version++;
+}
+
+void Palette::updateHistogram(const int* itters, size_t count, int maxItter, float colorShiftFactor, int threadCount)
+{
+	mode = Mode::Histogram;
+	this->maxItter = std::max(maxItter, 1);
+	this->colorShiftFactor = colorShiftFactor;
+
+	if (threadCount <= 0)
+		threadCount = Parallel::defaultThreadCount();
+
+	// counts inside the set (maxItter) are left out so the big black area does not squash the colors of everything else
+	int shift = 0;
+	while ((this->maxItter >> shift) + 1 > maxBuckets)
+		shift++;
+	int bucketCount = (this->maxItter >> shift) + 1;
+
+	// every thread bins its own slice of the image into its own histogram, no atomics needed
+	int sliceCount = (int)std::min<size_t>((size_t)threadCount, std::max<size_t>(count / 4096, 1));
+	std::vector<std::vector<uint32_t>> histograms(sliceCount);
+
+	Parallel::forEach(sliceCount, threadCount, [&](int s) {
+		std::vector<uint32_t>& histogram = histograms[s];
+		histogram.assign(bucketCount, 0);
+
+		size_t begin = count * s / sliceCount;
+		size_t end = count * (s + 1) / sliceCount;
+		for (size_t i = begin; i < end; i++) {
+			int itter = itters[i];
+			if (itter >= 0 && itter < this->maxItter)
+				histogram[itter >> shift]++;
+		}
+	});
+
+	// merge them pairwise in a tree, log2(sliceCount) rounds that each run in parallel
+	for (int stride = 1; stride < sliceCount; stride *= 2) {
+		int pairs = (sliceCount + 2 * stride - 1) / (2 * stride);
+		Parallel::forEach(pairs, threadCount, [&](int p) {
+			int into = p * 2 * stride;
+			int from = into + stride;
+			if (from >= sliceCount)
+				return;
+
+			uint32_t* a = &histograms[into][0];
+			const uint32_t* b = &histograms[from][0];
+			for (int i = 0; i < bucketCount; i++)
+				a[i] += b[i];
+		});
+	}
+	std::vector<uint32_t>& histogram = histograms[0];
+
+	// parallel prefix sum: sum each block, scan the block sums, then each block scans itself starting from its offset
+	int blockCount = std::min(threadCount, std::max(bucketCount / 4096, 1));
+	std::vector<uint64_t> blockSums(blockCount + 1, 0);
+	Parallel::forEach(blockCount, threadCount, [&](int b) {
+		uint64_t sum = 0;
+		for (int i = bucketCount * b / blockCount; i < bucketCount * (b + 1) / blockCount; i++)
+			sum += histogram[i];
+		blockSums[b + 1] = sum;
+	});
+	for (int b = 0; b < blockCount; b++)
+		blockSums[b + 1] += blockSums[b];
+
+	uint64_t total = blockSums[blockCount];
+	std::vector<uint64_t> below(bucketCount); // number of pixels in all buckets before this one
+	Parallel::forEach(blockCount, threadCount, [&](int b) {
+		uint64_t sum = blockSums[b];
+		for (int i = bucketCount * b / blockCount; i < bucketCount * (b + 1) / blockCount; i++) {
+			below[i] = sum;
+			sum += histogram[i];
+		}
+	});
+
+	// entry i gets the fraction of escaped pixels with a count of i or less, spread linearly inside a bucket when buckets are shared
+	table.resize(this->maxItter + 1);
+	int bucketSize = 1 << shift;
+	int chunkCount = std::min(threadCount * 4, std::max((this->maxItter + 1) / 4096, 1));
+	Parallel::forEach(chunkCount, threadCount, [&](int c) {
+		int begin = (int)((int64_t)(this->maxItter + 1) * c / chunkCount);
+		int end = (int)((int64_t)(this->maxItter + 1) * (c + 1) / chunkCount);
+
+		for (int i = begin; i < end; i++) {
+			float colorShift = 1.0f;
+			if (i < this->maxItter && total > 0) {
+				int bucket = i >> shift;
+				double inside = (double)((i & (bucketSize - 1)) + 1) / bucketSize;
+				colorShift = (float)((below[bucket] + histogram[bucket] * inside) / total);
+			}
+
+			table[i] = packColor(colorShift, colorShiftFactor);
+		}
+	});
+
+	version++;
+}
+
+Palette::Mode Palette::getMode()
+{
+	return mode;
+}
+
+int Palette::getMaxItter()
+{
+	return maxItter;
+}
+
+float Palette::getColorShiftFactor()
+{
+	return colorShiftFactor;
+}
+
+int Palette::getVersion()
+{
+	return version;
+}
+
+const std::vector<uint32_t>& Palette::getTable()
+{
+	return table;
+}
+
+void Palette::colorize(const int* itters, size_t count, uint8_t* rgba)
+{
+	size_t done = 0;
+
+#ifdef PALETTE_HAS_AVX2_PATH
+	static const bool hasAVX2 = cpuHasAVX2();
+	if (hasAVX2)
+		done = colorizeAVX2(itters, count, &table[0], maxItter, rgba);
+#endif
+
+	colorizeScalar(itters + done, count - done, rgba + done * 4);
+}
+
+void Palette::colorizeSmooth(const float* itters, size_t count, uint8_t* rgba)
+{
+	for (size_t i = 0; i < count; i++) {
+		float t = std::min(std::max(itters[i], 0.0f), (float)maxItter);
+		int index = (int)t;
+		float blend = t - index;
+
+		const uint8_t* a = (const uint8_t*)&table[index];
+		const uint8_t* b = (const uint8_t*)&table[std::min(index + 1, maxItter)];
+		for (int c = 0; c < 4; c++)
+			rgba[i * 4 + c] = (uint8_t)(a[c] + (b[c] - a[c]) * blend + 0.5f);
+	}
+}
+
+bool Palette::buildIndexed(std::vector<std::array<uint8_t, 3>>& palette, std::vector<uint8_t>& paletteIndex)
+{
+	palette.clear();
+	paletteIndex.resize(table.size());
+
+	std::map<std::array<uint8_t, 3>, uint8_t> entries;
+	for (size_t itter = 0; itter < table.size(); itter++) {
+		const uint8_t* rgba = (const uint8_t*)&table[itter];
+		std::array<uint8_t, 3> color = { rgba[0], rgba[1], rgba[2] };
+
+		auto found = entries.find(color);
+		if (found == entries.end()) {
+			if (palette.size() == 256)
+				return false;
+
+			found = entries.emplace(color, (uint8_t)palette.size()).first;
+			palette.push_back(color);
+		}
+
+		paletteIndex[itter] = found->second;
+	}
+
+	return true;
+}
+
+void Palette::colorizeScalar(const int* itters, size_t count, uint8_t* rgba)
+{
+	for (size_t i = 0; i < count; i++) {
+		int index = std::min(std::max(itters[i], 0), maxItter);
+		memcpy(rgba + i * 4, &table[index], 4);
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// lookup table of the color of every itteration count for one maxItter / colorShiftFactor pair
+// there are only maxItter + 1 distinct colors so they are computed once with MandelbrotCPU::colorizeRGBA8 and then looked up,
+// the result is bit for bit the same as calling colorizeRGBA8 on every pixel without any cos() calls per pixel
+// in histogram mode the table is instead built from how often each count appears in an image, so the colors are spread evenly over the pixels
+class Palette {
+public:
+	enum class Mode { Linear, Histogram };
+
+	Palette();
+
+	// rebuilds the table only if the parameters changed, cheap enough to call before every use
+	void update(int maxItter, float colorShiftFactor);
+
+	// rebuilds the table from the histogram of 'itters', always rebuilds since it depends on the image
+	// counts are binned per thread and merged, above 'maxBuckets' counts neighbouring counts share a bin so huge maxItter values stay cache friendly
+	void updateHistogram(const int* itters, size_t count, int maxItter, float colorShiftFactor, int threadCount = 0);
+
+	Mode getMode();
+
+	int getMaxItter();
+	float getColorShiftFactor();
+
+	// incremented every time the table is rebuilt, for anything that keeps a copy of it (like a palette texture)
+	int getVersion();
+
+	// entry i is the 8 bit rgba color of itteration count i, stored as 4 bytes in r, g, b, a order
+	const std::vector<uint32_t>& getTable();
+
+	// 4 bytes per pixel, counts outside [0, maxItter] are clamped, uses avx2 gathers when the cpu has them
+	void colorize(const int* itters, size_t count, uint8_t* rgba);
+
+	// smooth (fractional) itteration counts are colored by blending the two nearest entries
+	void colorizeSmooth(const float* itters, size_t count, uint8_t* rgba);
+
+	// if the table comes to 256 or fewer distinct colors the image can be stored as an indexed png
+	// 'paletteIndex' maps an itteration count to its entry in 'palette', returns false if there are too many colors
+	bool buildIndexed(std::vector<std::array<uint8_t, 3>>& palette, std::vector<uint8_t>& paletteIndex);
+
+private:
+	void colorizeScalar(const int* itters, size_t count, uint8_t* rgba);
+
+	static const int maxBuckets = 1 << 16;
+
+	Mode mode = Mode::Linear;
+	int maxItter = -1;
+	float colorShiftFactor = 0.0f;
+	int version = 0;
+	std::vector<uint32_t> table;
+};
@@ -0,0 +1,222 @@
+#include "game/PrefetchRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+
+PrefetchRenderer::PrefetchRenderer(int width, int height, size_t cacheCapacity, RenderScheduler* scheduler) :
+	width(width),
+	height(height),
+	cacheCapacity(cacheCapacity),
+	scheduler(scheduler)
+{
+	// leave one core for the main thread so speculative work never competes with the frame that is on screen
+	int threadCount = scheduler ? 1 : std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+	for (int i = 0; i < threadCount; i++) {
+		workers.push_back(std::make_unique<Worker>());
+	}
+	for (auto& worker : workers) {
+		Worker* w = worker.get();
+		w->thread = std::thread([this, w]() { workerLoop(*w); });
+	}
+}
+
+PrefetchRenderer::~PrefetchRenderer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shuttingDown = true;
+		queue.clear();
+		for (auto& worker : workers) {
+			worker->cancel = true;
+		}
+	}
+	jobAvailable.notify_all();
+
+	for (auto& worker : workers) {
+		worker->thread.join();
+	}
+}
+
+void PrefetchRenderer::prefetch(const std::vector<MandelbrotView>& views)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto& worker : workers) {
+			if (!worker->busy)
+				continue;
+
+			bool stillWanted = false;
+			for (const MandelbrotView& view : views) {
+				if (matches(worker->view, view))
+					stillWanted = true;
+			}
+
+			if (!stillWanted)
+				worker->cancel = true;
+		}
+
+		queue.clear();
+		for (const MandelbrotView& view : views) {
+			if (!isCached(view) && !isInFlight(view))
+				queue.push_back(view);
+		}
+	}
+
+	jobAvailable.notify_all();
+}
+
+void PrefetchRenderer::cancel()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	queue.clear();
+	for (auto& worker : workers) {
+		if (worker->busy)
+			worker->cancel = true;
+	}
+}
+
+bool PrefetchRenderer::take(const MandelbrotView& view, std::vector<int>& itters)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	lookups++;
+
+	for (auto it = cache.begin(); it != cache.end(); it++) {
+		if (matches(it->view, view)) {
+			itters = it->itters;
+			cache.splice(cache.begin(), cache, it);
+			hits++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool PrefetchRenderer::peek(const MandelbrotView& view, std::vector<int>& itters)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (const CacheEntry& entry : cache) {
+		if (matches(entry.view, view)) {
+			itters = entry.itters;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int PrefetchRenderer::getHits()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return hits;
+}
+
+int PrefetchRenderer::getLookups()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return lookups;
+}
+
+float PrefetchRenderer::getHitRate()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (lookups == 0)
+		return 0.0f;
+
+	return (float)hits / (float)lookups;
+}
+
+int PrefetchRenderer::getWidth()
+{
+	return width;
+}
+
+int PrefetchRenderer::getHeight()
+{
+	return height;
+}
+
+bool PrefetchRenderer::matches(const MandelbrotView& a, const MandelbrotView& b)
+{
+	if (a.maxItter != b.maxItter || a.camZoom != b.camZoom || !a.sameFormula(b))
+		return false;
+
+	// panning moves the camera by a deltaTime dependant amount so the predicted view is never exact, anything under half a pixel is not visible
+	double halfPixelX = 0.5 * 3.5 * a.camZoom / width;
+	double halfPixelY = 0.5 * 2.0 * a.camZoom / height;
+
+	// the high parts of nearby centers subtract exactly, so adding the low parts keeps deep views apart too
+	double dx = (a.camX - b.camX) + (a.camXLow - b.camXLow);
+	double dy = (a.camY - b.camY) + (a.camYLow - b.camYLow);
+	return std::abs(dx) <= halfPixelX && std::abs(dy) <= halfPixelY;
+}
+
+bool PrefetchRenderer::isCached(const MandelbrotView& view)
+{
+	for (const CacheEntry& entry : cache) {
+		if (matches(entry.view, view))
+			return true;
+	}
+
+	return false;
+}
+
+bool PrefetchRenderer::isInFlight(const MandelbrotView& view)
+{
+	// a cancelled render is thrown away when it stops, so its view has to be queued again if it is wanted
+	for (auto& worker : workers) {
+		if (worker->busy && !worker->cancel && matches(worker->view, view))
+			return true;
+	}
+
+	return false;
+}
+
+bool PrefetchRenderer::render(Worker& worker, std::vector<int>& itters)
+{
+	if (!scheduler)
+		return MandelbrotCPU::renderItterations(worker.view, width, height, &itters[0], 0, height, &worker.cancel);
+
+	// bands are small enough that a real render waits for at most one of them on each thread
+	const int bandHeight = 16;
+	scheduler->forEach(RenderScheduler::Priority::Prefetch, (height + bandHeight - 1) / bandHeight, [&](int band) {
+		MandelbrotCPU::renderItterations(worker.view, width, height, &itters[0], band * bandHeight, std::min((band + 1) * bandHeight, height), &worker.cancel);
+	});
+	return !worker.cancel;
+}
+
+void PrefetchRenderer::workerLoop(Worker& worker)
+{
+	std::vector<int> itters(width * height);
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			worker.busy = false;
+			jobAvailable.wait(lock, [this]() { return shuttingDown || !queue.empty(); });
+
+			if (shuttingDown)
+				return;
+
+			worker.view = queue.front();
+			queue.erase(queue.begin());
+			worker.cancel = false;
+			worker.busy = true;
+		}
+
+		if (!render(worker, itters))
+			continue;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (worker.cancel || isCached(worker.view))
+			continue;
+
+		cache.push_front({ worker.view, itters });
+		if (cache.size() > cacheCapacity)
+			cache.pop_back();
+	}
+}
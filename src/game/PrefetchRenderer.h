@@ -0,0 +1,82 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+#include "game/RenderScheduler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// renders views the user is likely to move to next on spare cores while they are idle
+// results are kept in a small lru cache of itteration buffers so that the next key press can be displayed without rendering
+class PrefetchRenderer {
+public:
+	// width and height are the size of the views that will be cached, cacheCapacity is the max number of cached views
+	// with a scheduler the views are rendered one at a time in bands on its pool at prefetch priority instead of on threads of their own
+	PrefetchRenderer(int width, int height, size_t cacheCapacity = 12, RenderScheduler* scheduler = nullptr);
+	~PrefetchRenderer();
+
+	PrefetchRenderer(const PrefetchRenderer&) = delete;
+
+	// replaces the set of views being speculatively rendered
+	// views already cached or already rendering are not restarted, in-flight views that are no longer wanted are cancelled
+	void prefetch(const std::vector<MandelbrotView>& views);
+
+	// drops every queued view and stops in-flight renders at the next row, call this before doing a real render
+	void cancel();
+
+	// if a cached view is within half a pixel of 'view' its itterations are copied into 'itters' and true is returned
+	// every call counts towards the hit rate
+	bool take(const MandelbrotView& view, std::vector<int>& itters);
+
+	// same as take() but is not counted as a lookup, used when the itterations are wanted for something other than displaying
+	bool peek(const MandelbrotView& view, std::vector<int>& itters);
+
+	int getHits();
+	int getLookups();
+	float getHitRate();
+
+	int getWidth();
+	int getHeight();
+
+private:
+	struct CacheEntry {
+		MandelbrotView view;
+		std::vector<int> itters;
+	};
+
+	struct Worker {
+		std::thread thread;
+		std::atomic<bool> cancel{ false };
+		bool busy = false;
+		MandelbrotView view;
+	};
+
+	bool matches(const MandelbrotView& a, const MandelbrotView& b);
+	bool isCached(const MandelbrotView& view);
+	bool isInFlight(const MandelbrotView& view);
+
+	void workerLoop(Worker& worker);
+
+	// false if it was cancelled
+	bool render(Worker& worker, std::vector<int>& itters);
+
+	int width, height;
+	size_t cacheCapacity;
+	RenderScheduler* scheduler;
+
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	bool shuttingDown = false;
+
+	std::vector<MandelbrotView> queue;
+	std::list<CacheEntry> cache; // most recently used at the front
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	int hits = 0;
+	int lookups = 0;
+};
@@ -0,0 +1,528 @@
+#include "game/RenderFarm.h"
+#include "game/EscapeDataCodec.h"
+#include "game/CostMap.h"
+#include "game/HeadlessRenderer.h"
+#include "game/FormulaProgram.h"
+#include "engine/Json.h"
+#include "engine/Parallel.h"
+#include "engine/Process.h"
+#include "engine/Socket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+	const uint32_t maxMessageSize = 1u << 30;
+
+	uint32_t readU32(const uint8_t* data) {
+		return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+	}
+
+	void appendU32(std::vector<uint8_t>& out, uint32_t value) {
+		for (int i = 0; i < 4; i++)
+			out.push_back((uint8_t)(value >> (8 * i)));
+	}
+
+	bool sendMessage(Socket& socket, const void* data, size_t size) {
+		std::vector<uint8_t> message;
+		message.reserve(4 + size);
+		appendU32(message, (uint32_t)size);
+		message.insert(message.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+		return socket.sendAll(&message[0], message.size());
+	}
+
+	bool sendMessage(Socket& socket, const JsonValue& value) {
+		std::string text = value.serialize();
+		return sendMessage(socket, text.data(), text.size());
+	}
+
+	bool receiveExactly(Socket& socket, uint8_t* data, size_t size) {
+		while (size > 0) {
+			int received = socket.receive(data, size);
+			if (received <= 0)
+				return false;
+			data += received;
+			size -= received;
+		}
+		return true;
+	}
+
+	bool receiveMessage(Socket& socket, std::vector<uint8_t>& message) {
+		uint8_t sizeBytes[4];
+		if (!receiveExactly(socket, sizeBytes, 4))
+			return false;
+
+		uint32_t size = readU32(sizeBytes);
+		if (size > maxMessageSize)
+			return false;
+
+		message.resize(size);
+		return size == 0 || receiveExactly(socket, &message[0], size);
+	}
+
+	bool receiveMessage(Socket& socket, JsonValue& value) {
+		std::vector<uint8_t> message;
+		std::string error;
+		return receiveMessage(socket, message) && JsonValue::parse(std::string(message.begin(), message.end()), value, error);
+	}
+
+	JsonValue pair(double a, double b) {
+		JsonValue value = JsonValue::array();
+		value.append(a);
+		value.append(b);
+		return value;
+	}
+
+	bool readPair(const JsonValue* value, double& a, double& b) {
+		if (!value || value->getArray().size() != 2)
+			return false;
+		a = value->getArray()[0].getNumber();
+		b = value->getArray()[1].getNumber();
+		return true;
+	}
+
+	// in the form --formula takes, so the worker reads it back with HeadlessRenderer::parseFormula
+	std::string formulaText(const MandelbrotView& view) {
+		switch (view.formula) {
+		case MandelbrotView::Formula::Multibrot:
+			return "multibrot:" + std::to_string(view.power);
+		case MandelbrotView::Formula::BurningShip:
+			return "burning-ship";
+		case MandelbrotView::Formula::Tricorn:
+			return "tricorn";
+		case MandelbrotView::Formula::Custom:
+			return view.program ? view.program->getSource() : "mandelbrot";
+		default:
+			return "mandelbrot";
+		}
+	}
+
+	// doubles are written with enough digits to read back exactly, so every worker maps pixels onto the plane the same way
+	JsonValue describeView(const MandelbrotView& view) {
+		JsonValue value = JsonValue::object();
+		value.set("cam", pair(view.camX, view.camY));
+		value.set("cam_low", pair(view.camXLow, view.camYLow));
+		value.set("cam_zoom", view.camZoom);
+		value.set("itters", (double)view.maxItter);
+		value.set("formula", formulaText(view));
+		if (view.julia)
+			value.set("julia", pair(view.juliaX, view.juliaY));
+		return value;
+	}
+
+	bool readView(const JsonValue* value, MandelbrotView& view) {
+		if (!value || !readPair(value->find("cam"), view.camX, view.camY) || !value->find("cam_zoom") || !value->find("itters") || !value->find("formula"))
+			return false;
+
+		view.camZoom = value->find("cam_zoom")->getNumber();
+		if (!readPair(value->find("cam_low"), view.camXLow, view.camYLow))
+			view.camXLow = view.camYLow = 0.0;
+		view.maxItter = (int)value->find("itters")->getNumber();
+		view.julia = readPair(value->find("julia"), view.juliaX, view.juliaY);
+
+		std::string error;
+		return HeadlessRenderer::parseFormula(value->find("formula")->getString(), view, error);
+	}
+
+	double millisecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	class Coordinator {
+	public:
+		Coordinator(const MandelbrotView& view, int width, int height, const RenderFarm::Settings& farm) :
+			view(view), width(width), height(height), farm(farm)
+		{
+			if (farm.balanced) {
+				// one band for each worker, cut where each has about the same predicted work
+				CostMap costs(view, width, height);
+				prepassMilliseconds = costs.getMilliseconds();
+				for (const CostMap::Region& region : costs.bisectRows(farm.workers)) {
+					Band band;
+					band.y0 = region.y0;
+					band.y1 = region.y1;
+					band.predicted = region.cost / costs.getTotal();
+					bands.push_back(band);
+				}
+			}
+			else {
+				for (int y = 0; y < height; y += farm.bandHeight) {
+					Band band;
+					band.y0 = y;
+					band.y1 = std::min(height, y + farm.bandHeight);
+					bands.push_back(band);
+				}
+			}
+
+			// png rows go from the top down, so the top band is wanted first
+			for (int band = (int)bands.size() - 1; band >= 0; band--)
+				queue.push_back(band);
+
+			itters.resize((size_t)width * height);
+		}
+
+		bool start(std::string& error) {
+			listener = Socket::listenLoopback(farm.port);
+			if (!listener.isValid()) {
+				error = "port " + std::to_string(farm.port) + " is already taken";
+				return false;
+			}
+
+			std::string executable = Process::currentExecutable();
+			int threads = farm.threadsPerWorker > 0 ? farm.threadsPerWorker : std::max(1, Parallel::defaultThreadCount() / std::max(1, farm.workers));
+			for (int i = 0; i < farm.workers; i++) {
+				Process process = Process::start(executable, { "--farm-worker", "--port", std::to_string(farm.port), "--threads", std::to_string(threads) });
+				if (process.isValid())
+					processes.push_back(std::move(process));
+			}
+			if (processes.empty() && farm.workers > 0) {
+				error = "could not start " + executable;
+				return false;
+			}
+
+			acceptThread = std::thread(&Coordinator::acceptWorkers, this);
+			return true;
+		}
+
+		// waits until every band that overlaps rows [yBegin, yEnd) has come back, false if it never will
+		bool waitForRows(int yBegin, int yEnd) {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				bool ready = true;
+				for (const Band& band : bands)
+					ready = ready && (band.done || band.y1 <= yBegin || band.y0 >= yEnd);
+				if (ready)
+					return true;
+
+				// nothing can finish them once every connection is gone and every worker process has exited
+				if (connected == 0) {
+					bool running = false;
+					for (Process& process : processes)
+						running = running || process.isRunning();
+					if (!running)
+						return false;
+				}
+
+				changed.wait_for(lock, std::chrono::milliseconds(100));
+			}
+		}
+
+		void copyRow(int y, int* rowItters) {
+			std::copy(&itters[(size_t)y * width], &itters[(size_t)(y + 1) * width], rowItters);
+		}
+
+		// stops the workers, which exit once their connection closes
+		void stop(RenderFarm::Result& result) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				finished = true;
+				for (Socket* socket : sockets)
+					socket->shutdown();
+			}
+			changed.notify_all();
+
+			listener.shutdown();
+			if (acceptThread.joinable())
+				acceptThread.join();
+			for (std::thread& thread : workerThreads)
+				thread.join();
+
+			for (Process& process : processes)
+				process.wait(2000);
+
+			result.bands = (int)bands.size();
+			result.bandsReassigned = reassigned;
+			result.bandsDuplicated = duplicated;
+			result.bandsPerWorker = bandsPerWorker;
+			result.prepassMilliseconds = prepassMilliseconds;
+
+			for (const Band& band : bands) {
+				RenderFarm::BandReport report;
+				report.y0 = band.y0;
+				report.y1 = band.y1;
+				report.worker = band.worker;
+				report.predicted = band.predicted;
+				report.milliseconds = band.milliseconds;
+				report.cpuMilliseconds = band.cpuMilliseconds;
+				result.bandReports.push_back(report);
+			}
+		}
+
+	private:
+		struct Band {
+			int y0 = 0, y1 = 0;
+			double predicted = 0.0;
+			bool done = false;
+			int inFlight = 0;
+			std::chrono::steady_clock::time_point started;
+			int worker = -1;
+			double milliseconds = 0.0;
+			double cpuMilliseconds = 0.0;
+		};
+
+		void acceptWorkers() {
+			while (true) {
+				Socket socket = listener.accept();
+
+				std::lock_guard<std::mutex> lock(mutex);
+				if (finished)
+					return;
+				if (!socket.isValid())
+					continue;
+
+				socket.setNoDelay();
+				connected++;
+				bandsPerWorker.push_back(0);
+				workerThreads.push_back(std::thread(&Coordinator::serveWorker, this, std::move(socket), (int)bandsPerWorker.size() - 1));
+			}
+		}
+
+		void serveWorker(Socket socket, int worker) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				sockets.push_back(&socket);
+			}
+
+			JsonValue setup = JsonValue::object();
+			setup.set("size", pair(width, height));
+			setup.set("view", describeView(view));
+			bool working = sendMessage(socket, setup);
+
+			std::vector<uint8_t> message;
+			std::vector<int> rows;
+			while (working) {
+				int band = take();
+				if (band < 0)
+					break;
+
+				int y0 = bands[band].y0, y1 = bands[band].y1;
+				JsonValue job = JsonValue::object();
+				job.set("band", (double)band);
+				job.set("rows", pair(y0, y1));
+
+				rows.resize((size_t)width * (y1 - y0));
+				working = sendMessage(socket, job) && receiveMessage(socket, message) && message.size() >= 8 && readU32(&message[0]) == (uint32_t)band &&
+					EscapeDataCodec::decompress(&message[8], message.size() - 8, &rows[0], rows.size());
+
+				if (working)
+					complete(band, rows, worker, readU32(&message[4]) / 1000.0);
+				else
+					giveBack(band);
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			sockets.erase(std::find(sockets.begin(), sockets.end(), &socket));
+			connected--;
+			changed.notify_all();
+		}
+
+		// the next band for a worker, -1 once the image is finished
+		int take() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!finished) {
+				auto now = std::chrono::steady_clock::now();
+
+				if (!queue.empty()) {
+					int band = queue.front();
+					queue.pop_front();
+					bands[band].inFlight++;
+					bands[band].started = now;
+					return band;
+				}
+
+				// a worker that has stopped or is much slower than the rest would hold up the end of the image
+				int slowest = -1;
+				for (int band = 0; band < (int)bands.size(); band++)
+					if (!bands[band].done && bands[band].inFlight == 1 && (slowest < 0 || bands[band].started < bands[slowest].started))
+						slowest = band;
+
+				if (slowest >= 0 && completed > 0) {
+					double out = std::chrono::duration<double, std::milli>(now - bands[slowest].started).count();
+					if (out > std::max(50.0, 4.0 * completedMilliseconds / completed)) {
+						bands[slowest].inFlight++;
+						duplicated++;
+						return slowest;
+					}
+				}
+
+				changed.wait_for(lock, std::chrono::milliseconds(20));
+			}
+			return -1;
+		}
+
+		void complete(int band, const std::vector<int>& rows, int worker, double cpuMilliseconds) {
+			std::lock_guard<std::mutex> lock(mutex);
+			bands[band].inFlight--;
+			if (bands[band].done)
+				return;
+
+			std::copy(rows.begin(), rows.end(), &itters[(size_t)bands[band].y0 * width]);
+			bands[band].done = true;
+			bands[band].worker = worker;
+			bands[band].milliseconds = millisecondsSince(bands[band].started);
+			bands[band].cpuMilliseconds = cpuMilliseconds;
+			bandsPerWorker[worker]++;
+			completed++;
+			completedMilliseconds += bands[band].milliseconds;
+			changed.notify_all();
+		}
+
+		void giveBack(int band) {
+			std::lock_guard<std::mutex> lock(mutex);
+			bands[band].inFlight--;
+			if (!bands[band].done && bands[band].inFlight == 0) {
+				queue.push_front(band);
+				reassigned++;
+			}
+			changed.notify_all();
+		}
+
+		MandelbrotView view;
+		int width, height;
+		RenderFarm::Settings farm;
+
+		Socket listener;
+		std::thread acceptThread;
+		std::vector<Process> processes;
+
+		std::mutex mutex;
+		std::condition_variable changed;
+		bool finished = false;
+		std::vector<std::thread> workerThreads;
+		std::vector<Socket*> sockets;
+		int connected = 0;
+
+		std::vector<Band> bands;
+		double prepassMilliseconds = 0.0;
+		std::deque<int> queue;
+		int completed = 0;
+		double completedMilliseconds = 0.0;
+		int reassigned = 0, duplicated = 0;
+		std::vector<int> bandsPerWorker;
+
+		std::vector<int> itters;
+	};
+
+}
+
+RenderFarm::Result RenderFarm::exportPng(const std::string& filepath, const MandelbrotView& view, int width, int height, ImageExport::Settings settings,
+	const Settings& farm)
+{
+	Result result;
+	Coordinator coordinator(view, width, height, farm);
+	if (!coordinator.start(result.error))
+		return result;
+
+	bool complete = true;
+	settings.smooth = false;
+	settings.trap = OrbitTrap();
+	settings.prepareRows = [&](int yBegin, int yEnd) {
+		complete = complete && coordinator.waitForRows(yBegin, yEnd);
+	};
+	settings.rowSource = [&](int y, int* itters, float*, float*) {
+		coordinator.copyRow(y, itters);
+	};
+
+	result.image = ImageExport::exportPng(filepath, view, width, height, settings);
+	coordinator.stop(result);
+
+	if (!complete) {
+		result.error = "every worker stopped before the image was finished";
+		result.image.written = false;
+	}
+	else if (!result.image.written) {
+		result.error = "could not write " + filepath;
+	}
+	return result;
+}
+
+int RenderFarm::work(uint16_t port, int threadCount, int failAfter)
+{
+	Socket socket = Socket::connectLoopback(port);
+	if (!socket.isValid()) {
+		printf("farm worker: nothing is listening on 127.0.0.1:%d\n", port);
+		return 1;
+	}
+	socket.setNoDelay();
+
+	JsonValue setup;
+	MandelbrotView view;
+	double width, height;
+	if (!receiveMessage(socket, setup) || !readPair(setup.find("size"), width, height) || width < 1 || height < 1 || !readView(setup.find("view"), view)) {
+		printf("farm worker: the coordinator did not send a valid view\n");
+		return 1;
+	}
+
+	if (threadCount <= 0)
+		threadCount = Parallel::defaultThreadCount();
+
+	JsonValue job;
+	std::vector<int> rows;
+	std::vector<uint8_t> packed, reply;
+	for (int bands = 0; receiveMessage(socket, job); bands++) {
+		double y0, y1;
+		const JsonValue* band = job.find("band");
+		if (!band || !readPair(job.find("rows"), y0, y1) || y0 < 0 || y1 > height || y0 >= y1)
+			return 1;
+
+		if (failAfter > 0 && bands + 1 == failAfter) {
+			printf("farm worker: stopping part way through band %d as asked\n", (int)band->getNumber());
+			return 2;
+		}
+
+		// processor time of every thread, which is the work the band took even while the workers share cores
+		double started = Process::cpuMilliseconds();
+
+		rows.resize((size_t)width * (int)(y1 - y0));
+		Parallel::forEach((int)(y1 - y0), threadCount, [&](int row) {
+			MandelbrotCPU::renderRow(view, (int)width, (int)height, (int)y0 + row, 0, (int)width, &rows[(size_t)row * (int)width]);
+		});
+
+		uint32_t index = (uint32_t)band->getNumber();
+		EscapeDataCodec::compress(&rows[0], rows.size(), packed);
+		reply.clear();
+		appendU32(reply, index);
+		appendU32(reply, (uint32_t)((Process::cpuMilliseconds() - started) * 1000.0));
+		reply.insert(reply.end(), packed.begin(), packed.end());
+		if (!sendMessage(socket, reply.data(), reply.size()))
+			return 1;
+	}
+
+	// the coordinator closes the connection once the image is finished
+	return 0;
+}
+
+void RenderFarm::scaling(const std::string& filepath, const MandelbrotView& view, int width, int height, const ImageExport::Settings& settings, Settings farm)
+{
+	int maxWorkers = farm.workers;
+	farm.threadsPerWorker = 1;
+
+	printf("\nrender farm, %dx%d, maxItter %d, one thread per worker, %d cores\n", width, height, view.maxItter, Parallel::defaultThreadCount());
+	printf("%-8s %9s %8s %8s %11s %10s\n", "workers", "ms", "Mpx/s", "speedup", "efficiency", "checksum");
+
+	double oneWorkerMs = 0.0;
+	uint32_t firstChecksum = 0;
+	for (int workers = 1; workers <= maxWorkers; workers++) {
+		farm.workers = workers;
+		Result result = exportPng(filepath, view, width, height, settings, farm);
+		if (!result.image.written) {
+			printf("%-8d %s\n", workers, result.error.c_str());
+			return;
+		}
+
+		double ms = result.image.milliseconds;
+		if (workers == 1) {
+			oneWorkerMs = ms;
+			firstChecksum = result.image.checksum;
+		}
+		printf("%-8d %9.0f %8.2f %7.2fx %10.0f%% %08x%s\n", workers, ms, result.image.pixels / ms / 1000.0, oneWorkerMs / ms,
+			100.0 * oneWorkerMs / ms / workers, result.image.checksum, result.image.checksum == firstChecksum ? "" : " DIFFERENT");
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "game/ImageExport.h"
+#include "game/MandelbrotCPU.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// fans one export out to worker processes on this machine, as a stand-in for the nodes of a cluster
+//
+// the coordinator starts copies of this executable with --farm-worker, which connect back to it over loopback and are handed bands of rows
+// one at a time, top band first. a worker renders its band with MandelbrotCPU::renderRow for the whole image size, exactly as a local render
+// would, and sends the escape counts back packed with EscapeDataCodec, so the stitched image is identical to one rendered in a single process.
+// the bands go into ImageExport through its row source, so the png is written while the later bands are still out
+//
+// a band whose worker disconnects is handed out again, and once none are left to hand out an idle worker also takes the band that has been
+// out longest if it is taking much longer than bands usually do, whichever copy comes back first is used
+//
+// messages are a u32 little endian size then the data: the coordinator sends {"size": [w, h], "view": {...}} once and then {"band": i, "rows": [y0, y1]}
+// for each band, a worker answers with the u32 band, the u32 processor microseconds it took and the packed counts of its rows
+namespace RenderFarm {
+
+	const uint16_t defaultPort = 8340;
+
+	struct Settings {
+		int workers = 4;           // processes started, more can join by running --farm-worker with the same port
+		int threadsPerWorker = 0;  // 0 shares the cores between the workers
+		uint16_t port = defaultPort;
+		int bandHeight = 16;
+
+		// one band per worker instead, cut from a CostMap of the view so each gets about the same predicted work
+		// this is how work would be split between nodes that cannot pull bands from a shared queue
+		bool balanced = false;
+	};
+
+	struct BandReport {
+		int y0 = 0, y1 = 0;
+		int worker = -1;           // that finished it
+		double predicted = 0.0;    // share of the predicted cost, only when balanced
+		double milliseconds = 0.0; // from being handed out to coming back
+		double cpuMilliseconds = 0.0; // processor time the worker spent on it, the actual work even when workers share cores
+	};
+
+	struct Result {
+		ImageExport::Result image;
+		int bands = 0;
+		int bandsReassigned = 0;   // handed out again after their worker disconnected
+		int bandsDuplicated = 0;   // also handed to an idle worker because the first one was slow
+		std::vector<int> bandsPerWorker; // in the order the workers connected
+		std::vector<BandReport> bandReports;
+		double prepassMilliseconds = 0.0; // of the CostMap when balanced
+		std::string error;         // why nothing was written
+	};
+
+	// smooth coloring and orbit traps need more than escape counts and are turned off, anti-aliasing works with the extra samples done locally
+	Result exportPng(const std::string& filepath, const MandelbrotView& view, int width, int height, ImageExport::Settings settings, const Settings& farm);
+
+	// the --farm-worker side, renders bands for the coordinator on 'port' until it disconnects and returns the process exit code
+	// 'failAfter' makes it exit without answering its nth band, for trying out the reassignment
+	int work(uint16_t port, int threadCount, int failAfter = 0);
+
+	// exports the same image with 1 to farm.workers single threaded workers and prints how the throughput scales
+	void scaling(const std::string& filepath, const MandelbrotView& view, int width, int height, const ImageExport::Settings& settings, Settings farm);
+
+}
@@ -0,0 +1,148 @@
+#include "game/RenderProgress.h"
+#include "game/CostMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+	// every thread keeps the slot it is first given, threads past RenderProgress' slot count share slots, which stays correct as the adds are atomic
+	int threadSlot(int slotCount) {
+		static std::atomic<int> nextSlot{ 0 };
+		thread_local int slot = nextSlot++;
+		return slot % slotCount;
+	}
+
+	int64_t nowTicks() {
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+	}
+
+	double ticksToSeconds(int64_t ticks) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::duration(ticks)).count();
+	}
+
+}
+
+std::string RenderProgress::Estimate::describe() const
+{
+	char text[64];
+	if (remainingSeconds < 0.0) {
+		snprintf(text, sizeof(text), "%.1f%%", fraction * 100.0f);
+	}
+	else {
+		int seconds = (int)std::ceil(remainingSeconds);
+		if (seconds >= 3600)
+			snprintf(text, sizeof(text), "%.1f%%, %dh %dm left", fraction * 100.0f, seconds / 3600, seconds / 60 % 60);
+		else if (seconds >= 60)
+			snprintf(text, sizeof(text), "%.1f%%, %dm %ds left", fraction * 100.0f, seconds / 60, seconds % 60);
+		else
+			snprintf(text, sizeof(text), "%.1f%%, %ds left", fraction * 100.0f, seconds);
+	}
+	return text;
+}
+
+RenderProgress::Printer::Printer(const std::string& name, RenderProgress& progress, int intervalSeconds)
+{
+	thread = std::thread([this, name, &progress, intervalSeconds]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!wake.wait_for(lock, std::chrono::seconds(intervalSeconds), [this]() { return stopping; }))
+			printf("%s: %s\n", name.c_str(), progress.getEstimate().describe().c_str());
+	});
+}
+
+RenderProgress::Printer::~Printer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	thread.join();
+}
+
+RenderProgress::RenderProgress()
+{
+}
+
+double RenderProgress::predict(const MandelbrotView& view, int width, int height, int threadCount)
+{
+	return CostMap(view, width, height, 192, threadCount).getTotal();
+}
+
+void RenderProgress::begin(double predictedCost)
+{
+	for (Slot& slot : slots)
+		slot.cost = 0;
+	predicted = predictedCost;
+	skipped = 0.0;
+	finished = false;
+	startTicks = nowTicks();
+}
+
+void RenderProgress::skip(double cost)
+{
+	double expected = skipped;
+	while (!skipped.compare_exchange_weak(expected, expected + cost)) {
+	}
+}
+
+void RenderProgress::addRow(const int* itters, int count)
+{
+	slots[threadSlot(slotCount)].cost.fetch_add((uint64_t)CostMap::rowCost(itters, count), std::memory_order_relaxed);
+}
+
+RenderProgress::Estimate RenderProgress::getEstimate()
+{
+	Estimate estimate;
+	estimate.predicted = predicted;
+	double rendered = counted();
+	estimate.done = rendered + skipped;
+	estimate.elapsedSeconds = ticksToSeconds((finished ? finishTicks.load() : nowTicks()) - startTicks);
+
+	if (finished) {
+		estimate.fraction = 1.0f;
+		estimate.remainingSeconds = 0.0;
+		return estimate;
+	}
+
+	estimate.fraction = estimate.predicted > 0.0 ? (float)std::min(estimate.done / estimate.predicted, 0.999) : 0.0f;
+	if (rendered > 0.0 && estimate.done < estimate.predicted)
+		estimate.remainingSeconds = (estimate.predicted - estimate.done) * estimate.elapsedSeconds / rendered;
+	return estimate;
+}
+
+void RenderProgress::finish()
+{
+	finishTicks = nowTicks();
+	finished = true;
+}
+
+bool RenderProgress::isFinished()
+{
+	return finished;
+}
+
+double RenderProgress::getPredicted()
+{
+	return predicted;
+}
+
+double RenderProgress::getActual()
+{
+	return counted() + skipped;
+}
+
+double RenderProgress::getError()
+{
+	double actual = getActual();
+	return actual > 0.0 ? (predicted - actual) / actual : 0.0;
+}
+
+double RenderProgress::counted()
+{
+	double sum = 0.0;
+	for (Slot& slot : slots)
+		sum += (double)slot.cost.load(std::memory_order_relaxed);
+	return sum;
+}
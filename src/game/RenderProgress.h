@@ -0,0 +1,91 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// progress and time left of a render, measured in itterations instead of pixels since a pixel on the boundary of the set can cost a thousand
+// times one outside it
+//
+// the total is predicted up front by a CostMap pre-pass and every rendered row adds what it actually cost, so the fraction done is the share of
+// the predicted work that is finished and the time left is the work left at the rate it has been going. each thread adds to a counter of its own
+// on its own cache line so rows are counted without locking or sharing. once the render is finished the prediction is compared to what was counted
+class RenderProgress {
+public:
+	struct Estimate {
+		double predicted = 0.0; // cost, in CostMap units
+		double done = 0.0;
+		float fraction = 0.0f;  // below 1 until finish(), even if the prediction was too low
+		double elapsedSeconds = 0.0;
+		double remainingSeconds = -1.0; // -1 until there is a rate to go by or when more than the prediction is done
+
+		// like "42.0%, 3m 10s left"
+		std::string describe() const;
+	};
+
+	// prints "<name>: <estimate>" every few seconds from a thread of its own for as long as it exists, for the command line
+	class Printer {
+	public:
+		Printer(const std::string& name, RenderProgress& progress, int intervalSeconds = 5);
+		~Printer();
+
+		Printer(const Printer&) = delete;
+
+	private:
+		std::mutex mutex;
+		std::condition_variable wake;
+		bool stopping = false;
+		std::thread thread;
+	};
+
+	RenderProgress();
+
+	RenderProgress(const RenderProgress&) = delete;
+
+	// predicted cost of rendering 'view' at width x height, from a CostMap of it, for begin()
+	static double predict(const MandelbrotView& view, int width, int height, int threadCount = 0);
+
+	// starts the clock and clears the counters
+	void begin(double predictedCost);
+
+	// work finished before begin(), like the tiles of a resumed export, it counts towards the fraction but not the rate
+	void skip(double cost);
+
+	// counts one rendered row of escape counts, from any thread
+	void addRow(const int* itters, int count);
+
+	Estimate getEstimate();
+
+	// stops the clock, everything counted since begin() is the actual cost
+	void finish();
+
+	bool isFinished();
+
+	double getPredicted();
+	double getActual();
+
+	// (predicted - actual) / actual once finished, negative when it was an underestimate
+	double getError();
+
+private:
+	static const int slotCount = 64;
+
+	struct alignas(64) Slot {
+		std::atomic<uint64_t> cost{ 0 };
+	};
+
+	double counted();
+
+	Slot slots[slotCount];
+	std::atomic<double> predicted{ 0.0 };
+	std::atomic<double> skipped{ 0.0 };
+	std::atomic<bool> finished{ false };
+	std::atomic<int64_t> startTicks{ 0 };
+	std::atomic<int64_t> finishTicks{ 0 };
+};
@@ -0,0 +1,117 @@
+#include "game/RenderScheduler.h"
+
+#include <algorithm>
+
+RenderScheduler::RenderScheduler(int threadCount, int exportThreads)
+{
+	if (threadCount <= 0)
+		threadCount = std::max(1, Parallel::defaultThreadCount() - 1);
+	this->exportThreads = std::min(threadCount, exportThreads > 0 ? exportThreads : std::max(1, threadCount / 2));
+
+	for (int i = 0; i < threadCount; i++)
+		threads.emplace_back([this, i]() { workerLoop(i); });
+}
+
+RenderScheduler::~RenderScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		shuttingDown = true;
+	}
+	workAvailable.notify_all();
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+void RenderScheduler::forEach(Priority priority, int count, const std::function<void(int)>& job)
+{
+	if (count <= 0)
+		return;
+
+	Batch batch;
+	batch.priority = priority;
+	batch.count = count;
+	batch.job = &job;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	batches.push_back(&batch);
+	workAvailable.notify_all();
+
+	// the frame on screen is what the user is waiting for, so its thread helps instead of sleeping
+	if (priority == Priority::Interactive) {
+		while (batch.next < batch.count)
+			run(batch, batch.next++, lock);
+	}
+
+	batchFinished.wait(lock, [&]() { return batch.finished == batch.count; });
+	batches.remove(&batch);
+}
+
+Parallel::Runner RenderScheduler::runner(Priority priority)
+{
+	return [this, priority](int count, const std::function<void(int)>& job) { forEach(priority, count, job); };
+}
+
+int RenderScheduler::getThreadCount()
+{
+	return (int)threads.size();
+}
+
+int RenderScheduler::getExportThreadCount()
+{
+	return exportThreads;
+}
+
+RenderScheduler::Stats RenderScheduler::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+RenderScheduler::Batch* RenderScheduler::pick(bool mayExport)
+{
+	auto best = batches.end();
+	for (auto batch = batches.begin(); batch != batches.end(); ++batch) {
+		if ((*batch)->next >= (*batch)->count || ((*batch)->priority == Priority::Export && !mayExport))
+			continue;
+		if (best == batches.end() || (*batch)->priority < (*best)->priority)
+			best = batch;
+	}
+	if (best == batches.end())
+		return nullptr;
+
+	// to the back, so batches of the same priority take turns instead of a poster holding every export thread until it is done
+	Batch* picked = *best;
+	batches.splice(batches.end(), batches, best);
+	return picked;
+}
+
+void RenderScheduler::run(Batch& batch, int item, std::unique_lock<std::mutex>& lock)
+{
+	auto start = std::chrono::steady_clock::now();
+	lock.unlock();
+	(*batch.job)(item);
+	lock.lock();
+
+	stats.items[(int)batch.priority]++;
+	stats.milliseconds[(int)batch.priority] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (++batch.finished == batch.count)
+		batchFinished.notify_all();
+}
+
+void RenderScheduler::workerLoop(int index)
+{
+	bool mayExport = index < exportThreads;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		Batch* batch = nullptr;
+		workAvailable.wait(lock, [&]() { return shuttingDown || (batch = pick(mayExport)) != nullptr; });
+		if (shuttingDown)
+			return;
+
+		run(*batch, batch->next++, lock);
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "engine/Parallel.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// one pool of render threads shared by everything the app renders on the cpu, so a long export can run while exploring without slowing the view down
+//
+// work is handed in as batches of items (bands of rows, tiles) with a priority, and whenever a thread is free it takes the next item of the highest
+// priority batch that has any left. items are small so a frame that is asked for while an export is running waits for at most one item per thread
+// before it has the whole pool. exports are also only ever taken by some of the threads, so a burst of prefetching cannot hold back an export
+// and an export cannot take every core while prefetching is idle either
+class RenderScheduler {
+public:
+	enum class Priority {
+		Interactive, // the frame on screen, the calling thread also works on it
+		Prefetch,    // views the user may move to next
+		Export,      // files being written in the background
+	};
+
+	struct Stats {
+		uint64_t items[3] = {};      // run so far of each priority
+		double milliseconds[3] = {}; // spent running them
+	};
+
+	// 'threadCount' pool threads, one less than the cores if 0, of which 'exportThreads' (half of them if 0) may run export items
+	RenderScheduler(int threadCount = 0, int exportThreads = 0);
+	~RenderScheduler();
+
+	RenderScheduler(const RenderScheduler&) = delete;
+
+	// calls job(0) to job(count - 1) at 'priority' and returns when all are done, it may be called from any thread
+	void forEach(Priority priority, int count, const std::function<void(int)>& job);
+
+	// forEach at 'priority', for the classes that take a Parallel::Runner
+	Parallel::Runner runner(Priority priority);
+
+	int getThreadCount();
+	int getExportThreadCount();
+
+	Stats getStats();
+
+private:
+	struct Batch {
+		Priority priority;
+		int count = 0;
+		const std::function<void(int)>* job = nullptr;
+		int next = 0;     // first item not taken yet
+		int finished = 0;
+	};
+
+	// the highest priority batch with items left that a thread is allowed to take, the mutex must be held
+	// of batches with the same priority it is the one that was picked longest ago
+	Batch* pick(bool mayExport);
+
+	// runs one item of 'batch' that was claimed under the lock, and takes the lock again
+	void run(Batch& batch, int item, std::unique_lock<std::mutex>& lock);
+
+	void workerLoop(int index);
+
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable batchFinished;
+	bool shuttingDown = false;
+
+	std::list<Batch*> batches; // a batch moves to the back each time it is picked
+	std::vector<std::thread> threads;
+	int exportThreads;
+
+	Stats stats;
+};
@@ -0,0 +1,88 @@
+#include "game/StreamViewer.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+StreamViewer::StreamViewer(uint16_t port) :
+	port(port)
+{
+	thread = std::thread(&StreamViewer::receiveFrames, this);
+}
+
+StreamViewer::~StreamViewer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		receiver.interrupt();
+	}
+	stopped.notify_all();
+	thread.join();
+	receiver.close();
+}
+
+bool StreamViewer::takeFrame(FrameStream::Frame& frame)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!hasNewFrame)
+		return false;
+
+	std::swap(frame, latest);
+	hasNewFrame = false;
+	return true;
+}
+
+bool StreamViewer::isConnected()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return connected;
+}
+
+uint16_t StreamViewer::getPort()
+{
+	return port;
+}
+
+uint16_t StreamViewer::requestedPort(int argc, char** argv)
+{
+	bool viewing = false;
+	int port = FrameStream::defaultPort;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--view") == 0)
+			viewing = true;
+		else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) < 65536)
+			port = atoi(argv[++i]);
+	}
+	return viewing ? (uint16_t)port : 0;
+}
+
+void StreamViewer::receiveFrames()
+{
+	FrameStream::Frame frame;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (stopping)
+				return;
+
+			// the receiver is only swapped for a new connection under the lock, so the destructor always interrupts the current one
+			bool connecting = receiver.connect(port);
+			connected = connecting;
+			if (!connecting) {
+				stopped.wait_for(lock, std::chrono::milliseconds(500), [&]() { return stopping; });
+				continue;
+			}
+		}
+
+		while (receiver.receive(frame)) {
+			std::lock_guard<std::mutex> lock(mutex);
+			std::swap(latest, frame);
+			hasNewFrame = true;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		receiver.close();
+		connected = false;
+	}
+}
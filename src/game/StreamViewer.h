@@ -0,0 +1,41 @@
+#pragma once
+
+#include "game/FrameStream.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// the window side of FrameStream, receives the frames of a session on its own thread so the window keeps drawing while they arrive
+// started with --view [--port n], it connects again whenever the session stops and starts streaming
+class StreamViewer {
+public:
+	StreamViewer(uint16_t port);
+	~StreamViewer();
+
+	StreamViewer(const StreamViewer&) = delete;
+
+	// the newest frame since the last call, frames that arrived in between were applied but are never shown
+	bool takeFrame(FrameStream::Frame& frame);
+
+	bool isConnected();
+	uint16_t getPort();
+
+	// the port if the arguments ask for a viewer, 0 if they do not
+	static uint16_t requestedPort(int argc, char** argv);
+
+private:
+	void receiveFrames();
+
+	uint16_t port;
+	FrameStream::Receiver receiver;
+	std::thread thread;
+
+	std::mutex mutex;
+	std::condition_variable stopped;
+	bool stopping = false;
+	bool connected = false;
+	bool hasNewFrame = false;
+	FrameStream::Frame latest;
+};
@@ -0,0 +1,323 @@
+#include "game/TileCache.h"
+#include "game/FormulaProgram.h"
+#include "engine/Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+
+namespace {
+
+	const int T = TileCache::tileSize;
+
+	// levels this far above and below a tile are looked at for points it shares with them
+	const int maxLevelGap = 3;
+
+	int64_t floorDiv(int64_t a, int64_t b) {
+		int64_t q = a / b;
+		return q * b > a ? q - 1 : q;
+	}
+
+	std::string latticeOf(const MandelbrotView& view, bool smooth, const OrbitTrap& trap, double mantissaX, double mantissaY, int levelDifference) {
+		char text[512];
+		snprintf(text, sizeof(text), "%d %d %d %.17g %.17g %d %d %d %.17g %.17g %.17g %.17g %.17g %.17g %d ",
+			(int)view.formula, view.formula == MandelbrotView::Formula::Multibrot ? view.power : 0, view.julia, view.julia ? view.juliaX : 0.0, view.julia ? view.juliaY : 0.0,
+			view.maxItter, smooth, (int)trap.shape, trap.x, trap.y, trap.angle, trap.radius, mantissaX, mantissaY, levelDifference);
+
+		std::string lattice = text;
+		if (view.formula == MandelbrotView::Formula::Custom && view.program)
+			lattice += view.program->getSource();
+		return lattice;
+	}
+
+}
+
+struct TileCache::Rows::Tile {
+	std::vector<int> itters;
+	std::vector<float> smooth, trapDistances; // empty unless the lattice has them
+	std::vector<uint8_t> known;
+};
+
+size_t TileCache::KeyHash::operator()(const Key& key) const
+{
+	size_t hash = std::hash<std::string>()(key.lattice);
+	hash = hash * 31 + std::hash<int64_t>()(key.x);
+	hash = hash * 31 + std::hash<int64_t>()(key.y);
+	return hash * 31 + key.level;
+}
+
+TileCache::TileCache(size_t maxBytes) :
+	maxBytes(maxBytes)
+{
+}
+
+TileCache::Placement TileCache::place(const MandelbrotView& view, int width, int height, bool smooth, const OrbitTrap& trap)
+{
+	Placement placement;
+	placement.view = view;
+	placement.width = width;
+	placement.height = height;
+	placement.smooth = smooth;
+	placement.trap = trap;
+
+	// pixel x of the view is at ((x / width) * 3.5 - 1.75) * camZoom + camX, so the pitch is the size of a pixel
+	placement.pitchX = 3.5 * view.camZoom / width;
+	placement.pitchY = 2.0 * view.camZoom / height;
+
+	int exponentX, exponentY;
+	double mantissaX = std::frexp(placement.pitchX, &exponentX);
+	double mantissaY = std::frexp(placement.pitchY, &exponentY);
+	placement.level = exponentX;
+	placement.lattice = latticeOf(view, smooth, trap, mantissaX, mantissaY, exponentX - exponentY);
+
+	placement.originX = std::llround((view.camX - 1.75 * view.camZoom) / placement.pitchX);
+	placement.originY = std::llround((view.camY - 1.0 * view.camZoom) / placement.pitchY);
+	placement.view.camX = placement.originX * placement.pitchX + 1.75 * view.camZoom;
+	placement.view.camY = placement.originY * placement.pitchY + 1.0 * view.camZoom;
+	placement.view.camXLow = 0.0;
+	placement.view.camYLow = 0.0;
+	return placement;
+}
+
+bool TileCache::canPlace(const MandelbrotView& view, int width, int height)
+{
+	if (MandelbrotCPU::precisionFor(view, width, height) != MandelbrotCPU::Precision::Double)
+		return false;
+
+	double originX = (view.camX - 1.75 * view.camZoom) / (3.5 * view.camZoom / width);
+	double originY = (view.camY - 1.0 * view.camZoom) / (2.0 * view.camZoom / height);
+	return std::abs(originX) < 1e18 && std::abs(originY) < 1e18;
+}
+
+TileCache::Rows TileCache::prepare(const Placement& placement, int yBegin, int yEnd, int threadCount)
+{
+	Rows rows;
+	rows.placement = &placement;
+	rows.yBegin = yBegin;
+	rows.yEnd = yEnd;
+	if (yBegin >= yEnd)
+		return rows;
+
+	int64_t left = placement.originX, right = placement.originX + placement.width;
+	int64_t bottom = placement.originY + yBegin, top = placement.originY + yEnd;
+
+	rows.tileX0 = floorDiv(left, T);
+	rows.tileY0 = floorDiv(bottom, T);
+	int64_t tileX1 = floorDiv(right - 1, T), tileY1 = floorDiv(top - 1, T);
+	rows.tilesWide = (int)(tileX1 - rows.tileX0 + 1);
+
+	struct Job {
+		Key key;
+		Tile* tile;
+		int x0, x1, y0, y1;
+	};
+	std::vector<Job> jobs;
+
+	for (int64_t ty = rows.tileY0; ty <= tileY1; ty++) {
+		for (int64_t tx = rows.tileX0; tx <= tileX1; tx++) {
+			Key key = { placement.lattice, placement.level, tx, ty };
+			std::shared_ptr<Tile> tile = find(key, &placement);
+			rows.tiles.push_back(tile);
+
+			Job job = { key, tile.get(),
+				(int)(std::max(left, tx * T) - tx * T), (int)(std::min(right, tx * T + T) - tx * T),
+				(int)(std::max(bottom, ty * T) - ty * T), (int)(std::min(top, ty * T + T) - ty * T) };
+			jobs.push_back(job);
+		}
+	}
+
+	// every tile here is on the same level and only tiles of other levels are read while filling, so they can all be filled at once
+	Parallel::forEach((int)jobs.size(), threadCount, [&](int i) {
+		const Job& job = jobs[i];
+		fill(placement, job.key, *job.tile, job.x0, job.x1, job.y0, job.y1);
+	});
+
+	return rows;
+}
+
+void TileCache::fill(const Placement& placement, const Key& key, Tile& tile, int x0, int x1, int y0, int y1)
+{
+	uint64_t reused = 0, borrowed = 0, saved = 0;
+	std::vector<int> missing;
+	for (int b = y0; b < y1; b++) {
+		for (int a = x0; a < x1; a++) {
+			int index = b * T + a;
+			if (tile.known[index]) {
+				reused++;
+				saved += tile.itters[index];
+			}
+			else {
+				missing.push_back(index);
+			}
+		}
+	}
+
+	auto copyFrom = [&](const Tile& source, int sourceIndex, int index) {
+		tile.itters[index] = source.itters[sourceIndex];
+		if (!tile.smooth.empty())
+			tile.smooth[index] = source.smooth[sourceIndex];
+		if (!tile.trapDistances.empty())
+			tile.trapDistances[index] = source.trapDistances[sourceIndex];
+		tile.known[index] = 1;
+		borrowed++;
+		saved += tile.itters[index];
+	};
+
+	for (int k = 1; k <= maxLevelGap && !missing.empty(); k++) {
+		int s = 1 << k;
+
+		// point (i, j) here is point (i * s, j * s) of the level k below, which spreads this tile over s x s of its tiles
+		std::vector<std::shared_ptr<Tile>> finer(s * s);
+		std::vector<bool> looked(s * s, false);
+
+		// and if i and j are multiples of s it is point (i / s, j / s) of the level k above, which all fall in one tile
+		Key coarseKey = { key.lattice, key.level + k, floorDiv(key.x, s), floorDiv(key.y, s) };
+		std::shared_ptr<Tile> coarse = find(coarseKey, nullptr);
+		int coarseX = (int)(key.x - coarseKey.x * s) * (T / s), coarseY = (int)(key.y - coarseKey.y * s) * (T / s);
+
+		std::vector<int> stillMissing;
+		for (int index : missing) {
+			int a = index % T, b = index / T;
+
+			int fine = (b * s / T) * s + (a * s / T);
+			if (!looked[fine]) {
+				Key fineKey = { key.lattice, key.level - k, key.x * s + a * s / T, key.y * s + b * s / T };
+				finer[fine] = find(fineKey, nullptr);
+				looked[fine] = true;
+			}
+
+			int fineIndex = (b * s % T) * T + (a * s % T);
+			if (finer[fine] && finer[fine]->known[fineIndex]) {
+				copyFrom(*finer[fine], fineIndex, index);
+				continue;
+			}
+
+			if (coarse && a % s == 0 && b % s == 0) {
+				int coarseIndex = (coarseY + b / s) * T + coarseX + a / s;
+				if (coarse->known[coarseIndex]) {
+					copyFrom(*coarse, coarseIndex, index);
+					continue;
+				}
+			}
+
+			stillMissing.push_back(index);
+		}
+		missing.swap(stillMissing);
+	}
+
+	size_t count = missing.size();
+	if (count > 0) {
+		const MandelbrotView& view = placement.view;
+		std::vector<double> zx(count), zy(count), cx(count), cy(count);
+		for (size_t i = 0; i < count; i++) {
+			double px = (double)(key.x * T + missing[i] % T) * placement.pitchX;
+			double py = (double)(key.y * T + missing[i] / T) * placement.pitchY;
+			zx[i] = view.julia ? px : 0.0;
+			zy[i] = view.julia ? py : 0.0;
+			cx[i] = view.julia ? view.juliaX : px;
+			cy[i] = view.julia ? view.juliaY : py;
+		}
+
+		std::vector<int> itters(count);
+		std::vector<float> smooth(tile.smooth.empty() ? 0 : count);
+		std::vector<float> trapDistances(tile.trapDistances.empty() ? 0 : count);
+		MandelbrotCPU::renderPoints(view, &zx[0], &zy[0], &cx[0], &cy[0], (int)count, &itters[0], smooth.empty() ? nullptr : &smooth[0],
+			&placement.trap, trapDistances.empty() ? nullptr : &trapDistances[0]);
+
+		uint64_t computed = 0;
+		for (size_t i = 0; i < count; i++) {
+			int index = missing[i];
+			tile.itters[index] = itters[i];
+			if (!smooth.empty())
+				tile.smooth[index] = smooth[i];
+			if (!trapDistances.empty())
+				tile.trapDistances[index] = trapDistances[i];
+			tile.known[index] = 1;
+			computed += itters[i];
+		}
+
+		samplesComputed += count;
+		itterationsComputed += computed;
+	}
+
+	samplesReused += reused;
+	samplesBorrowed += borrowed;
+	itterationsSaved += saved;
+}
+
+std::shared_ptr<TileCache::Tile> TileCache::find(const Key& key, const Placement* creator)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto found = tiles.find(key);
+	if (found != tiles.end()) {
+		recent.splice(recent.begin(), recent, found->second.second);
+		return found->second.first;
+	}
+	if (!creator)
+		return nullptr;
+
+	std::shared_ptr<Tile> tile = std::make_shared<Tile>();
+	size_t points = (size_t)T * T;
+	tile->itters.resize(points);
+	tile->smooth.resize(creator->smooth ? points : 0);
+	tile->trapDistances.resize(creator->trap.shape != OrbitTrap::Shape::None ? points : 0);
+	tile->known.resize(points, 0);
+	size_t tileBytes = (tile->itters.size() + tile->smooth.size() + tile->trapDistances.size()) * 4 + points;
+
+	recent.push_front(key);
+	tiles[key] = { tile, recent.begin() };
+	bytes += tileBytes;
+
+	// tiles still being read by a Rows are kept alive by it after they leave the cache
+	while (bytes > maxBytes && recent.size() > 1) {
+		auto oldest = tiles.find(recent.back());
+		const Tile& evicted = *oldest->second.first;
+		bytes -= (evicted.itters.size() + evicted.smooth.size() + evicted.trapDistances.size()) * 4 + evicted.known.size();
+		tiles.erase(oldest);
+		recent.pop_back();
+		tilesEvicted++;
+	}
+
+	return tile;
+}
+
+TileCache::Stats TileCache::getStats()
+{
+	Stats stats;
+	stats.samplesComputed = samplesComputed;
+	stats.samplesReused = samplesReused;
+	stats.samplesBorrowed = samplesBorrowed;
+	stats.itterationsComputed = itterationsComputed;
+	stats.itterationsSaved = itterationsSaved;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.tilesEvicted = tilesEvicted;
+	return stats;
+}
+
+void TileCache::Rows::copyRow(int y, int* itters, float* smooth, float* trapDistances) const
+{
+	int64_t j = placement->originY + y;
+	int64_t ty = floorDiv(j, T);
+	int b = (int)(j - ty * T);
+	const std::shared_ptr<Tile>* row = &tiles[(size_t)(ty - tileY0) * tilesWide];
+
+	int x = 0;
+	while (x < placement->width) {
+		int64_t i = placement->originX + x;
+		int64_t tx = floorDiv(i, T);
+		int a = (int)(i - tx * T);
+		int run = std::min(T - a, placement->width - x);
+
+		const Tile& tile = *row[tx - tileX0];
+		size_t from = (size_t)b * T + a;
+		std::copy(&tile.itters[from], &tile.itters[from] + run, itters + x);
+		if (smooth)
+			std::copy(&tile.smooth[from], &tile.smooth[from] + run, smooth + x);
+		if (trapDistances)
+			std::copy(&tile.trapDistances[from], &tile.trapDistances[from] + run, trapDistances + x);
+		x += run;
+	}
+}
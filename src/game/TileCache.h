@@ -0,0 +1,112 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+#include "game/OrbitTrap.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// escape data of square tiles of a lattice of points on the plane, shared by every view placed on the same lattice so views that
+// overlap only itterate each point once
+//
+// point (i, j) of a level is the plane point (i * pitchX, j * pitchY), worked out with one multiply each so it is bit for bit the same whichever
+// view asks for it. a view is placed on the lattice of its own pixel size by moving it less than half a pixel. the level above has exactly twice
+// the pitch, so every other point of a level is a point of the level above with the same coordinates, and views zoomed in or out by powers of two
+// fill in each other's shared points too
+//
+// tiles are only filled where they have been asked for, a view that covers part of a tile does not pay for the rest of it
+class TileCache {
+public:
+	static const int tileSize = 64;
+
+	// a view placed on its lattice, pixel (x, y) of the width x height image is lattice point (originX + x, originY + y) of 'level'
+	struct Placement {
+		MandelbrotView view; // the view moved onto the lattice
+		int width = 0, height = 0;
+		bool smooth = false;
+		OrbitTrap trap;
+
+		std::string lattice; // everything that changes the escape data apart from the level and position
+		int level = 0;
+		int64_t originX = 0, originY = 0;
+		double pitchX = 0.0, pitchY = 0.0;
+	};
+
+	// tiles under a range of rows of a placed view, they are held here so eviction cannot free them while rows are copied out
+	class Rows {
+	public:
+		// copies row 'y' of the view, safe to call from several threads at once
+		void copyRow(int y, int* itters, float* smooth, float* trapDistances) const;
+
+		bool contains(int y) const { return y >= yBegin && y < yEnd; }
+
+	private:
+		friend class TileCache;
+		struct Tile;
+		const Placement* placement = nullptr;
+		int yBegin = 0, yEnd = 0;
+		int64_t tileX0 = 0, tileY0 = 0;
+		int tilesWide = 0;
+		std::vector<std::shared_ptr<Tile>> tiles;
+	};
+
+	struct Stats {
+		uint64_t samplesComputed = 0;
+		uint64_t samplesReused = 0;   // already in a tile of the same level
+		uint64_t samplesBorrowed = 0; // copied from a tile of another level
+		uint64_t itterationsComputed = 0;
+		uint64_t itterationsSaved = 0; // total escape count of every reused or borrowed sample
+		uint64_t tilesEvicted = 0;
+	};
+
+	// tiles that were used least recently are dropped once they take more than 'maxBytes'
+	TileCache(size_t maxBytes);
+
+	static Placement place(const MandelbrotView& view, int width, int height, bool smooth, const OrbitTrap& trap);
+
+	// false for views too deep for a lattice of doubles, those need a precision tier past double or are so far from
+	// the origin in pixels that their position does not fit in an int64, and are rendered without the cache
+	static bool canPlace(const MandelbrotView& view, int width, int height);
+
+	// makes sure rows [yBegin, yEnd) of a placed view are in the cache, itterating the missing points on 'threadCount' threads
+	// 'placement' must outlive the returned rows, and only one prepare() may run at a time
+	Rows prepare(const Placement& placement, int yBegin, int yEnd, int threadCount);
+
+	Stats getStats();
+
+private:
+	using Tile = Rows::Tile;
+
+	struct Key {
+		std::string lattice;
+		int level;
+		int64_t x, y;
+		bool operator==(const Key& other) const { return x == other.x && y == other.y && level == other.level && lattice == other.lattice; }
+	};
+	struct KeyHash {
+		size_t operator()(const Key& key) const;
+	};
+
+	// the tile if it is cached, otherwise null, or a new empty tile for 'creator' that has been added to the cache if that is set
+	std::shared_ptr<Tile> find(const Key& key, const Placement* creator);
+
+	// fills points [x0, x1) x [y0, y1) of 'tile', copying what it can from the cached levels above and below
+	void fill(const Placement& placement, const Key& key, Tile& tile, int x0, int x1, int y0, int y1);
+
+	size_t maxBytes;
+	size_t bytes = 0;
+
+	std::mutex mutex;
+	std::list<Key> recent; // most recently used first
+	std::unordered_map<Key, std::pair<std::shared_ptr<Tile>, std::list<Key>::iterator>, KeyHash> tiles;
+
+	std::atomic<uint64_t> samplesComputed{ 0 }, samplesReused{ 0 }, samplesBorrowed{ 0 };
+	std::atomic<uint64_t> itterationsComputed{ 0 }, itterationsSaved{ 0 };
+	uint64_t tilesEvicted = 0;
+};
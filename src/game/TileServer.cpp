@@ -0,0 +1,507 @@
+#include "game/TileServer.h"
+#include "game/HeadlessRenderer.h"
+#include "game/FormulaProgram.h"
+#include "game/MandelbrotCPU.h"
+#include "game/OrbitTrap.h"
+#include "game/Palette.h"
+#include "engine/PngWriter.h"
+#include "engine/Parallel.h"
+#include "engine/Json.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+
+	const int maxZoomLevel = 44; // past this neighbouring pixels are closer together than doubles can tell apart
+	const size_t maxFormulaLength = 1024;
+
+	std::string urlDecode(const std::string& text) {
+		std::string decoded;
+		for (size_t i = 0; i < text.size(); i++) {
+			if (text[i] == '+') {
+				decoded += ' ';
+			}
+			else if (text[i] == '%' && i + 2 < text.size()) {
+				decoded += (char)strtol(text.substr(i + 1, 2).c_str(), nullptr, 16);
+				i += 2;
+			}
+			else {
+				decoded += text[i];
+			}
+		}
+		return decoded;
+	}
+
+	bool parseInt(const std::string& text, int64_t& value) {
+		char* end;
+		value = strtoll(text.c_str(), &end, 10);
+		return !text.empty() && *end == '\0';
+	}
+
+	bool parseDouble(const std::string& text, double& value) {
+		char* end;
+		value = strtod(text.c_str(), &end);
+		return !text.empty() && *end == '\0' && std::isfinite(value);
+	}
+
+	bool respond(Socket& socket, const char* status, const char* contentType, const void* body, size_t size, bool keepAlive) {
+		char head[256];
+		int length = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nAccess-Control-Allow-Origin: *\r\nConnection: %s\r\n\r\n",
+			status, contentType, size, keepAlive ? "keep-alive" : "close");
+		return socket.sendAll(head, length) && socket.sendAll(body, size);
+	}
+
+	bool respondText(Socket& socket, const char* status, const std::string& text, bool keepAlive) {
+		return respond(socket, status, "text/plain", text.c_str(), text.size(), keepAlive);
+	}
+
+}
+
+struct TileServer::Request {
+	int z = 0;
+	int64_t x = 0, y = 0;
+	int size = 256;
+
+	MandelbrotView view;
+	bool smooth = false;
+	OrbitTrap trap;
+	float trapScale = 0.1f;
+
+	std::string key; // the same for every url that gives the same png
+};
+
+TileServer::TileServer(const Settings& settings) :
+	settings(settings),
+	renderSlots(settings.renderThreads > 0 ? settings.renderThreads : Parallel::defaultThreadCount())
+{
+}
+
+bool TileServer::run()
+{
+	Socket listener = Socket::listenLoopback(settings.port);
+	if (!listener.isValid()) {
+		printf("could not listen on port %d\n", settings.port);
+		return false;
+	}
+
+	printf("serving tiles on http://127.0.0.1:%d/{z}/{x}/{y}.png, counters on /stats\n", settings.port);
+	while (true) {
+		Socket client = listener.accept();
+		if (client.isValid())
+			std::thread(&TileServer::serveConnection, this, std::move(client)).detach();
+	}
+}
+
+void TileServer::serveConnection(Socket socket)
+{
+	std::string buffer;
+	char chunk[4096];
+
+	while (true) {
+		size_t headEnd;
+		while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+			int received = socket.receive(chunk, sizeof(chunk));
+			if (received <= 0 || buffer.size() > 16384)
+				return;
+			buffer.append(chunk, received);
+		}
+
+		std::string head = buffer.substr(0, headEnd);
+		buffer.erase(0, headEnd + 4);
+
+		std::string lowerHead = head;
+		std::transform(lowerHead.begin(), lowerHead.end(), lowerHead.begin(), [](char c) { return (char)tolower(c); });
+
+		size_t firstSpace = head.find(' '), secondSpace = head.find(' ', firstSpace + 1);
+		if (firstSpace == std::string::npos || secondSpace == std::string::npos) {
+			respondText(socket, "400 Bad Request", "bad request line\n", false);
+			return;
+		}
+		std::string method = head.substr(0, firstSpace);
+		std::string target = head.substr(firstSpace + 1, secondSpace - firstSpace - 1);
+		bool keepAlive = head.compare(secondSpace + 1, 8, "HTTP/1.1") == 0 && lowerHead.find("connection: close") == std::string::npos;
+
+		requests++;
+		bool sent;
+		if (method != "GET") {
+			sent = respondText(socket, "405 Method Not Allowed", "only GET is supported\n", keepAlive);
+		}
+		else if (target == "/stats") {
+			std::string json = statsJson();
+			sent = respond(socket, "200 OK", "application/json", json.c_str(), json.size(), keepAlive);
+		}
+		else {
+			Request request;
+			std::string error;
+			if (!parseRequest(target, request, error)) {
+				sent = respondText(socket, "404 Not Found", error + "\n", keepAlive);
+			}
+			else {
+				bool renderFailed = false;
+				std::shared_ptr<const std::vector<uint8_t>> png = getTile(request, socket, renderFailed);
+				if (renderFailed) {
+					sent = respondText(socket, "500 Internal Server Error", "the tile could not be rendered\n", keepAlive);
+				}
+				else if (!png) {
+					return;
+				}
+				else {
+					sent = respond(socket, "200 OK", "image/png", png->data(), png->size(), keepAlive);
+					if (sent)
+						bytesSent += png->size();
+				}
+			}
+		}
+
+		if (!sent || !keepAlive)
+			return;
+	}
+}
+
+bool TileServer::parseRequest(const std::string& target, Request& request, std::string& error)
+{
+	size_t queryStart = target.find('?');
+	std::string path = target.substr(0, queryStart);
+	std::string query = queryStart == std::string::npos ? "" : target.substr(queryStart + 1);
+
+	// /z/x/y.png
+	int64_t z, x, y;
+	size_t slash1 = path.find('/', 1), slash2 = slash1 == std::string::npos ? slash1 : path.find('/', slash1 + 1);
+	size_t extension = path.rfind(".png");
+	if (path.empty() || path[0] != '/' || slash2 == std::string::npos || extension == std::string::npos || extension + 4 != path.size() ||
+		!parseInt(path.substr(1, slash1 - 1), z) || !parseInt(path.substr(slash1 + 1, slash2 - slash1 - 1), x) ||
+		!parseInt(path.substr(slash2 + 1, extension - slash2 - 1), y)) {
+		error = "tiles are /z/x/y.png";
+		return false;
+	}
+	if (z < 0 || z > maxZoomLevel || x < 0 || y < 0 || x >= ((int64_t)1 << z) || y >= ((int64_t)1 << z)) {
+		error = "no such tile";
+		return false;
+	}
+	request.z = (int)z;
+	request.x = x;
+	request.y = y;
+
+	std::string palette = "linear";
+	size_t position = 0;
+	while (position < query.size()) {
+		size_t end = query.find('&', position);
+		if (end == std::string::npos)
+			end = query.size();
+		std::string parameter = query.substr(position, end - position);
+		position = end + 1;
+
+		size_t equals = parameter.find('=');
+		std::string name = parameter.substr(0, equals);
+		std::string value = equals == std::string::npos ? "" : urlDecode(parameter.substr(equals + 1));
+
+		bool valid = true;
+		int64_t number;
+		double real;
+		if (name == "itters") {
+			valid = parseInt(value, number) && number > 0 && number <= (1 << 20);
+			request.view.maxItter = (int)number;
+		}
+		else if (name == "palette") {
+			palette = value;
+			valid = palette == "linear" || palette == "smooth";
+		}
+		else if (name == "shift") {
+			valid = parseDouble(value, real);
+			request.view.colorShiftFactor = (float)real;
+		}
+		else if (name == "formula") {
+			if (value.size() > maxFormulaLength) {
+				error = "formula: longer than " + std::to_string(maxFormulaLength) + " characters";
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(programMutex);
+			auto compiled = programs.find(value);
+			if (compiled != programs.end()) {
+				request.view.formula = MandelbrotView::Formula::Custom;
+				request.view.program = compiled->second;
+			}
+			else if (!HeadlessRenderer::parseFormula(value, request.view, error)) {
+				error = "formula: " + error;
+				return false;
+			}
+			else if (request.view.program) {
+				if (programs.size() >= maxPrograms)
+					programs.clear();
+				programs[value] = request.view.program;
+			}
+		}
+		else if (name == "julia") {
+			size_t comma = value.find(',');
+			request.view.julia = true;
+			valid = comma != std::string::npos && parseDouble(value.substr(0, comma), request.view.juliaX) && parseDouble(value.substr(comma + 1), request.view.juliaY);
+		}
+		else if (name == "trap") {
+			valid = HeadlessRenderer::parseTrap(value, request.trap.shape);
+		}
+		else if (name == "trapscale") {
+			valid = parseDouble(value, real) && real > 0.0;
+			request.trapScale = (float)real;
+		}
+		else if (name == "size") {
+			valid = parseInt(value, number) && number >= 16 && number <= 1024;
+			request.size = (int)number;
+		}
+		else if (!name.empty()) {
+			error = "unknown parameter " + name;
+			return false;
+		}
+
+		if (!valid) {
+			error = "bad value for " + name;
+			return false;
+		}
+	}
+	request.smooth = palette == "smooth" && request.trap.shape == OrbitTrap::Shape::None;
+
+	const MandelbrotView& view = request.view;
+	char key[512];
+	snprintf(key, sizeof(key), "%d/%lld/%lld %d %d %.9g %d %d %d %.17g %.17g %d %.9g ", request.z, (long long)request.x, (long long)request.y, request.size,
+		view.maxItter, view.colorShiftFactor, request.smooth, (int)view.formula, view.power, view.julia ? view.juliaX : 0.0, view.julia ? view.juliaY : 0.0,
+		(int)request.trap.shape, request.trap.shape != OrbitTrap::Shape::None ? request.trapScale : 0.0f);
+	request.key = key;
+	if (view.formula == MandelbrotView::Formula::Custom)
+		request.key += view.program->getSource();
+	return true;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> TileServer::getTile(const Request& request, Socket& socket, bool& failed)
+{
+	std::shared_ptr<const std::vector<uint8_t>> png = findCached(request.key);
+	if (png) {
+		cacheHits++;
+		return png;
+	}
+
+	while (true) {
+		std::shared_ptr<Render> render;
+		bool owner = false;
+		{
+			std::lock_guard<std::mutex> lock(renderMutex);
+			auto found = rendering.find(request.key);
+			if (found != rendering.end()) {
+				render = found->second;
+				render->waiting++;
+				coalesced++;
+			}
+			else {
+				// a render may have finished since the cache was looked at
+				png = findCached(request.key);
+				if (png) {
+					cacheHits++;
+					return png;
+				}
+
+				render = std::make_shared<Render>();
+				render->waiting = 1;
+				rendering[request.key] = render;
+				owner = true;
+			}
+		}
+
+		if (!owner) {
+			// the client of the owner may disconnect while this one is still waiting, the render keeps going for this one then
+			std::unique_lock<std::mutex> lock(render->mutex);
+			while (!render->done) {
+				if (render->finished.wait_for(lock, std::chrono::milliseconds(50)) == std::cv_status::timeout && !render->done && socket.peerClosed()) {
+					render->waiting--;
+					return nullptr;
+				}
+			}
+			if (render->png)
+				return render->png;
+			if (render->failed) {
+				failed = true;
+				return nullptr;
+			}
+
+			// only cancelled if nobody was waiting, so this client joined just too late and starts it again
+			continue;
+		}
+
+		bool clientGone = false;
+		bool wasCancelled = false;
+		auto shouldStop = [&]() {
+			if (!clientGone && socket.peerClosed()) {
+				clientGone = true;
+				render->waiting--;
+			}
+			if (render->waiting > 0)
+				return false;
+
+			// nobody wants it any more, unless another client joined just now
+			std::lock_guard<std::mutex> lock(renderMutex);
+			if (render->waiting > 0)
+				return false;
+			rendering.erase(request.key);
+			wasCancelled = true;
+			return true;
+		};
+
+		bool stopped = false;
+		{
+			std::unique_lock<std::mutex> lock(slotMutex);
+			while (renderSlots == 0 && !stopped) {
+				slotFree.wait_for(lock, std::chrono::milliseconds(50));
+				stopped = renderSlots == 0 && shouldStop();
+			}
+			if (!stopped)
+				renderSlots--;
+		}
+
+		if (!stopped) {
+			png = renderTile(request, shouldStop);
+			{
+				std::lock_guard<std::mutex> lock(slotMutex);
+				renderSlots++;
+			}
+			slotFree.notify_one();
+		}
+
+		if (png) {
+			// cached before it stops being in flight so a new request always finds one or the other
+			addCached(request.key, png);
+			rendered++;
+		}
+		else if (wasCancelled) {
+			cancelled++;
+		}
+		else {
+			failures++;
+		}
+
+		// a cancelled render was already taken out, and a new one for the same tile may have been started since
+		{
+			std::lock_guard<std::mutex> lock(renderMutex);
+			auto found = rendering.find(request.key);
+			if (found != rendering.end() && found->second == render)
+				rendering.erase(found);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(render->mutex);
+			render->done = true;
+			render->png = png;
+			render->failed = !png && !wasCancelled;
+		}
+		render->finished.notify_all();
+
+		failed = render->failed && !clientGone;
+		return clientGone ? nullptr : png;
+	}
+}
+
+std::shared_ptr<const std::vector<uint8_t>> TileServer::renderTile(const Request& request, const std::function<bool()>& cancelled)
+{
+	const MandelbrotView& view = request.view;
+	int size = request.size;
+	bool trapped = request.trap.shape != OrbitTrap::Shape::None;
+
+	double span = 4.0 / (double)((int64_t)1 << request.z);
+	double pitch = span / size;
+	double left = -2.5 + request.x * span;
+	double top = 2.0 - request.y * span;
+
+	size_t pixels = (size_t)size * size;
+	std::vector<int> itters(pixels);
+	std::vector<float> smooth(request.smooth ? pixels : 0);
+	std::vector<float> trapDistances(trapped ? pixels : 0);
+
+	// pixels go from the top down like the png, the client is checked between chunks which are about the same amount of work whatever maxItter is
+	size_t chunk = std::min(pixels, std::max((size_t)64, ((size_t)1 << 24) / view.maxItter));
+	std::vector<double> zx(chunk), zy(chunk), cx(chunk), cy(chunk);
+	for (size_t begin = 0; begin < pixels; begin += chunk) {
+		if (cancelled())
+			return nullptr;
+
+		size_t count = std::min(chunk, pixels - begin);
+		for (size_t i = 0; i < count; i++) {
+			double x = left + ((begin + i) % size + 0.5) * pitch;
+			double y = top - ((begin + i) / size + 0.5) * pitch;
+			zx[i] = view.julia ? x : 0.0;
+			zy[i] = view.julia ? y : 0.0;
+			cx[i] = view.julia ? view.juliaX : x;
+			cy[i] = view.julia ? view.juliaY : y;
+		}
+
+		MandelbrotCPU::renderPoints(view, &zx[0], &zy[0], &cx[0], &cy[0], (int)count, &itters[begin], request.smooth ? &smooth[begin] : nullptr,
+			&request.trap, trapped ? &trapDistances[begin] : nullptr);
+	}
+
+	std::vector<uint8_t> rgba(pixels * 4);
+	if (trapped) {
+		MandelbrotCPU::colorizeTrapsRGBA8(&trapDistances[0], pixels, request.trapScale, view.colorShiftFactor, &rgba[0]);
+	}
+	else {
+		Palette palette;
+		palette.update(view.maxItter, view.colorShiftFactor);
+		if (request.smooth)
+			palette.colorizeSmooth(&smooth[0], pixels, &rgba[0]);
+		else
+			palette.colorize(&itters[0], pixels, &rgba[0]);
+	}
+
+	std::shared_ptr<std::vector<uint8_t>> png = std::make_shared<std::vector<uint8_t>>();
+	PngWriter writer(*png, size, size, 4, 1);
+	writer.writeRows(&rgba[0], size);
+	if (!writer.finish())
+		return nullptr;
+	return png;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> TileServer::findCached(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	auto found = cache.find(key);
+	if (found == cache.end())
+		return nullptr;
+
+	recent.splice(recent.begin(), recent, found->second.second);
+	return found->second.first;
+}
+
+void TileServer::addCached(const std::string& key, const std::shared_ptr<const std::vector<uint8_t>>& png)
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	if (cache.count(key))
+		return;
+
+	recent.push_front(key);
+	cache[key] = { png, recent.begin() };
+	cachedBytes += png->size() + key.size();
+
+	while (cachedBytes > settings.cacheBytes && recent.size() > 1) {
+		auto oldest = cache.find(recent.back());
+		cachedBytes -= oldest->second.first->size() + oldest->first.size();
+		cache.erase(oldest);
+		recent.pop_back();
+	}
+}
+
+std::string TileServer::statsJson()
+{
+	JsonValue stats = JsonValue::object();
+	stats.set("requests", JsonValue((double)requests));
+	stats.set("cacheHits", JsonValue((double)cacheHits));
+	stats.set("coalesced", JsonValue((double)coalesced));
+	stats.set("rendered", JsonValue((double)rendered));
+	stats.set("cancelled", JsonValue((double)cancelled));
+	stats.set("failed", JsonValue((double)failures));
+	stats.set("bytesSent", JsonValue((double)bytesSent));
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	stats.set("cachedTiles", JsonValue((double)cache.size()));
+	stats.set("cachedBytes", JsonValue((double)cachedBytes));
+	return stats.serialize();
+}
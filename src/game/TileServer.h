@@ -0,0 +1,92 @@
+#pragma once
+
+#include "engine/Socket.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class FormulaProgram;
+
+// serves png tiles of the set over http on 127.0.0.1, for map style viewers (leaflet, openlayers) that want tiles instead of whole frames
+//
+//   GET /z/x/y.png?itters=500&palette=smooth&shift=2&formula=burning-ship&julia=-0.8,0.156&trap=cross&trapscale=0.1&size=256
+//   GET /stats   counters as json
+//
+// tile 0/0/0 is the square from -2.5 - 2i to 1.5 + 2i, each zoom level splits every tile into 4 and y counts down from the top like a web map.
+// every parameter is optional. histogram coloring is not offered since every tile would get its own colors and the seams would show
+//
+// tiles are rendered on the connection's own thread with MandelbrotCPU, at most one per core at a time. a request for a tile that is already
+// being rendered waits for that render instead of starting another, and a render is stopped when every client that wanted it has disconnected.
+// finished pngs are kept in a cache that drops the least recently used ones
+class TileServer {
+public:
+	struct Settings {
+		uint16_t port = 8337;
+		size_t cacheBytes = (size_t)256 << 20;
+		int renderThreads = 0; // tiles rendered at once, 0 is one per core
+	};
+
+	TileServer(const Settings& settings);
+
+	// serves until the process is stopped, returns false straight away if the port could not be opened
+	bool run();
+
+private:
+	struct Request;
+
+	// one render that any number of clients may be waiting for
+	struct Render {
+		std::mutex mutex;
+		std::condition_variable finished;
+		bool done = false;
+		std::shared_ptr<const std::vector<uint8_t>> png; // null if it was cancelled or failed
+		bool failed = false;                             // it was not cancelled but gave no png
+		std::atomic<int> waiting{ 0 };                   // clients still connected that want it
+	};
+
+	void serveConnection(Socket socket);
+
+	// reads the path and query of a tile url, false with a message in 'error' if it is not a valid tile
+	bool parseRequest(const std::string& target, Request& request, std::string& error);
+
+	// the png of a tile, from the cache, another client's render or a new render, null if the client disconnected first
+	// or if the render failed, which sets 'failed'
+	std::shared_ptr<const std::vector<uint8_t>> getTile(const Request& request, Socket& socket, bool& failed);
+
+	// renders and encodes a tile, null if 'cancelled' returned true part way through
+	std::shared_ptr<const std::vector<uint8_t>> renderTile(const Request& request, const std::function<bool()>& cancelled);
+
+	std::shared_ptr<const std::vector<uint8_t>> findCached(const std::string& key);
+	void addCached(const std::string& key, const std::shared_ptr<const std::vector<uint8_t>>& png);
+
+	std::string statsJson();
+
+	Settings settings;
+
+	std::mutex programMutex;
+	std::map<std::string, std::shared_ptr<const FormulaProgram>> programs; // custom formulas are compiled once per source
+	static const size_t maxPrograms = 256;                                   // emptied when it fills, clients can send any number of sources
+
+	std::mutex renderMutex;
+	std::unordered_map<std::string, std::shared_ptr<Render>> rendering;
+
+	std::mutex slotMutex;
+	std::condition_variable slotFree;
+	int renderSlots;
+
+	std::mutex cacheMutex;
+	std::list<std::string> recent; // most recently used first
+	std::unordered_map<std::string, std::pair<std::shared_ptr<const std::vector<uint8_t>>, std::list<std::string>::iterator>> cache;
+	size_t cachedBytes = 0;
+
+	std::atomic<uint64_t> requests{ 0 }, cacheHits{ 0 }, coalesced{ 0 }, rendered{ 0 }, cancelled{ 0 }, failures{ 0 }, bytesSent{ 0 };
+};
@@ -0,0 +1,318 @@
+#include "game/ViewState.h"
+#include "game/DoubleDouble.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+	// the longest decimal normalizeDecimal writes out
+	const int64_t maxDigits = 100000;
+
+	DoubleDouble powerOfTen(int n) {
+		DoubleDouble result = 1.0, base = 10.0;
+		for (; n > 0; n >>= 1) {
+			if (n & 1)
+				result = result * base;
+			base = base * base;
+		}
+		return result;
+	}
+
+	// the DoubleDouble nearest a normalized decimal, to within the last bit or two, infinite if it is too large for a double
+	DoubleDouble toDoubleDouble(const std::string& decimal) {
+		bool negative = !decimal.empty() && decimal[0] == '-';
+
+		std::string digits;
+		int fractionDigits = 0;
+		bool fraction = false;
+		for (char c : decimal) {
+			if (c == '.')
+				fraction = true;
+			else if (c >= '0' && c <= '9') {
+				digits += c;
+				fractionDigits += fraction;
+			}
+		}
+
+		size_t first = digits.find_first_not_of('0');
+		if (first == std::string::npos)
+			return 0.0;
+
+		// a DoubleDouble holds about 32 digits, the ones after those only move the point
+		std::string significant = digits.substr(first, 34);
+		int64_t exponent = (int64_t)(digits.size() - first - significant.size()) - fractionDigits;
+		if (exponent < -340)
+			return 0.0;
+
+		DoubleDouble value;
+		for (char c : significant)
+			value = value * 10.0 + (double)(c - '0');
+
+		// scaled in steps of at most 10^300, a larger power of ten would be infinite and dividing by it gives nan
+		while (exponent != 0) {
+			int step = (int)std::min<int64_t>(std::abs(exponent), 300);
+			if (exponent > 0) {
+				value = value * powerOfTen(step);
+				exponent -= step;
+			}
+			else {
+				value = value / powerOfTen(step);
+				exponent += step;
+			}
+			if (!std::isfinite(value.hi))
+				break;
+		}
+		return negative ? -value : value;
+	}
+
+	// 'value' rounded to 'decimals' places, normalized
+	std::string toDecimal(DoubleDouble value, int decimals) {
+		bool negative = value < 0.0;
+		if (negative)
+			value = -value;
+
+		value = value + DoubleDouble(0.5) / powerOfTen(decimals);
+		DoubleDouble whole = floor(value);
+		DoubleDouble fraction = value - whole;
+
+		std::string text = negative ? "-" : "";
+		text += std::to_string((long long)whole.hi + (long long)whole.lo);
+		if (decimals > 0)
+			text += '.';
+		for (int i = 0; i < decimals; i++) {
+			fraction = fraction * 10.0;
+			DoubleDouble digit = floor(fraction);
+			int d = std::min(std::max((int)digit.hi, 0), 9);
+			text += (char)('0' + d);
+			fraction = fraction - (double)d;
+		}
+
+		std::string normalized;
+		ViewState::normalizeDecimal(text, normalized);
+		return normalized;
+	}
+
+}
+
+ViewState::ViewState()
+{
+}
+
+ViewState ViewState::capture(const MandelbrotView& view)
+{
+	ViewState state;
+
+	// a pixel of a 4k export is about camZoom / 1000, a few more digits than that place the center to well under one
+	int decimals = std::min(std::max((int)std::ceil(-std::log10(view.camZoom)) + 6, 6), 32);
+	state.centerX = toDecimal(DoubleDouble(view.camX, view.camXLow), decimals);
+	state.centerY = toDecimal(DoubleDouble(view.camY, view.camYLow), decimals);
+
+	char zoom[32];
+	snprintf(zoom, sizeof(zoom), "%.14e", 1.0 / view.camZoom);
+	state.setZoom(zoom);
+	return state;
+}
+
+bool ViewState::setCenter(const std::string& x, const std::string& y)
+{
+	std::string normalizedX, normalizedY;
+	if (!normalizeDecimal(x, normalizedX) || !normalizeDecimal(y, normalizedY))
+		return false;
+
+	centerX = normalizedX;
+	centerY = normalizedY;
+	return true;
+}
+
+bool ViewState::setCenter(const std::string& text)
+{
+	size_t comma = text.find(',');
+	return comma != std::string::npos && setCenter(text.substr(0, comma), text.substr(comma + 1));
+}
+
+bool ViewState::setZoom(const std::string& text)
+{
+	std::string normalized;
+	if (!normalizeDecimal(text, normalized) || normalized[0] == '-')
+		return false;
+
+	size_t point = normalized.find('.');
+	std::string whole = normalized.substr(0, point);
+	std::string fraction = point == std::string::npos ? "" : normalized.substr(point + 1);
+
+	// the power of ten of the first significant digit
+	std::string digits = whole + fraction;
+	size_t first = digits.find_first_not_of('0');
+	if (first == std::string::npos)
+		return false;
+	int64_t exponent = (int64_t)whole.size() - 1 - (int64_t)first;
+
+	// the significant digits are kept as they were written, the double is only for apply()
+	std::string significant = digits.substr(first);
+	significant.erase(significant.find_last_not_of('0') + 1);
+
+	zoomDigits = significant;
+	zoomMantissa = strtod((significant.substr(0, 1) + "." + significant.substr(1)).c_str(), nullptr);
+	zoomExponent = exponent;
+	return true;
+}
+
+const std::string& ViewState::getCenterX() const
+{
+	return centerX;
+}
+
+const std::string& ViewState::getCenterY() const
+{
+	return centerY;
+}
+
+std::string ViewState::getZoom() const
+{
+	std::string scientific = zoomDigits.substr(0, 1) + (zoomDigits.size() > 1 ? "." + zoomDigits.substr(1) : "") + "e" + std::to_string(zoomExponent);
+
+	// written out like %g would when that is short
+	std::string plain;
+	if (zoomExponent >= -4 && zoomExponent <= 6 && normalizeDecimal(scientific, plain))
+		return plain;
+	return scientific;
+}
+
+double ViewState::getZoomMantissa() const
+{
+	return zoomMantissa;
+}
+
+int64_t ViewState::getZoomExponent() const
+{
+	return zoomExponent;
+}
+
+bool ViewState::apply(MandelbrotView& view) const
+{
+	if (zoomExponent > 300 || zoomExponent < -300)
+		return false;
+
+	DoubleDouble x = toDoubleDouble(centerX);
+	DoubleDouble y = toDoubleDouble(centerY);
+	if (!std::isfinite(x.hi) || !std::isfinite(y.hi))
+		return false;
+
+	view.camX = x.hi;
+	view.camXLow = x.lo;
+	view.camY = y.hi;
+	view.camYLow = y.lo;
+	view.camZoom = 1.0 / (zoomMantissa * std::pow(10.0, (double)zoomExponent));
+	return true;
+}
+
+MandelbrotCPU::Precision ViewState::getPrecision(int width, int height) const
+{
+	MandelbrotView view;
+	if (!apply(view))
+		return MandelbrotCPU::Precision::Beyond;
+	return MandelbrotCPU::precisionFor(view, width, height);
+}
+
+std::string ViewState::toArguments() const
+{
+	return "--center " + centerX + "," + centerY + " --zoom " + getZoom();
+}
+
+bool ViewState::parseArguments(const std::string& text)
+{
+	std::istringstream in(text);
+	std::vector<std::string> words;
+	for (std::string word; in >> word;)
+		words.push_back(word);
+
+	ViewState parsed = *this;
+	bool found = false;
+	for (size_t i = 0; i + 1 < words.size(); i++) {
+		if (words[i] == "--center") {
+			if (!parsed.setCenter(words[++i]))
+				return false;
+			found = true;
+		}
+		else if (words[i] == "--zoom") {
+			if (!parsed.setZoom(words[++i]))
+				return false;
+			found = true;
+		}
+	}
+
+	if (found)
+		*this = parsed;
+	return found;
+}
+
+bool ViewState::normalizeDecimal(const std::string& text, std::string& normalized)
+{
+	size_t i = 0;
+	bool negative = false;
+	if (i < text.size() && (text[i] == '+' || text[i] == '-'))
+		negative = text[i++] == '-';
+
+	std::string digits;
+	int64_t wholeDigits = -1; // before the point, -1 until there is one
+	for (; i < text.size(); i++) {
+		if (text[i] >= '0' && text[i] <= '9')
+			digits += text[i];
+		else if (text[i] == '.' && wholeDigits < 0)
+			wholeDigits = (int64_t)digits.size();
+		else
+			break;
+	}
+	if (digits.empty())
+		return false;
+	if (wholeDigits < 0)
+		wholeDigits = (int64_t)digits.size();
+
+	if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+		i++;
+		bool negativeExponent = false;
+		if (i < text.size() && (text[i] == '+' || text[i] == '-'))
+			negativeExponent = text[i++] == '-';
+
+		int64_t exponent = 0;
+		size_t exponentStart = i;
+		for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; i++) {
+			exponent = exponent * 10 + (text[i] - '0');
+			if (exponent > maxDigits)
+				return false;
+		}
+		if (i == exponentStart)
+			return false;
+		wholeDigits += negativeExponent ? -exponent : exponent;
+	}
+	if (i != text.size() || wholeDigits > maxDigits || wholeDigits < -maxDigits)
+		return false;
+
+	// the point moved to after 'wholeDigits' digits
+	std::string whole, fraction;
+	if (wholeDigits <= 0) {
+		fraction = std::string((size_t)-wholeDigits, '0') + digits;
+	}
+	else if (wholeDigits >= (int64_t)digits.size()) {
+		whole = digits + std::string((size_t)(wholeDigits - (int64_t)digits.size()), '0');
+	}
+	else {
+		whole = digits.substr(0, (size_t)wholeDigits);
+		fraction = digits.substr((size_t)wholeDigits);
+	}
+
+	whole.erase(0, std::min(whole.find_first_not_of('0'), whole.size()));
+	if (whole.empty())
+		whole = "0";
+	size_t lastDigit = fraction.find_last_not_of('0');
+	fraction.erase(lastDigit == std::string::npos ? 0 : lastDigit + 1);
+
+	bool zero = whole == "0" && fraction.empty();
+	normalized = (negative && !zero ? "-" : "") + whole + (fraction.empty() ? "" : "." + fraction);
+	return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "game/MandelbrotCPU.h"
+
+#include <cstdint>
+#include <string>
+
+// where a view is and how far it is zoomed in, exactly, so deep locations can be saved, shared and rendered again
+//
+// the center is kept as decimal text, either as it was typed or enough digits of a view's center to place it to a small fraction of a pixel,
+// and the zoom (the magnification shown on screen, 1 / camZoom) as a mantissa and a power of ten, so neither is rounded or runs out of range
+// here. apply() is the only place they become binary, in a MandelbrotView whose center is a DoubleDouble (camX + camXLow), and renderRow
+// then uses whichever precision tier the zoom needs, so shallow views never pay for the extra digits
+class ViewState {
+public:
+	// the default view, -0.5,0 at zoom 1
+	ViewState();
+
+	// the center of 'view' with as many digits as its zoom needs, and its zoom
+	static ViewState capture(const MandelbrotView& view);
+
+	// decimal numbers like "-0.7435669", "1.5e-3" or "+.25", kept exactly, false if either is not a number
+	bool setCenter(const std::string& x, const std::string& y);
+
+	// "x,y"
+	bool setCenter(const std::string& text);
+
+	// a positive number like "500" or "2.5e40" with any number of digits, false otherwise
+	bool setZoom(const std::string& text);
+
+	const std::string& getCenterX() const;
+	const std::string& getCenterY() const;
+
+	// every digit it was given, "500", "0.25" or "2.5e40"
+	std::string getZoom() const;
+	double getZoomMantissa() const; // from 1 to 10, rounded to a double
+	int64_t getZoomExponent() const;
+
+	// sets the center and camZoom of 'view', rounded to a DoubleDouble and a double
+	// returns false without changing it if the zoom or center does not fit in a double, which is far past what any tier can render anyway
+	bool apply(MandelbrotView& view) const;
+
+	// the tier renderRow will use for the view at width x height
+	MandelbrotCPU::Precision getPrecision(int width, int height) const;
+
+	// "--center x,y --zoom z", which the command line reads back
+	std::string toArguments() const;
+
+	// the --center and --zoom of text like toArguments() writes, anything else in it is ignored
+	// false if it has neither or they are not valid, the state is only changed when it returns true
+	bool parseArguments(const std::string& text);
+
+	// a decimal number written with no exponent, no leading zeros before the point and no trailing zeros after it
+	// false if 'text' is not a number or its exponent is too large to write out (over 100000 digits)
+	static bool normalizeDecimal(const std::string& text, std::string& normalized);
+
+private:
+	std::string centerX = "-0.5";
+	std::string centerY = "0";
+	std::string zoomDigits = "1"; // significant digits of the zoom, the point goes after the first
+	double zoomMantissa = 1.0;
+	int64_t zoomExponent = 0;
+};